@@ -17,18 +17,44 @@
  * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
  **/
 
-#ifndef DAE_LOAD_H
-#define DAE_LOAD_H
+#ifndef LUFTBALLONS_DAE_LOAD_H
+#define LUFTBALLONS_DAE_LOAD_H
 #include <luftballons/object.h>
 
+/**
+ * Totals for the meshes the COLLADA loader has loaded.
+ *
+ * meshes: Meshes loaded.
+ * corners: Polygon corners in the files. Without merging shared vertices
+ *          each would be its own vertex.
+ * verts: Vertices left after merging corners with all the same data.
+ * bytes_in: Vertex and index bytes the meshes would take up unmerged.
+ * bytes_out: Vertex and index bytes the meshes take up.
+ * tris: Triangles loaded.
+ * misses_before, misses_after: Simulated vertex cache misses drawing the
+ *                              meshes before and after optimisation. Divide
+ *                              by tris or verts for ACMR or ATVR.
+ **/
+typedef struct dae_load_stats {
+	size_t meshes;
+	size_t corners;
+	size_t verts;
+	size_t bytes_in;
+	size_t bytes_out;
+	size_t tris;
+	size_t misses_before;
+	size_t misses_after;
+} luft_dae_load_stats_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 luft_object_t **luft_dae_load(const char *filename, size_t *count);
+void luft_dae_get_stats(luft_dae_load_stats_t *out);
 
 #ifdef __cplusplus
 }
 #endif
 
-#endif /* DAE_LOAD_H */
+#endif /* LUFTBALLONS_DAE_LOAD_H */
@@ -60,6 +60,7 @@ void luft_draw_op_deactivate_material(luft_draw_op_t *draw_op,
 				      luft_material_t mat);
 void luft_draw_op_set_uniform(luft_draw_op_t *op, luft_material_t mat,
 			      luft_uniform_type_t type, ...);
+void luft_draw_op_set_name(luft_draw_op_t *op, const char *name);
 void luft_draw_op_grab(luft_draw_op_t *op);
 void luft_draw_op_ungrab(luft_draw_op_t *op);
 void luft_draw_op_exec(luft_draw_op_t *op);
@@ -53,6 +53,7 @@ void luft_draw_proc_set_colorbuf(luft_draw_proc_t *draw_proc,
 void luft_draw_proc_set_uniform(luft_draw_proc_t *draw_proc,
 				luft_material_t mat,
 				luft_uniform_type_t type, ...);
+void luft_draw_proc_set_name(luft_draw_proc_t *draw_proc, const char *name);
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,51 @@
+/**
+ * Copyright © 2013 Casey Dahlin
+ *
+ * This file is part of Luftballons.
+ *
+ * Luftballons is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Luftballons is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef LUFTBALLONS_GL_CHECK_H
+#define LUFTBALLONS_GL_CHECK_H
+
+/**
+ * How often Luftballons asks OpenGL whether something went wrong. Each check
+ * is a glGetError call, which can make the driver wait for the GPU.
+ *
+ * LUFT_GL_CHECK_NONE: Never check.
+ * LUFT_GL_CHECK_MEM: Check only after allocating buffers, so we can recover
+ * when the GPU runs out of memory. Errors from other calls are ignored.
+ * LUFT_GL_CHECK_FULL: Check after almost every call, and die on any error.
+ **/
+typedef enum {
+	LUFT_GL_CHECK_NONE,
+	LUFT_GL_CHECK_MEM,
+	LUFT_GL_CHECK_FULL,
+} luft_gl_check_level_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void luft_gl_check_set_level(luft_gl_check_level_t level);
+luft_gl_check_level_t luft_gl_check_get_level(void);
+int luft_gl_debug_enable(int synchronous);
+void luft_gl_debug_disable(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LUFTBALLONS_GL_CHECK_H */
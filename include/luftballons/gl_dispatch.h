@@ -0,0 +1,54 @@
+/**
+ * Copyright © 2013 Casey Dahlin
+ *
+ * This file is part of Luftballons.
+ *
+ * Luftballons is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Luftballons is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef LUFTBALLONS_GL_DISPATCH_H
+#define LUFTBALLONS_GL_DISPATCH_H
+
+#include <stdlib.h>
+
+/**
+ * Where GL calls go when Luftballons is built with the dispatch layer.
+ *
+ * LUFT_GL_BACKEND_REAL: Pass calls through to the system's GL.
+ * LUFT_GL_BACKEND_NULL: Drop calls, returning plausible values, so no context
+ * (or display, or GPU) is needed.
+ **/
+typedef enum {
+	LUFT_GL_BACKEND_REAL,
+	LUFT_GL_BACKEND_NULL,
+} luft_gl_backend_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int luft_gl_dispatch_available(void);
+void luft_gl_set_backend(luft_gl_backend_t backend);
+const char *luft_gl_entry_point(size_t idx);
+size_t luft_gl_call_count(const char *name);
+void luft_gl_reset_counts(void);
+void luft_gl_record(int enable);
+size_t luft_gl_recorded_calls(void);
+const char *luft_gl_recorded_call(size_t idx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LUFTBALLONS_GL_DISPATCH_H */
@@ -0,0 +1,53 @@
+/**
+ * Copyright © 2013 Casey Dahlin
+ *
+ * This file is part of Luftballons.
+ *
+ * Luftballons is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Luftballons is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef LUFTBALLONS_MESH_CACHE_H
+#define LUFTBALLONS_MESH_CACHE_H
+
+#include <stdlib.h>
+
+/**
+ * What happens to a mesh's copy of its vertex and index data once the data
+ * is on the GPU.
+ *
+ * LUFT_MESH_KEEP_DATA: Keep the copy in memory for as long as the mesh
+ * lives.
+ * LUFT_MESH_RELEASE_DATA: Let go of the copy once it's uploaded, and get it
+ * back if the mesh is evicted and has to be uploaded again. The data is
+ * written to the mesh cache file first and mapped back in from there.
+ * Dynamic meshes always keep their copy.
+ **/
+typedef enum {
+	LUFT_MESH_KEEP_DATA,
+	LUFT_MESH_RELEASE_DATA,
+} luft_mesh_residency_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void luft_mesh_set_residency(luft_mesh_residency_t residency);
+void luft_mesh_cache_set_dir(const char *dir);
+size_t luft_mesh_get_data_bytes(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LUFTBALLONS_MESH_CACHE_H */
@@ -29,8 +29,16 @@ extern "C" {
 #endif
 
 luft_shader_t *luft_shader_create(const char *vertex, const char *frag);
+luft_shader_t *luft_shader_create_async(const char *vertex, const char *frag);
+luft_shader_t *luft_shader_create_variant(const char *vertex, const char *frag,
+					  const char *const *defines);
+int luft_shader_ready(luft_shader_t *shader);
+void luft_shader_wait(luft_shader_t *shader);
+void luft_shader_set_fallback(luft_shader_t *shader,
+			      luft_shader_t *fallback);
 void luft_shader_grab(luft_shader_t *shader);
 void luft_shader_ungrab(luft_shader_t *shader);
+void luft_shader_set_cache_dir(const char *dir);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,78 @@
+/**
+ * Copyright © 2013 Casey Dahlin
+ *
+ * This file is part of Luftballons.
+ *
+ * Luftballons is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Luftballons is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef LUFTBALLONS_STATS_H
+#define LUFTBALLONS_STATS_H
+
+#include <stdlib.h>
+
+/**
+ * Engine-side work counted over the course of one frame.
+ *
+ * draws: Draw calls issued.
+ * state_changes: Draw states actually entered.
+ * uniform_uploads: Uniform values handed to OpenGL.
+ * buffer_bytes: Bytes of vertex and element data uploaded.
+ * texture_binds: Textures bound to texture units.
+ * gl_calls_skipped: GL state calls dropped because the driver already had
+ *                   that state.
+ * stream_stalls: Times we waited for the GPU to finish with part of the
+ *                streaming ring before writing to it.
+ **/
+typedef struct stats_counters {
+	size_t draws;
+	size_t state_changes;
+	size_t uniform_uploads;
+	size_t buffer_bytes;
+	size_t texture_binds;
+	size_t gl_calls_skipped;
+	size_t stream_stalls;
+} luft_stats_counters_t;
+
+/**
+ * Timing for one instrumented pass (a draw_op or draw_proc run, or a clear).
+ *
+ * name: Name of the draw_op or draw_proc, or "clear".
+ * depth: How deeply nested in other passes this pass ran.
+ * cpu_ms: CPU time spent submitting the pass.
+ * gpu_ms: GPU time spent executing the pass.
+ **/
+typedef struct stats_pass {
+	const char *name;
+	size_t depth;
+	double cpu_ms;
+	double gpu_ms;
+} luft_stats_pass_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void luft_stats_enable(int enable);
+void luft_stats_frame_end(void);
+void luft_stats_get_counters(luft_stats_counters_t *out);
+size_t luft_stats_get_passes(const luft_stats_pass_t **passes);
+int luft_stats_dump_trace(const char *path);
+void luft_stats_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LUFTBALLONS_STATS_H */
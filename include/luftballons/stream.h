@@ -1,5 +1,3 @@
-#version 130
-
 /**
  * Copyright © 2013 Casey Dahlin
  *
@@ -19,20 +17,20 @@
  * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
  **/
 
-in vec4 colorout;
-in vec4 posout;
-in vec4 texcoordout;
-in vec4 normalout;
-uniform sampler2D last_depth;
-uniform int last_depth_valid;
+#ifndef LUFTBALLONS_STREAM_H
+#define LUFTBALLONS_STREAM_H
+
+#include <stdlib.h>
+#include <GL/gl.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
-void main()
-{
-	vec2 screen_pos = vec2(gl_FragCoord.x / 800, gl_FragCoord.y / 600);
-	float depth = texture2D(last_depth, screen_pos).r;
-	if (last_depth_valid != 0 && depth >= gl_FragCoord.z)
-		discard;
-	gl_FragData[0] = normalout;
-	gl_FragData[1] = posout;
-	gl_FragData[2] = colorout;
+void *luft_stream_alloc(size_t bytes, GLuint *buffer, size_t *offset);
+
+#ifdef __cplusplus
 }
+#endif
+
+#endif /* LUFTBALLONS_STREAM_H */
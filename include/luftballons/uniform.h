@@ -20,6 +20,8 @@
 #ifndef LUFTBALLONS_UNIFORM_H
 #define LUFTBALLONS_UNIFORM_H
 
+#include <stddef.h>
+
 #include <GL/gl.h>
 
 typedef struct uniform luft_uniform_t;
@@ -39,7 +41,10 @@ typedef enum {
 extern "C" {
 #endif
 
+size_t luft_uniform_name_id(const char *name);
 luft_uniform_t *luft_uniform_create(luft_uniform_type_t type, ...);
+luft_uniform_t *luft_uniform_create_id(luft_uniform_type_t type,
+				       size_t name_id, ...);
 void luft_uniform_grab(luft_uniform_t *uniform);
 void luft_uniform_ungrab(luft_uniform_t *uniform);
 
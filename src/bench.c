@@ -0,0 +1,1465 @@
+/**
+ * Copyright © 2013 Casey Dahlin
+ *
+ * This file is part of Luftballons.
+ *
+ * Luftballons is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Luftballons is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/**
+ * Headless benchmark. Builds a parameterised stress scene, runs it through the
+ * regular draw_proc pipeline for a fixed number of frames in a surfaceless EGL
+ * context, and reports frame times, engine counters and allocation counts as
+ * JSON on stdout.
+ **/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <err.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <luftballons/shader.h>
+#include <luftballons/uniform.h>
+#include <luftballons/texmap.h>
+#include <luftballons/colorbuf.h>
+#include <luftballons/quat.h>
+#include <luftballons/object.h>
+#include <luftballons/draw_proc.h>
+#include <luftballons/stats.h>
+#include <luftballons/gl_dispatch.h>
+#include <luftballons/gl_check.h>
+#include <luftballons/mesh_cache.h>
+
+#ifdef HAVE_COLLADA
+#include <luftballons/dae_load.h>
+#endif
+
+/* Procedural meshes and scene cloning need a little more than the public API
+ * offers.
+ */
+#include "object.h"
+#include "mesh.h"
+#include "vbuf_fmt.h"
+#include "interval.h"
+
+#ifndef BENCH_SRCDIR
+#define BENCH_SRCDIR "."
+#endif
+
+/**
+ * Benchmark parameters.
+ *
+ * planes: Number of aircraft instances in the scene.
+ * lights: Number of point lights.
+ * depth: Number of scene graph nodes between the root and each instance.
+ * colliders: Number of collision primitives tested against each other.
+ * frames: Frames to measure.
+ * warmup: Frames to run before measuring.
+ * width, height: Size of the render target.
+ * model: COLLADA file to instance, or NULL for a procedural stand-in.
+ * datadir: Directory containing the shaders.
+ * trace: File to write a pass timing trace to, or NULL.
+ * shader_cache: Directory to cache program binaries in, or NULL.
+ * null_gl: Use the null GL backend instead of a real context.
+ * gl_checks: How often to check for GL errors.
+ * gl_debug: Report driver messages through KHR_debug.
+ * churn: Operations to run the allocator churn benchmark for, or 0 to render.
+ * planar: Store the stand-in meshes with each segment whole, not interleaved.
+ * compress: Quantise the stand-in meshes' vertex data.
+ * update: Vertices of each stand-in mesh to rewrite every frame, or 0.
+ * release: Let go of CPU copies of mesh data once it's uploaded.
+ **/
+static struct {
+	size_t planes;
+	size_t lights;
+	size_t depth;
+	size_t colliders;
+	size_t frames;
+	size_t warmup;
+	size_t width;
+	size_t height;
+	const char *model;
+	const char *datadir;
+	const char *trace;
+	const char *shader_cache;
+	int null_gl;
+	luft_gl_check_level_t gl_checks;
+	int gl_debug;
+	size_t churn;
+	int planar;
+	int compress;
+	size_t update;
+	int release;
+} params = {
+	.planes = 16,
+	.lights = 4,
+	.depth = 4,
+	.colliders = 64,
+	.frames = 300,
+	.warmup = 10,
+	.width = 640,
+	.height = 480,
+	.model = NULL,
+	.datadir = BENCH_SRCDIR,
+	.trace = NULL,
+	.shader_cache = NULL,
+	.null_gl = 0,
+	.gl_checks = LUFT_GL_CHECK_FULL,
+	.gl_debug = 0,
+	.churn = 0,
+	.planar = 0,
+	.compress = 0,
+	.update = 0,
+	.release = 0,
+};
+
+/* Names for GL check levels on the command line and in the results. */
+static const char *const bench_gl_check_names[] = {
+	[LUFT_GL_CHECK_NONE] = "none",
+	[LUFT_GL_CHECK_MEM] = "mem",
+	[LUFT_GL_CHECK_FULL] = "full",
+};
+
+/**
+ * Everything in the scene we need to touch while it runs.
+ **/
+static struct {
+	luft_object_t *root;
+	luft_object_t *camera;
+	luft_object_t *output_light;
+	luft_object_t *collide_root;
+
+	luft_object_t **instances;
+	luft_object_t **colliders;
+
+	luft_material_t mesh_mat;
+	luft_material_t light_mat;
+
+	luft_draw_proc_t *frame_proc;
+
+	size_t mesh_count;
+	size_t vertex_bytes;
+
+	mesh_t **dynamic;
+	size_t num_dynamic;
+} scene;
+
+/**
+ * Allocation counting. We only count allocations on the thread running the
+ * benchmark, so driver worker threads don't make noise in the numbers.
+ **/
+static __thread int alloc_tracking = 0;
+static size_t alloc_count = 0;
+static size_t alloc_bytes = 0;
+static size_t free_count = 0;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+void *
+malloc(size_t size)
+{
+	if (alloc_tracking) {
+		alloc_count++;
+		alloc_bytes += size;
+	}
+
+	return __libc_malloc(size);
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+	if (alloc_tracking) {
+		alloc_count++;
+		alloc_bytes += nmemb * size;
+	}
+
+	return __libc_calloc(nmemb, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+	if (alloc_tracking) {
+		alloc_count++;
+		alloc_bytes += size;
+	}
+
+	return __libc_realloc(ptr, size);
+}
+
+void
+free(void *ptr)
+{
+	if (alloc_tracking && ptr)
+		free_count++;
+
+	__libc_free(ptr);
+}
+#define BENCH_ALLOCS_COUNTED 1
+#else
+#define BENCH_ALLOCS_COUNTED 0
+#endif
+
+/**
+ * Read the CPU clock in milliseconds.
+ **/
+static double
+bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/**
+ * Bring up a GL context with a pbuffer to draw in, without any display
+ * server.
+ **/
+static void
+bench_init_egl(void)
+{
+	PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display;
+	EGLDisplay display = EGL_NO_DISPLAY;
+	EGLSurface surface;
+	EGLContext context;
+	EGLConfig config;
+	EGLint num_configs;
+	EGLint config_attrs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_ALPHA_SIZE, 8,
+		EGL_DEPTH_SIZE, 24,
+		EGL_STENCIL_SIZE, 8,
+		EGL_NONE,
+	};
+	EGLint surface_attrs[] = {
+		EGL_WIDTH, params.width,
+		EGL_HEIGHT, params.height,
+		EGL_NONE,
+	};
+
+	get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+		eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+	if (get_platform_display)
+		display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,
+					       EGL_DEFAULT_DISPLAY, NULL);
+
+	if (display == EGL_NO_DISPLAY)
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	if (! eglInitialize(display, NULL, NULL))
+		errx(1, "Could not initialize EGL");
+
+	if (! eglBindAPI(EGL_OPENGL_API))
+		errx(1, "EGL does not support desktop OpenGL");
+
+	if (! eglChooseConfig(display, config_attrs, &config, 1,
+			      &num_configs) || ! num_configs)
+		errx(1, "No suitable EGL config");
+
+	surface = eglCreatePbufferSurface(display, config, surface_attrs);
+
+	if (surface == EGL_NO_SURFACE)
+		errx(1, "Could not create EGL pbuffer");
+
+	context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+
+	if (context == EGL_NO_CONTEXT)
+		errx(1, "Could not create EGL context");
+
+	if (! eglMakeCurrent(display, surface, surface, context))
+		errx(1, "Could not make EGL context current");
+}
+
+/**
+ * Build a mesh from separate position, normal and color arrays.
+ **/
+static mesh_t *
+bench_build_mesh(size_t verts, const float *pos, const float *norm,
+		 const float *color, size_t elems, const uint16_t *elem_data)
+{
+	vbuf_fmt_t format = 0;
+	vbuf_fmt_t iter;
+	const char *name;
+	size_t size;
+	char *data;
+	char *cursor;
+	mesh_t *ret;
+
+	vbuf_fmt_add(&format, "position", 4, GL_FLOAT);
+	vbuf_fmt_add(&format, "normal", 3, GL_FLOAT);
+	vbuf_fmt_add(&format, "color", 4, GL_FLOAT);
+
+	if (! params.planar)
+		format |= VBUF_FMT_INTERLEAVED;
+
+	if (params.compress)
+		format |= VBUF_FMT_COMPRESSED;
+
+	if (params.update)
+		format |= VBUF_FMT_DYNAMIC;
+
+	data = xmalloc(vbuf_fmt_vert_size(format) * verts);
+	cursor = data;
+	iter = format;
+
+	while (vbuf_fmt_pop_segment(&iter, NULL, NULL, &name, &size)) {
+		if (! strcmp(name, "position"))
+			memcpy(cursor, pos, size * verts);
+		else if (! strcmp(name, "normal"))
+			memcpy(cursor, norm, size * verts);
+		else
+			memcpy(cursor, color, size * verts);
+
+		cursor += size * verts;
+	}
+
+	ret = mesh_create(verts, data, elems, elem_data, GL_UNSIGNED_SHORT,
+			  format, GL_TRIANGLES);
+	free(data);
+
+	if (params.update) {
+		scene.dynamic = vec_expand(scene.dynamic, scene.num_dynamic);
+		scene.dynamic[scene.num_dynamic++] = ret;
+	}
+
+	return ret;
+}
+
+/**
+ * Create a cylinder along the Z axis, centered at the origin.
+ **/
+static mesh_t *
+bench_make_cylinder(float r, float len, size_t segs, size_t rings,
+		    const float color[4])
+{
+	size_t verts = (segs + 1) * (rings + 1);
+	size_t elems = segs * rings * 6;
+	float *pos = xcalloc(verts * 4, sizeof(float));
+	float *norm = xcalloc(verts * 3, sizeof(float));
+	float *colors = xcalloc(verts * 4, sizeof(float));
+	uint16_t *elem_data = xcalloc(elems, sizeof(uint16_t));
+	uint16_t *e = elem_data;
+	mesh_t *ret;
+	float angle;
+	size_t i, j, v;
+
+	for (j = 0; j <= rings; j++) {
+		for (i = 0; i <= segs; i++) {
+			v = j * (segs + 1) + i;
+			angle = 2 * M_PI * i / segs;
+
+			norm[v * 3] = cosf(angle);
+			norm[v * 3 + 1] = sinf(angle);
+			norm[v * 3 + 2] = 0;
+
+			pos[v * 4] = r * norm[v * 3];
+			pos[v * 4 + 1] = r * norm[v * 3 + 1];
+			pos[v * 4 + 2] = len * ((float)j / rings - .5);
+			pos[v * 4 + 3] = 1;
+
+			memcpy(&colors[v * 4], color, 4 * sizeof(float));
+		}
+	}
+
+	for (j = 0; j < rings; j++) {
+		for (i = 0; i < segs; i++) {
+			v = j * (segs + 1) + i;
+
+			*e++ = v;
+			*e++ = v + 1;
+			*e++ = v + segs + 1;
+			*e++ = v + 1;
+			*e++ = v + segs + 2;
+			*e++ = v + segs + 1;
+		}
+	}
+
+	ret = bench_build_mesh(verts, pos, norm, colors, elems, elem_data);
+
+	free(pos);
+	free(norm);
+	free(colors);
+	free(elem_data);
+
+	return ret;
+}
+
+/**
+ * Create an axis-aligned box centered at the given point.
+ **/
+static mesh_t *
+bench_make_box(const float center[3], const float size[3],
+	       const float color[4])
+{
+	float pos[24 * 4];
+	float norm[24 * 3];
+	float colors[24 * 4];
+	uint16_t elem_data[36];
+	size_t face, corner, axis, v;
+	float sign;
+	int u, w;
+
+	for (face = 0; face < 6; face++) {
+		axis = face / 2;
+		sign = (face & 1) ? 1 : -1;
+
+		for (corner = 0; corner < 4; corner++) {
+			v = face * 4 + corner;
+			u = (corner == 1 || corner == 2) ? 1 : -1;
+			w = (corner >= 2) ? 1 : -1;
+
+			if (sign < 0)
+				u = -u;
+
+			memset(&norm[v * 3], 0, 3 * sizeof(float));
+			norm[v * 3 + axis] = sign;
+
+			pos[v * 4 + axis] = sign;
+			pos[v * 4 + (axis + 1) % 3] = u;
+			pos[v * 4 + (axis + 2) % 3] = w;
+
+			pos[v * 4] = center[0] + pos[v * 4] * size[0] / 2;
+			pos[v * 4 + 1] = center[1] + pos[v * 4 + 1] * size[1] / 2;
+			pos[v * 4 + 2] = center[2] + pos[v * 4 + 2] * size[2] / 2;
+			pos[v * 4 + 3] = 1;
+
+			memcpy(&colors[v * 4], color, 4 * sizeof(float));
+		}
+
+		elem_data[face * 6] = face * 4;
+		elem_data[face * 6 + 1] = face * 4 + 1;
+		elem_data[face * 6 + 2] = face * 4 + 2;
+		elem_data[face * 6 + 3] = face * 4;
+		elem_data[face * 6 + 4] = face * 4 + 2;
+		elem_data[face * 6 + 5] = face * 4 + 3;
+	}
+
+	return bench_build_mesh(24, pos, norm, colors, 36, elem_data);
+}
+
+/**
+ * Attach a mesh to a new child of the given object.
+ **/
+static void
+bench_add_mesh(object_t *parent, mesh_t *mesh, const char *name)
+{
+	object_t *object = object_create(parent);
+
+	object_set_mesh(object, mesh);
+	object_set_name(object, name);
+	object_ungrab(object);
+	mesh_ungrab(mesh);
+}
+
+/**
+ * Build a rough aircraft out of primitives, for when we can't load the
+ * reference model.
+ **/
+static object_t *
+bench_make_standin(void)
+{
+	static const float body[4] = { .6, .6, .65, 1 };
+	static const float trim[4] = { .8, .2, .1, 1 };
+	static const float wing_pos[3] = { 0, -.05, .1 };
+	static const float wing_size[3] = { 1.8, .04, .35 };
+	static const float tail_pos[3] = { 0, 0, -.7 };
+	static const float tail_size[3] = { .6, .03, .2 };
+	static const float fin_pos[3] = { 0, .15, -.7 };
+	static const float fin_size[3] = { .03, .3, .2 };
+	object_t *ret = object_create(NULL);
+
+	bench_add_mesh(ret, bench_make_cylinder(.15, 1.6, 32, 32, body),
+		       "fuselage");
+	bench_add_mesh(ret, bench_make_box(wing_pos, wing_size, body), "wing");
+	bench_add_mesh(ret, bench_make_box(tail_pos, tail_size, trim), "tail");
+	bench_add_mesh(ret, bench_make_box(fin_pos, fin_size, trim), "fin");
+
+	return ret;
+}
+
+/**
+ * Print how much merging shared vertices saved when loading the model.
+ **/
+static void
+bench_print_import(void)
+{
+#ifdef HAVE_COLLADA
+	luft_dae_load_stats_t stats;
+
+	if (! params.model)
+		return;
+
+	luft_dae_get_stats(&stats);
+	printf("\t\"import\": {\"meshes\": %zu, \"corners\": %zu, "
+	       "\"verts\": %zu, \"bytes_in\": %zu, \"bytes_out\": %zu, "
+	       "\"acmr_before\": %.3f, \"acmr_after\": %.3f},\n",
+	       stats.meshes, stats.corners, stats.verts, stats.bytes_in,
+	       stats.bytes_out,
+	       stats.tris ? stats.misses_before / (double)stats.tris : 0,
+	       stats.tris ? stats.misses_after / (double)stats.tris : 0);
+#endif
+}
+
+/**
+ * Get the resident set size of this process, or 0 if we can't tell.
+ **/
+static size_t
+bench_rss(void)
+{
+	FILE *fp = fopen("/proc/self/statm", "r");
+	size_t size;
+	size_t resident = 0;
+
+	if (! fp)
+		return 0;
+
+	if (fscanf(fp, "%zu %zu", &size, &resident) != 2)
+		resident = 0;
+
+	fclose(fp);
+	return resident * sysconf(_SC_PAGESIZE);
+}
+
+/**
+ * Print how much memory the loaded scene takes.
+ *
+ * setup_rss: Resident set size once the scene was built, before anything
+ *            was uploaded.
+ **/
+static void
+bench_print_memory(size_t setup_rss)
+{
+	printf("\t\"memory\": {\"residency\": \"%s\", \"setup_rss\": %zu, "
+	       "\"rss\": %zu, \"mesh_data_bytes\": %zu},\n",
+	       params.release ? "release" : "keep", setup_rss, bench_rss(),
+	       luft_mesh_get_data_bytes());
+}
+
+/**
+ * Load the model to instance, as a single object tree.
+ **/
+static object_t *
+bench_load_model(void)
+{
+#ifdef HAVE_COLLADA
+	object_t **items;
+	object_t *ret;
+	size_t count;
+	size_t i;
+
+	if (! params.model)
+		return bench_make_standin();
+
+	items = luft_dae_load(params.model, &count);
+	ret = object_create(NULL);
+
+	for (i = 0; i < count; i++) {
+		object_reparent(items[i], ret);
+		object_ungrab(items[i]);
+	}
+
+	free(items);
+	return ret;
+#else
+	if (params.model)
+		errx(1, "Built without COLLADA support, can't load %s",
+		     params.model);
+
+	return bench_make_standin();
+#endif
+}
+
+/**
+ * Make a copy of an object tree which shares the original's meshes. Lights,
+ * cameras and colliders in the source are left out.
+ **/
+static object_t *
+bench_instance(object_t *src, object_t *parent)
+{
+	object_t *ret = object_create(parent);
+	size_t i;
+
+	if (src->name)
+		object_set_name(ret, src->name);
+
+	ret->rot = src->rot;
+	memcpy(ret->trans, src->trans, sizeof(ret->trans));
+	memcpy(ret->scale, src->scale, sizeof(ret->scale));
+	object_apply_pretransform(ret, src->pretransform);
+
+	if (src->type == OBJ_MESH) {
+		object_set_mesh(ret, src->mesh);
+		object_set_material(ret, scene.mesh_mat);
+		scene.mesh_count++;
+		scene.vertex_bytes += vbuf_fmt_vert_size(src->mesh->format) *
+			src->mesh->verts;
+	}
+
+	for (i = 0; i < src->child_count; i++)
+		object_ungrab(bench_instance(src->children[i], ret));
+
+	return ret;
+}
+
+/**
+ * Place the aircraft instances in a grid in front of the camera, each at the
+ * bottom of a chain of params.depth nodes.
+ **/
+static void
+bench_build_instances(void)
+{
+	object_t *model = bench_load_model();
+	size_t grid = ceil(sqrt(params.planes));
+	object_t *parent;
+	object_t *node;
+	float offset[3];
+	size_t i, j;
+
+	scene.instances = xcalloc(params.planes, sizeof(object_t *));
+
+	for (i = 0; i < params.planes; i++) {
+		offset[0] = ((float)(i % grid) - (grid - 1) / 2.0) * 2.5;
+		offset[1] = -1;
+		offset[2] = -4 - (float)(i / grid) * 2.5;
+
+		parent = scene.root;
+
+		for (j = 0; j < params.depth; j++) {
+			node = luft_object_create(parent);
+
+			if (parent != scene.root)
+				luft_object_ungrab(node);
+
+			if (! j) {
+				luft_object_move(node, offset);
+				scene.instances[i] = node;
+			}
+
+			parent = node;
+		}
+
+		node = bench_instance(model, parent);
+
+		if (! params.depth) {
+			luft_object_move(node, offset);
+			scene.instances[i] = node;
+		} else {
+			luft_object_ungrab(node);
+		}
+	}
+
+	luft_object_ungrab(model);
+}
+
+/**
+ * Scatter point lights above the instance grid.
+ **/
+static void
+bench_build_lights(void)
+{
+	luft_object_t *light;
+	float color[3];
+	float pos[3];
+	float angle;
+	size_t i;
+
+	for (i = 0; i < params.lights; i++) {
+		angle = 2 * M_PI * i / params.lights;
+
+		color[0] = .5 + .5 * cosf(angle);
+		color[1] = .5 + .5 * cosf(angle + 2 * M_PI / 3);
+		color[2] = .5 + .5 * cosf(angle + 4 * M_PI / 3);
+
+		pos[0] = 6 * cosf(angle);
+		pos[1] = 3;
+		pos[2] = -8 + 6 * sinf(angle);
+
+		light = luft_object_create(scene.root);
+		luft_object_make_light(light, color);
+		luft_object_move(light, pos);
+		luft_object_set_material(light, scene.light_mat);
+		luft_object_ungrab(light);
+	}
+}
+
+/**
+ * Build a field of collision primitives. They aren't drawn, but every pair is
+ * tested each frame.
+ **/
+static void
+bench_build_colliders(void)
+{
+	size_t grid = ceil(cbrt(params.colliders));
+	float pos[3];
+	size_t i;
+
+	scene.collide_root = luft_object_create(NULL);
+	scene.colliders = xcalloc(params.colliders, sizeof(object_t *));
+
+	for (i = 0; i < params.colliders; i++) {
+		scene.colliders[i] = luft_object_create(scene.collide_root);
+
+		if (i % 3 == 0)
+			luft_object_make_sphere_collider(scene.colliders[i], .6);
+		else if (i % 3 == 1)
+			luft_object_make_box_collider(scene.colliders[i],
+						      1, .8, .6);
+		else
+			luft_object_make_cylinder_collider(scene.colliders[i],
+							   .4, 1);
+
+		pos[0] = 3.0 * (i % grid);
+		pos[1] = 3.0 * (i / grid % grid);
+		pos[2] = 3.0 * (i / grid / grid);
+
+		luft_object_move(scene.colliders[i], pos);
+	}
+}
+
+/**
+ * Create a render target texture the size of our output.
+ **/
+static luft_texmap_t *
+bench_target(unsigned int flags)
+{
+	luft_texmap_t *ret = luft_texmap_create(0, 0, flags);
+
+	luft_texmap_init_blank(ret, 0, params.width, params.height);
+
+	return ret;
+}
+
+/**
+ * Start loading a shader from the data directory.
+ *
+ * variant: Load as a shader variant, specialised per vertex format.
+ **/
+static luft_shader_t *
+bench_shader(const char *vertex, const char *frag, int variant)
+{
+	char *vpath;
+	char *fpath;
+	luft_shader_t *ret;
+
+	if (asprintf(&vpath, "%s/%s", params.datadir, vertex) < 0 ||
+	    asprintf(&fpath, "%s/%s", params.datadir, frag) < 0)
+		errx(1, "Could not allocate shader path");
+
+	if (variant)
+		ret = luft_shader_create_variant(vpath, fpath, NULL);
+	else
+		ret = luft_shader_create_async(vpath, fpath);
+
+	free(vpath);
+	free(fpath);
+
+	return ret;
+}
+
+/**
+ * Set up the same deferred pipeline the demo uses: a geometry pass into a
+ * set of float buffers, a lighting pass per light, and a copy to the output.
+ **/
+static void
+bench_build_pipeline(void)
+{
+	float clear_color[4] = { 0, 0, 0, 0 };
+	float white[3] = { 1, 1, 1 };
+	luft_texmap_t *normal_texmap = bench_target(LUFT_TEXMAP_FLOAT32);
+	luft_texmap_t *position_texmap = bench_target(LUFT_TEXMAP_FLOAT32);
+	luft_texmap_t *diffuse_texmap = bench_target(LUFT_TEXMAP_FLOAT32);
+	luft_texmap_t *depth_texmap = bench_target(LUFT_TEXMAP_DEPTH |
+						   LUFT_TEXMAP_STENCIL);
+	luft_texmap_t *gather_texmap = bench_target(0);
+	luft_colorbuf_t *gbuf;
+	luft_colorbuf_t *gather_cbuf;
+	luft_shader_t *scene_shader;
+	luft_shader_t *gather_shader;
+	luft_shader_t *output_shader;
+	luft_draw_op_t *scene_op;
+	luft_draw_op_t *gather_op;
+	luft_draw_op_t *output_op;
+	luft_draw_proc_t *geom_proc;
+	luft_draw_proc_t *gather_proc;
+
+	luft_colorbuf_init_output(LUFT_COLORBUF_CLEAR |
+				  LUFT_COLORBUF_CLEAR_DEPTH |
+				  LUFT_COLORBUF_DEPTH |
+				  LUFT_COLORBUF_STENCIL);
+	luft_colorbuf_clear_color(NULL, clear_color);
+	luft_colorbuf_clear_depth(NULL, 1.0);
+	luft_colorbuf_set_output_geom(params.width, params.height);
+
+	gbuf = luft_colorbuf_create(LUFT_COLORBUF_CLEAR |
+				    LUFT_COLORBUF_CLEAR_DEPTH |
+				    LUFT_COLORBUF_DEPTH |
+				    LUFT_COLORBUF_STENCIL);
+	luft_colorbuf_clear_color(gbuf, clear_color);
+	luft_colorbuf_clear_depth(gbuf, 1.0);
+	luft_colorbuf_set_buf(gbuf, 0, normal_texmap);
+	luft_colorbuf_set_buf(gbuf, 1, position_texmap);
+	luft_colorbuf_set_buf(gbuf, 2, diffuse_texmap);
+	luft_colorbuf_set_depth_buf(gbuf, depth_texmap);
+
+	gather_cbuf = luft_colorbuf_create(LUFT_COLORBUF_CLEAR);
+	luft_colorbuf_clear_color(gather_cbuf, clear_color);
+	luft_colorbuf_set_buf(gather_cbuf, 0, gather_texmap);
+
+	scene_shader = bench_shader("vertex.glsl", "fragment.glsl", 1);
+	gather_shader = bench_shader("vertex_quad.glsl",
+				     "fragment_lighting.glsl", 0);
+	output_shader = bench_shader("vertex_quad.glsl", "fragment_copy.glsl",
+				     0);
+
+	/* All three compile at once; the first frame shouldn't skip any. */
+	luft_shader_wait(scene_shader);
+	luft_shader_wait(gather_shader);
+	luft_shader_wait(output_shader);
+
+	scene_op = luft_draw_op_create(scene.root, scene.camera);
+	luft_draw_op_set_name(scene_op, "geometry");
+	luft_draw_op_set_shader(scene_op, scene_shader);
+	luft_draw_op_set_flags(scene_op, LUFT_DEPTH_TEST | LUFT_BF_CULL);
+	luft_draw_op_set_blend(scene_op, LUFT_BLEND_NONE);
+	luft_draw_op_activate_material(scene_op, scene.mesh_mat);
+	luft_draw_op_set_uniform(scene_op, LUFT_NO_MATERIAL,
+				 LUFT_UNIFORM_UINT, "last_depth_valid", 0);
+
+	gather_op = luft_draw_op_create(scene.root, scene.camera);
+	luft_draw_op_set_name(gather_op, "lighting");
+	luft_draw_op_set_shader(gather_op, gather_shader);
+	luft_draw_op_set_flags(gather_op, LUFT_BF_CULL);
+	luft_draw_op_clear_flags(gather_op, LUFT_DEPTH_TEST);
+	luft_draw_op_set_blend(gather_op, LUFT_BLEND_ADDITIVE);
+	luft_draw_op_activate_material(gather_op, scene.light_mat);
+	luft_draw_op_set_colorbuf(gather_op, gather_cbuf);
+	luft_draw_op_set_uniform(gather_op, LUFT_NO_MATERIAL,
+				 LUFT_UNIFORM_TEXMAP, "normal_buf",
+				 normal_texmap);
+	luft_draw_op_set_uniform(gather_op, LUFT_NO_MATERIAL,
+				 LUFT_UNIFORM_TEXMAP, "position_buf",
+				 position_texmap);
+	luft_draw_op_set_uniform(gather_op, LUFT_NO_MATERIAL,
+				 LUFT_UNIFORM_TEXMAP, "diffuse_buf",
+				 diffuse_texmap);
+
+	scene.output_light = luft_object_create(NULL);
+	luft_object_make_light(scene.output_light, white);
+	luft_object_set_material(scene.output_light, scene.light_mat);
+
+	output_op = luft_draw_op_create(scene.output_light, scene.camera);
+	luft_draw_op_set_name(output_op, "output");
+	luft_draw_op_set_shader(output_op, output_shader);
+	luft_draw_op_set_flags(output_op, LUFT_BF_CULL);
+	luft_draw_op_clear_flags(output_op, LUFT_DEPTH_TEST);
+	luft_draw_op_set_blend(output_op, LUFT_BLEND_REVERSE_ALPHA);
+	luft_draw_op_activate_material(output_op, scene.light_mat);
+	luft_draw_op_set_uniform(output_op, LUFT_NO_MATERIAL,
+				 LUFT_UNIFORM_TEXMAP, "in_buf", gather_texmap);
+
+	geom_proc = luft_draw_proc_create(1);
+	luft_draw_proc_set_name(geom_proc, "geometry_pass");
+	luft_draw_proc_set_colorbuf(geom_proc, gbuf);
+	luft_draw_proc_clear(geom_proc, gbuf);
+	luft_draw_proc_draw(geom_proc, scene_op);
+
+	gather_proc = luft_draw_proc_create(1);
+	luft_draw_proc_set_name(gather_proc, "lighting_pass");
+	luft_draw_proc_clear(gather_proc, gather_cbuf);
+	luft_draw_proc_draw(gather_proc, gather_op);
+	luft_draw_proc_draw(gather_proc, output_op);
+
+	scene.frame_proc = luft_draw_proc_create(1);
+	luft_draw_proc_set_name(scene.frame_proc, "frame");
+	luft_draw_proc_clear(scene.frame_proc, NULL);
+	luft_draw_proc_run_other(scene.frame_proc, geom_proc);
+	luft_draw_proc_run_other(scene.frame_proc, gather_proc);
+
+	luft_draw_proc_ungrab(geom_proc);
+	luft_draw_proc_ungrab(gather_proc);
+	luft_draw_op_ungrab(scene_op);
+	luft_draw_op_ungrab(gather_op);
+	luft_draw_op_ungrab(output_op);
+	luft_shader_ungrab(scene_shader);
+	luft_shader_ungrab(gather_shader);
+	luft_shader_ungrab(output_shader);
+	luft_colorbuf_ungrab(gbuf);
+	luft_colorbuf_ungrab(gather_cbuf);
+	luft_texmap_ungrab(normal_texmap);
+	luft_texmap_ungrab(position_texmap);
+	luft_texmap_ungrab(diffuse_texmap);
+	luft_texmap_ungrab(depth_texmap);
+	luft_texmap_ungrab(gather_texmap);
+}
+
+/**
+ * Build the whole scene.
+ **/
+static void
+bench_build_scene(void)
+{
+	scene.root = luft_object_create(NULL);
+	scene.mesh_mat = luft_material_alloc();
+	scene.light_mat = luft_material_alloc();
+
+	scene.camera = luft_object_create(scene.root);
+	luft_object_make_camera(scene.camera, 45, .01, 3000.0);
+	luft_camera_set_aspect(scene.camera,
+			       params.width / (float)params.height);
+
+	bench_build_instances();
+	bench_build_lights();
+	bench_build_colliders();
+	bench_build_pipeline();
+}
+
+/**
+ * Rewrite a window of a dynamic mesh's vertices, moving along each frame.
+ * The vertices are written back unchanged, so the picture stays the same.
+ **/
+static void
+bench_update_mesh(mesh_t *mesh, size_t frame)
+{
+	size_t count = params.update < mesh->verts ?
+		params.update : mesh->verts;
+	size_t first = frame * count % (mesh->verts - count + 1);
+	vbuf_fmt_t iter = mesh->format;
+	const char *src = mesh->vert_data;
+	char *data = xmalloc(vbuf_fmt_vert_size(mesh->format) * count);
+	char *cursor = data;
+	size_t size;
+
+	while (vbuf_fmt_pop_segment(&iter, NULL, NULL, NULL, &size)) {
+		memcpy(cursor, src + first * size, count * size);
+		cursor += count * size;
+		src += mesh->verts * size;
+	}
+
+	mesh_update(mesh, first, count, data);
+	free(data);
+}
+
+/**
+ * Move everything for the given frame.
+ *
+ * Returns: Number of colliding pairs.
+ **/
+static size_t
+bench_animate(size_t frame)
+{
+	luft_quat_t rot;
+	float pos[3];
+	size_t hits = 0;
+	size_t i, j;
+
+	for (i = 0; i < params.planes; i++) {
+		luft_quat_init(&rot, 0, 1, 0, .01 * frame + i);
+		luft_object_set_rotation(scene.instances[i], &rot);
+	}
+
+	for (i = 0; i < params.colliders; i++) {
+		pos[0] = .01 * sinf(.1 * frame + i);
+		pos[1] = .01 * cosf(.1 * frame + i);
+		pos[2] = 0;
+		luft_object_move(scene.colliders[i], pos);
+	}
+
+	for (i = 0; i < params.colliders; i++)
+		for (j = i + 1; j < params.colliders; j++)
+			hits += luft_object_check_collision(scene.colliders[i],
+							    scene.colliders[j]);
+
+	for (i = 0; i < scene.num_dynamic; i++)
+		bench_update_mesh(scene.dynamic[i], frame);
+
+	return hits;
+}
+
+/**
+ * qsort comparator for doubles.
+ **/
+static int
+bench_cmp_double(const void *a_, const void *b_)
+{
+	const double *a = a_;
+	const double *b = b_;
+
+	return (*a > *b) - (*a < *b);
+}
+
+/**
+ * Print a set of samples as a JSON object with mean and percentiles. Sorts
+ * the samples.
+ **/
+static void
+bench_print_dist(const char *name, double *samples, size_t count)
+{
+	static const double pcts[] = { 50, 90, 95, 99 };
+	double total = 0;
+	size_t i;
+	size_t idx;
+
+	qsort(samples, count, sizeof(double), bench_cmp_double);
+
+	for (i = 0; i < count; i++)
+		total += samples[i];
+
+	printf("\t\"%s\": {\"mean\": %.4f, \"min\": %.4f", name,
+	       total / count, samples[0]);
+
+	for (i = 0; i < sizeof(pcts) / sizeof(*pcts); i++) {
+		idx = ceil(pcts[i] / 100 * count);
+		idx = idx ? idx - 1 : 0;
+		printf(", \"p%.0f\": %.4f", pcts[i], samples[idx]);
+	}
+
+	printf(", \"max\": %.4f},\n", samples[count - 1]);
+}
+
+/**
+ * Print usage information.
+ **/
+static void
+bench_usage(const char *argv0)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -n count   aircraft instances (default %zu)\n"
+		"  -l count   lights (default %zu)\n"
+		"  -d depth   scene graph depth above each instance (default %zu)\n"
+		"  -c count   collision primitives (default %zu)\n"
+		"  -f count   frames to measure (default %zu)\n"
+		"  -w count   warmup frames (default %zu)\n"
+		"  -W pixels  output width (default %zu)\n"
+		"  -H pixels  output height (default %zu)\n"
+		"  -m file    COLLADA model to instance (default: stand-in)\n"
+		"  -s dir     shader directory (default %s)\n"
+		"  -t file    write a Chrome trace of pass timings\n"
+		"  -k dir     cache linked shader binaries in dir\n"
+		"  -N         use the null GL backend; no context needed\n"
+		"  -e level   GL error checks: full, mem or none (default full)\n"
+		"  -D         report driver messages through KHR_debug\n"
+		"  -a count   run count random allocations and frees against the\n"
+		"             buffer space allocator instead of rendering\n"
+		"  -P         store stand-in meshes planar, not interleaved\n"
+		"  -Q         quantise stand-in mesh vertex data\n"
+		"  -u count   make stand-in meshes dynamic and rewrite count\n"
+		"             vertices of each every frame\n"
+		"  -R         release CPU copies of mesh data once uploaded\n",
+		argv0, params.planes, params.lights, params.depth,
+		params.colliders, params.frames, params.warmup, params.width,
+		params.height, params.datadir);
+}
+
+/**
+ * Parse a numeric argument.
+ **/
+static size_t
+bench_parse_size(const char *arg, char opt)
+{
+	char *end;
+	unsigned long ret = strtoul(arg, &end, 10);
+
+	if (! *arg || *end)
+		errx(1, "Option -%c needs a number", opt);
+
+	return ret;
+}
+
+/**
+ * Parse a GL check level argument.
+ **/
+static luft_gl_check_level_t
+bench_parse_gl_checks(const char *arg)
+{
+	size_t i;
+
+	for (i = 0; i <= LUFT_GL_CHECK_FULL; i++)
+		if (! strcmp(arg, bench_gl_check_names[i]))
+			return i;
+
+	errx(1, "Option -e needs full, mem or none");
+}
+
+/**
+ * Parse the command line.
+ **/
+static void
+bench_parse_args(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:l:d:c:f:w:W:H:m:s:t:k:Ne:Da:PQu:Rh")) != -1) {
+		switch (opt) {
+		case 'n': params.planes = bench_parse_size(optarg, opt); break;
+		case 'l': params.lights = bench_parse_size(optarg, opt); break;
+		case 'd': params.depth = bench_parse_size(optarg, opt); break;
+		case 'c': params.colliders = bench_parse_size(optarg, opt); break;
+		case 'f': params.frames = bench_parse_size(optarg, opt); break;
+		case 'w': params.warmup = bench_parse_size(optarg, opt); break;
+		case 'W': params.width = bench_parse_size(optarg, opt); break;
+		case 'H': params.height = bench_parse_size(optarg, opt); break;
+		case 'm': params.model = optarg; break;
+		case 's': params.datadir = optarg; break;
+		case 't': params.trace = optarg; break;
+		case 'k': params.shader_cache = optarg; break;
+		case 'N': params.null_gl = 1; break;
+		case 'e': params.gl_checks = bench_parse_gl_checks(optarg); break;
+		case 'D': params.gl_debug = 1; break;
+		case 'a': params.churn = bench_parse_size(optarg, opt); break;
+		case 'P': params.planar = 1; break;
+		case 'Q': params.compress = 1; break;
+		case 'u': params.update = bench_parse_size(optarg, opt); break;
+		case 'R': params.release = 1; break;
+		case 'h':
+			bench_usage(argv[0]);
+			exit(0);
+		default:
+			bench_usage(argv[0]);
+			exit(1);
+		}
+	}
+
+	if (! params.frames)
+		errx(1, "Need at least one frame to measure");
+
+	if (! params.width || ! params.height)
+		errx(1, "Output size must be nonzero");
+
+	if (params.null_gl && ! luft_gl_dispatch_available())
+		errx(1, "Null GL needs a build configured --with-gl-dispatch");
+
+	if (params.compress && params.update)
+		errx(1, "Stand-in meshes can't be both quantised and dynamic");
+}
+
+/**
+ * Print GL call counts gathered by the dispatch layer.
+ **/
+static void
+bench_print_gl_calls(size_t draws)
+{
+	const char *name;
+	size_t count;
+	size_t i;
+
+	printf("\t\"gl_calls\": {\"per_frame\": %.2f, \"per_draw\": %.2f, "
+	       "\"by_entry_point\": {",
+	       luft_gl_call_count(NULL) / (double)params.frames,
+	       draws ? luft_gl_call_count(NULL) / (double)draws : 0.0);
+
+	for (i = 0, count = 0; (name = luft_gl_entry_point(i)); i++) {
+		if (! luft_gl_call_count(name))
+			continue;
+
+		printf("%s\"%s\": %.2f", count++ ? ", " : "", name,
+		       luft_gl_call_count(name) / (double)params.frames);
+	}
+
+	printf("}},\n");
+}
+
+/* Space the churn benchmark allocates from, in vertices. */
+#define BENCH_CHURN_SPACE (1 << 24)
+
+/* Fraction of the space the churn benchmark keeps in use. */
+#define BENCH_CHURN_FILL 0.75
+
+/* Operations between fragmentation samples in the churn benchmark. */
+#define BENCH_CHURN_SAMPLE 1024
+
+/**
+ * Deterministic random numbers for the churn benchmark (xorshift64).
+ **/
+static uint64_t
+bench_churn_rand(void)
+{
+	static uint64_t state = 0x2545F4914F6CDD1Dull;
+
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+/**
+ * Pick a mesh size for the churn benchmark: log-uniform between 16 and 16384
+ * vertices, so there are many small meshes and a few big ones.
+ **/
+static size_t
+bench_churn_size(void)
+{
+	size_t shift = 4 + bench_churn_rand() % 10;
+
+	return (1 << shift) + bench_churn_rand() % (1 << shift);
+}
+
+/**
+ * Churn the buffer space allocator the way meshes coming and going would:
+ * keep a buffer about three quarters full, freeing a random mesh or adding
+ * one of random size each step. Reports time per operation and how
+ * fragmented the free space gets, measured as the share of free space
+ * outside the biggest free block.
+ **/
+static void
+bench_churn(void)
+{
+	intervals_t set;
+	size_t *starts = xcalloc(params.churn, sizeof(size_t));
+	size_t *sizes = xcalloc(params.churn, sizeof(size_t));
+	size_t live = 0;
+	size_t used = 0;
+	size_t allocs = 0;
+	size_t frees = 0;
+	size_t failed = 0;
+	size_t samples = 0;
+	double frag_sum = 0;
+	double frag_max = 0;
+	double frag;
+	double start;
+	double elapsed;
+	ssize_t offset;
+	size_t size;
+	size_t pick;
+	size_t i;
+
+	intervals_init(&set, BENCH_CHURN_SPACE);
+	start = bench_now();
+
+	for (i = 0; i < params.churn; i++) {
+		/* Mostly add meshes until the buffer is full enough, then
+		 * mostly drop them, so use hovers around the target. */
+		if (live && (used > BENCH_CHURN_SPACE * BENCH_CHURN_FILL ||
+			     bench_churn_rand() % 4 == 0)) {
+			pick = bench_churn_rand() % live;
+			interval_free(&set, starts[pick], sizes[pick]);
+			used -= sizes[pick];
+			starts[pick] = starts[--live];
+			sizes[pick] = sizes[live];
+			frees++;
+		} else {
+			size = bench_churn_size();
+			offset = interval_alloc(&set, size);
+			allocs++;
+
+			if (offset < 0) {
+				failed++;
+				continue;
+			}
+
+			starts[live] = offset;
+			sizes[live++] = size;
+			used += size;
+		}
+
+		if (i % BENCH_CHURN_SAMPLE || ! set.free_space)
+			continue;
+
+		/* Sampling is slow next to the operations; leave it out. */
+		elapsed = bench_now();
+		frag = 1.0 - intervals_largest_free(&set) /
+			(double)set.free_space;
+		frag_sum += frag;
+		samples++;
+
+		if (frag > frag_max)
+			frag_max = frag;
+
+		start += bench_now() - elapsed;
+	}
+
+	elapsed = bench_now() - start;
+
+	printf("{\n");
+	printf("\t\"churn\": {\"ops\": %zu, \"allocs\": %zu, \"frees\": %zu, "
+	       "\"failed\": %zu, \"live\": %zu, \"used\": %zu, "
+	       "\"space\": %d},\n", params.churn, allocs, frees, failed, live,
+	       used, BENCH_CHURN_SPACE);
+	printf("\t\"total_ms\": %.4f,\n", elapsed);
+	printf("\t\"ns_per_op\": %.2f,\n", elapsed * 1e6 / params.churn);
+	printf("\t\"fragmentation\": {\"mean\": %.4f, \"max\": %.4f}\n",
+	       samples ? frag_sum / samples : 0.0, frag_max);
+	printf("}\n");
+
+	intervals_release(&set);
+	free(starts);
+	free(sizes);
+}
+
+int
+main(int argc, char **argv)
+{
+	luft_stats_counters_t counters;
+	luft_stats_counters_t totals = { 0 };
+	double *cpu_ms;
+	double *frame_ms;
+	double setup_ms;
+	size_t setup_rss;
+	double start;
+	double submitted;
+	size_t allocs_start, alloc_bytes_start, frees_start;
+	size_t hits = 0;
+	size_t frame;
+	size_t i;
+
+	bench_parse_args(argc, argv);
+
+	if (params.churn) {
+		bench_churn();
+		return 0;
+	}
+
+	start = bench_now();
+
+	if (params.null_gl)
+		luft_gl_set_backend(LUFT_GL_BACKEND_NULL);
+	else
+		bench_init_egl();
+
+	if (params.shader_cache)
+		luft_shader_set_cache_dir(params.shader_cache);
+
+	luft_gl_check_set_level(params.gl_checks);
+
+	if (params.release)
+		luft_mesh_set_residency(LUFT_MESH_RELEASE_DATA);
+
+	if (params.gl_debug && luft_gl_debug_enable(0))
+		warnx("KHR_debug isn't available; no driver messages");
+
+	bench_build_scene();
+	setup_ms = bench_now() - start;
+	setup_rss = bench_rss();
+
+	cpu_ms = xcalloc(params.frames, sizeof(double));
+	frame_ms = xcalloc(params.frames, sizeof(double));
+
+	if (params.trace)
+		luft_stats_enable(1);
+
+	for (frame = 0; frame < params.warmup; frame++) {
+		bench_animate(frame);
+		luft_draw_proc_run(scene.frame_proc);
+		glFinish();
+		luft_stats_frame_end();
+	}
+
+	allocs_start = alloc_count;
+	alloc_bytes_start = alloc_bytes;
+	frees_start = free_count;
+	luft_gl_reset_counts();
+
+	for (i = 0; i < params.frames; i++, frame++) {
+		alloc_tracking = 1;
+		start = bench_now();
+
+		hits += bench_animate(frame);
+		luft_draw_proc_run(scene.frame_proc);
+
+		submitted = bench_now();
+		alloc_tracking = 0;
+
+		glFinish();
+		frame_ms[i] = bench_now() - start;
+		cpu_ms[i] = submitted - start;
+
+		luft_stats_frame_end();
+		luft_stats_get_counters(&counters);
+
+		totals.draws += counters.draws;
+		totals.state_changes += counters.state_changes;
+		totals.uniform_uploads += counters.uniform_uploads;
+		totals.buffer_bytes += counters.buffer_bytes;
+		totals.texture_binds += counters.texture_binds;
+		totals.gl_calls_skipped += counters.gl_calls_skipped;
+		totals.stream_stalls += counters.stream_stalls;
+	}
+
+	if (params.trace && luft_stats_dump_trace(params.trace))
+		err(1, "Could not write trace to %s", params.trace);
+
+	printf("{\n");
+	printf("\t\"renderer\": \"%s\",\n", glGetString(GL_RENDERER));
+	printf("\t\"scene\": {\"planes\": %zu, \"lights\": %zu, "
+	       "\"depth\": %zu, \"colliders\": %zu, \"meshes\": %zu, "
+	       "\"model\": \"%s\", \"width\": %zu, \"height\": %zu, "
+	       "\"layout\": \"%s\", \"compressed\": %s, "
+	       "\"vertex_bytes\": %zu},\n",
+	       params.planes, params.lights, params.depth, params.colliders,
+	       scene.mesh_count, params.model ? params.model : "stand-in",
+	       params.width, params.height,
+	       params.planar ? "planar" : "interleaved",
+	       params.compress ? "true" : "false", scene.vertex_bytes);
+	bench_print_import();
+	bench_print_memory(setup_rss);
+	printf("\t\"frames\": %zu,\n", params.frames);
+	printf("\t\"warmup\": %zu,\n", params.warmup);
+	printf("\t\"gl_checks\": \"%s\",\n",
+	       bench_gl_check_names[luft_gl_check_get_level()]);
+	printf("\t\"setup_ms\": %.4f,\n", setup_ms);
+	bench_print_dist("cpu_ms", cpu_ms, params.frames);
+	bench_print_dist("frame_ms", frame_ms, params.frames);
+	printf("\t\"per_frame\": {\"draws\": %.2f, \"state_changes\": %.2f, "
+	       "\"uniform_uploads\": %.2f, \"buffer_bytes\": %.2f, "
+	       "\"texture_binds\": %.2f, \"gl_calls_skipped\": %.2f, "
+	       "\"stream_stalls\": %.2f, "
+	       "\"collision_checks\": %zu, \"collisions\": %.2f},\n",
+	       totals.draws / (double)params.frames,
+	       totals.state_changes / (double)params.frames,
+	       totals.uniform_uploads / (double)params.frames,
+	       totals.buffer_bytes / (double)params.frames,
+	       totals.texture_binds / (double)params.frames,
+	       totals.gl_calls_skipped / (double)params.frames,
+	       totals.stream_stalls / (double)params.frames,
+	       params.colliders * (params.colliders - 1) / 2,
+	       hits / (double)params.frames);
+
+	if (luft_gl_dispatch_available())
+		bench_print_gl_calls(totals.draws);
+
+	if (BENCH_ALLOCS_COUNTED)
+		printf("\t\"allocations\": {\"per_frame\": %.2f, "
+		       "\"bytes_per_frame\": %.2f, \"frees_per_frame\": %.2f}\n",
+		       (alloc_count - allocs_start) / (double)params.frames,
+		       (alloc_bytes - alloc_bytes_start) /
+		       (double)params.frames,
+		       (free_count - frees_start) / (double)params.frames);
+	else
+		printf("\t\"allocations\": null\n");
+
+	printf("}\n");
+
+	return 0;
+}
@@ -23,32 +23,52 @@
 #include "vbuf.h"
 #include "ebuf.h"
 
+/* Smallest slab we create, in vertices or indices. */
+#ifndef BUFPOOL_SLAB_MIN
+#define BUFPOOL_SLAB_MIN 4096
+#endif
+
+/* Compact a slab once this much of its free space is outside its biggest
+ * free block. */
+#ifndef BUFPOOL_COMPACT_FRAGMENTATION
+#define BUFPOOL_COMPACT_FRAGMENTATION 0.5
+#endif
+
+/* Most meshes to move in a slab each generation when compacting. */
+#ifndef BUFPOOL_COMPACT_MOVES
+#define BUFPOOL_COMPACT_MOVES 16
+#endif
+
 /**
  * Add a new generation to this pool.
  **/
 static void
 bufpool_add_generation(bufpool_t *pool)
 {
+	mesh_generation_t *gen;
 	size_t i;
 
+	/* Drop generations whose meshes have all moved on to newer ones. */
 	for (i = 0; i < pool->num_generations;) {
-		if (pool->generations[pool->num_generations - 1].num_meshes) {
+		if (pool->generations[i]->num_meshes) {
 			i++;
 			continue;
 		}
 
-		free(pool->generations[pool->num_generations - 1].meshes);
+		free(pool->generations[i]->meshes);
+		free(pool->generations[i]);
 
 		pool->generations = vec_del(pool->generations,
 					    pool->num_generations, i);
 		pool->num_generations--;
 	}
 
-	pool->generations = vec_expand(pool->generations, pool->num_generations);
+	gen = xmalloc(sizeof(mesh_generation_t));
+	gen->meshes = NULL;
+	gen->num_meshes = 0;
 
-	pool->generations[pool->num_generations].meshes = NULL;
-	pool->generations[pool->num_generations].num_meshes = 0;
-	pool->num_generations++;
+	pool->generations = vec_expand(pool->generations, pool->num_generations);
+	pool->generations[pool->num_generations++] = gen;
 }
 
 /**
@@ -63,12 +83,21 @@ bufpool_create(vbuf_fmt_t format)
 	ret->generation_over = 1;
 	ret->generations = NULL;
 	ret->num_generations = 0;
+	ret->vbuf = NULL;
+	ret->ebuf = NULL;
+	ret->ebuf32 = NULL;
+	ret->vbuf_settled = UINT64_MAX;
+	ret->ebuf_settled = UINT64_MAX;
+	ret->ebuf32_settled = UINT64_MAX;
 
 	return ret;
 }
 
 /**
- * Free up some space in this bufpool.
+ * Free up some space in this bufpool by unbacking the meshes that were drawn
+ * longest ago.
+ *
+ * Returns: 1 if space was freed, 0 if there was nothing left to free.
  **/
 static int
 bufpool_prune(bufpool_t *pool)
@@ -79,7 +108,7 @@ bufpool_prune(bufpool_t *pool)
 	if (pool->num_generations <= 1)
 		return 0;
 
-	gen = &pool->generations[--pool->num_generations];
+	gen = pool->generations[0];
 
 	for (i = 0; i < gen->num_meshes; i++) {
 		mesh_remove_from_vbuf(gen->meshes[i]);
@@ -88,13 +117,127 @@ bufpool_prune(bufpool_t *pool)
 	}
 
 	free(gen->meshes);
-	pool->generations = vec_contract(pool->generations, pool->num_generations);
+	free(gen);
+	pool->generations = vec_del(pool->generations, pool->num_generations,
+				    0);
+	pool->num_generations--;
 
 	return 1;
 }
 
 /**
- * Allocate vbufs and ebufs for all the extant meshes we have.
+ * Work out how big a slab should become to take some more data: twice its
+ * current size, or more if that still isn't enough.
+ **/
+static size_t
+bufpool_slab_size(size_t current, size_t need)
+{
+	size_t ret = current * 2;
+
+	if (ret < current + need)
+		ret = current + need;
+
+	if (ret < BUFPOOL_SLAB_MIN)
+		ret = BUFPOOL_SLAB_MIN;
+
+	return ret;
+}
+
+/**
+ * Make room for more vertices in the pool's slab, creating it if need be.
+ *
+ * Returns: 0 on success, -1 if we ran out of GPU memory.
+ **/
+static int
+bufpool_grow_vbuf(bufpool_t *pool, size_t need)
+{
+	if (pool->vbuf)
+		return vbuf_grow(pool->vbuf,
+				 bufpool_slab_size(pool->vbuf->vert_count,
+						   need));
+
+	pool->vbuf = vbuf_create(bufpool_slab_size(0, need), pool->format);
+	return pool->vbuf ? 0 : -1;
+}
+
+/**
+ * Get the pool's element slab for indices of the given type.
+ **/
+static ebuf_t **
+bufpool_ebuf_slab(bufpool_t *pool, GLenum type)
+{
+	return type == GL_UNSIGNED_INT ? &pool->ebuf32 : &pool->ebuf;
+}
+
+/**
+ * Make room for more indices of the given type in the pool's slab for them,
+ * creating it if need be.
+ *
+ * Returns: 0 on success, -1 if we ran out of GPU memory.
+ **/
+static int
+bufpool_grow_ebuf(bufpool_t *pool, GLenum type, size_t need)
+{
+	ebuf_t **slab = bufpool_ebuf_slab(pool, type);
+
+	if (*slab)
+		return ebuf_grow(*slab, bufpool_slab_size((*slab)->size, need));
+
+	*slab = ebuf_create(bufpool_slab_size(0, need), type);
+	return *slab ? 0 : -1;
+}
+
+/**
+ * Back a mesh in the pool's vertex slab, growing it if the mesh won't fit,
+ * and unbacking old meshes if we can't grow.
+ **/
+static void
+bufpool_back_vbuf(bufpool_t *pool, mesh_t *mesh)
+{
+	if (pool->vbuf && ! mesh_add_to_vbuf(mesh, pool->vbuf))
+		return;
+
+	while (bufpool_grow_vbuf(pool, mesh->verts))
+		if (! bufpool_prune(pool))
+			return;
+
+	mesh_add_to_vbuf(mesh, pool->vbuf);
+}
+
+/**
+ * Back a mesh in the pool's element slab, growing it if the mesh won't fit,
+ * and unbacking old meshes if we can't grow.
+ **/
+static void
+bufpool_back_ebuf(bufpool_t *pool, mesh_t *mesh)
+{
+	ebuf_t **slab = bufpool_ebuf_slab(pool, mesh->elem_type);
+
+	if (*slab && ! mesh_add_to_ebuf(mesh, *slab))
+		return;
+
+	while (bufpool_grow_ebuf(pool, mesh->elem_type, mesh->elems))
+		if (! bufpool_prune(pool))
+			return;
+
+	mesh_add_to_ebuf(mesh, *slab);
+}
+
+/**
+ * Make sure the pool's element slab for the given type has at least some
+ * amount of free space, growing it if not.
+ **/
+static void
+bufpool_reserve_ebuf(bufpool_t *pool, GLenum type, size_t need)
+{
+	ebuf_t *slab = *bufpool_ebuf_slab(pool, type);
+
+	if (need && (! slab || slab->free.free_space < need))
+		bufpool_grow_ebuf(pool, type, need);
+}
+
+/**
+ * Back all the meshes in the current generation that aren't backed yet.
  **/
 static void
 bufpool_create_buffers(bufpool_t *pool)
@@ -102,44 +245,137 @@ bufpool_create_buffers(bufpool_t *pool)
 	mesh_generation_t *gen;
 	size_t vbuf_size = 0;
 	size_t ebuf_size = 0;
-	vbuf_t *vbuf = NULL;
-	ebuf_t *ebuf = NULL;
+	size_t ebuf32_size = 0;
 	size_t i;
 
 	if (! pool->num_generations)
 		return;
 
-	gen = &pool->generations[pool->num_generations - 1];
+	gen = pool->generations[pool->num_generations - 1];
 
 	for (i = 0; i < gen->num_meshes; i++) {
 		if (! gen->meshes[i]->vbuf)
 			vbuf_size += gen->meshes[i]->verts;
 
-		if (! gen->meshes[i]->ebuf)
+		if (gen->meshes[i]->ebuf)
+			continue;
+
+		if (gen->meshes[i]->elem_type == GL_UNSIGNED_INT)
+			ebuf32_size += gen->meshes[i]->elems;
+		else
 			ebuf_size += gen->meshes[i]->elems;
 	}
 
-	do {
-		vbuf = vbuf_create(vbuf_size, pool->format);
-	} while (!vbuf && bufpool_prune(pool));
+	/* Grow once for the lot if there's clearly not enough room. If we
+	 * can't, the meshes will grow or prune one at a time below. */
+	if (vbuf_size && (! pool->vbuf ||
+			  pool->vbuf->free.free_space < vbuf_size))
+		bufpool_grow_vbuf(pool, vbuf_size);
 
-	do {
-		ebuf = ebuf_create(ebuf_size);
-	} while (!ebuf && bufpool_prune(pool));
+	bufpool_reserve_ebuf(pool, GL_UNSIGNED_SHORT, ebuf_size);
+	bufpool_reserve_ebuf(pool, GL_UNSIGNED_INT, ebuf32_size);
 
-	/* FIXME: Prune generations on failure at least. */
 	for (i = 0; i < gen->num_meshes; i++) {
-		if (vbuf && ! gen->meshes[i]->vbuf)
-			mesh_add_to_vbuf(gen->meshes[i], vbuf);
+		if (! gen->meshes[i]->vbuf && gen->meshes[i]->verts)
+			bufpool_back_vbuf(pool, gen->meshes[i]);
+
+		if (! gen->meshes[i]->ebuf && gen->meshes[i]->elems)
+			bufpool_back_ebuf(pool, gen->meshes[i]);
+	}
+}
+
+/**
+ * Measure how scattered the free space in a slab is: the share of it outside
+ * the biggest free block.
+ **/
+static double
+bufpool_fragmentation(intervals_t *free_space)
+{
+	if (! free_space->free_space)
+		return 0;
+
+	return 1.0 - intervals_largest_free(free_space) /
+		(double)free_space->free_space;
+}
+
+/**
+ * qsort comparator putting meshes furthest into the vertex slab first.
+ **/
+static int
+bufpool_cmp_vbuf_pos(const void *a, const void *b)
+{
+	const mesh_t *ma = *(mesh_t *const *)a;
+	const mesh_t *mb = *(mesh_t *const *)b;
+
+	return (ma->vbuf_pos < mb->vbuf_pos) - (ma->vbuf_pos > mb->vbuf_pos);
+}
+
+/**
+ * qsort comparator putting meshes furthest into the element slab first.
+ **/
+static int
+bufpool_cmp_ebuf_pos(const void *a, const void *b)
+{
+	const mesh_t *ma = *(mesh_t *const *)a;
+	const mesh_t *mb = *(mesh_t *const *)b;
+
+	return (ma->ebuf_pos < mb->ebuf_pos) - (ma->ebuf_pos > mb->ebuf_pos);
+}
+
+/**
+ * Compact a slab a little if its free space is too scattered, by moving the
+ * meshes furthest into it into holes nearer the start. Freed space merges
+ * as we go, so a few passes gather it up without stalling any one frame.
+ * Once a pass finds nothing to move, we don't look again until space in the
+ * slab comes free.
+ *
+ * ebuf: Element slab to compact, or NULL to compact the vertex slab.
+ * settled: Where we note that the slab had nothing to move.
+ **/
+static void
+bufpool_compact(bufpool_t *pool, ebuf_t *ebuf, uint64_t *settled)
+{
+	intervals_t *free_space = ebuf ? &ebuf->free : &pool->vbuf->free;
+	mesh_t **meshes = NULL;
+	size_t num_meshes = 0;
+	size_t moves = 0;
+	mesh_t *mesh;
+	size_t i, j;
+
+	if (*settled == free_space->changes)
+		return;
 
-		if (ebuf && ! gen->meshes[i]->ebuf)
-			mesh_add_to_ebuf(gen->meshes[i], ebuf);
+	if (bufpool_fragmentation(free_space) < BUFPOOL_COMPACT_FRAGMENTATION)
+		return;
+
+	for (i = 0; i < pool->num_generations; i++) {
+		for (j = 0; j < pool->generations[i]->num_meshes; j++) {
+			mesh = pool->generations[i]->meshes[j];
+
+			if (ebuf ? mesh->ebuf != ebuf :
+			    mesh->vbuf != pool->vbuf)
+				continue;
+
+			meshes = vec_expand(meshes, num_meshes);
+			meshes[num_meshes++] = mesh;
+		}
 	}
 
-	if (ebuf)
-		ebuf_ungrab(ebuf);
-	if (vbuf)
-		vbuf_ungrab(vbuf);
+	qsort(meshes, num_meshes, sizeof(mesh_t *),
+	      ebuf ? bufpool_cmp_ebuf_pos : bufpool_cmp_vbuf_pos);
+
+	for (i = 0; i < num_meshes && moves < BUFPOOL_COMPACT_MOVES; i++) {
+		if (ebuf ? mesh_move_down_in_ebuf(meshes[i]) :
+		    mesh_move_down_in_vbuf(meshes[i]))
+			continue;
+
+		moves++;
+	}
+
+	if (! moves)
+		*settled = free_space->changes;
+
+	free(meshes);
 }
 
 /**
@@ -150,6 +386,15 @@ bufpool_end_generation(bufpool_t *pool)
 {
 	pool->generation_over = 1;
 	bufpool_create_buffers(pool);
+
+	if (pool->vbuf)
+		bufpool_compact(pool, NULL, &pool->vbuf_settled);
+
+	if (pool->ebuf)
+		bufpool_compact(pool, pool->ebuf, &pool->ebuf_settled);
+
+	if (pool->ebuf32)
+		bufpool_compact(pool, pool->ebuf32, &pool->ebuf32_settled);
 }
 
 /**
@@ -164,7 +409,7 @@ bufpool_add_mesh(bufpool_t *pool, mesh_t *mesh)
 		bufpool_add_generation(pool);
 
 	pool->generation_over = 0;
-	gen = &pool->generations[pool->num_generations - 1];
+	gen = pool->generations[pool->num_generations - 1];
 
 	if (gen == mesh->generation)
 		return;
@@ -25,17 +25,30 @@
 #include "mesh.h"
 
 /**
- * A pool of buffer space to draw from to back an object.
+ * A pool of buffer space to draw from to back an object. Meshes are packed
+ * into one large vertex buffer and one large element buffer, the slabs, so
+ * most draws of a format share buffers.
  *
  * format: What vertex format these buffers are.
- * generations, num_generations: LRU list of backed meshes.
+ * generations, num_generations: LRU list of backed meshes, oldest first.
  * generation_over: Whether the next new mesh should start a generation.
+ * vbuf, ebuf: Slab buffers, or NULL until something needs backing.
+ * ebuf32: Element slab for meshes with too many vertices for 16-bit indices.
+ * vbuf_settled, ebuf_settled, ebuf32_settled: Change count of each slab's
+ *                                             free space when compacting it
+ *                                             last found nothing to move.
  **/
 typedef struct bufpool {
 	vbuf_fmt_t format;
-	mesh_generation_t *generations;
+	mesh_generation_t **generations;
 	size_t num_generations;
 	int generation_over;
+	vbuf_t *vbuf;
+	ebuf_t *ebuf;
+	ebuf_t *ebuf32;
+	uint64_t vbuf_settled;
+	uint64_t ebuf_settled;
+	uint64_t ebuf32_settled;
 } bufpool_t;
 
 #ifdef __cplusplus
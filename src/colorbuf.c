@@ -25,6 +25,7 @@
 
 #include "colorbuf.h"
 #include "util.h"
+#include "gl_state.h"
 
 static colorbuf_t *current_colorbuf = NULL;
 
@@ -58,7 +59,7 @@ colorbuf_set_output_geom(size_t w, size_t h)
 {
 	def_buf_w = w;
 	def_buf_h = h;
-	glViewport(0, 0, w, h);
+	gl_state_viewport(0, 0, w, h);
 	CHECK_GL;
 }
 EXPORT(colorbuf_set_output_geom);
@@ -78,6 +79,8 @@ colorbuf_destroy(void *buf_v)
 	if (buf->flags & COLORBUF_DEPTH)
 		glDeleteRenderbuffers(1, &buf->autodepth);
 
+	gl_state_delete_framebuffer(buf->framebuf);
+
 	free(buf->colorbufs);
 	free(buf->colorbuf_attach_pos);
 	free(buf);
@@ -194,7 +197,7 @@ colorbuf_set_buf(colorbuf_t *buf, size_t idx, texmap_t *texmap)
 		buf->num_colorbufs--;
 	}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, buf->framebuf);
+	gl_state_bind_framebuffer(buf->framebuf);
 
 	if (texmap)
 		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i,
@@ -203,7 +206,7 @@ colorbuf_set_buf(colorbuf_t *buf, size_t idx, texmap_t *texmap)
 		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i,
 				       GL_TEXTURE_2D, 0, 0);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, framebuf_prev);
+	gl_state_bind_framebuffer(framebuf_prev);
 
 	/* FIXME: Set glDrawBuffers if we're the current colorbuf */
 }
@@ -414,10 +417,11 @@ colorbuf_set_draw(void)
 {
 	size_t bufcnt = 0;
 	GLenum *buffers;
+	GLenum back = GL_BACK;
 	size_t i;
 
 	if (! current_colorbuf) {
-		glDrawBuffer(GL_BACK);
+		gl_state_draw_buffers(1, &back);
 		return;
 	}
 
@@ -433,7 +437,7 @@ colorbuf_set_draw(void)
 		buffers[i] = GL_COLOR_ATTACHMENT0 +
 			current_colorbuf->colorbuf_attach_pos[i];
 
-	glDrawBuffers(current_colorbuf->num_colorbufs, buffers);
+	gl_state_draw_buffers(current_colorbuf->num_colorbufs, buffers);
 	free(buffers);
 	CHECK_GL;
 }
@@ -452,9 +456,7 @@ colorbuf_prep(colorbuf_t *colorbuf)
 	if (! colorbuf) {
 		current_colorbuf = NULL;
 
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-		glDrawBuffer(GL_BACK);
-
+		gl_state_bind_framebuffer(0);
 		colorbuf_set_draw();
 
 		if (def_buf.flags & COLORBUF_NEEDS_CLEAR)
@@ -472,7 +474,7 @@ colorbuf_prep(colorbuf_t *colorbuf)
 
 	current_colorbuf = colorbuf;
 
-	glBindFramebuffer(GL_FRAMEBUFFER, colorbuf->framebuf);
+	gl_state_bind_framebuffer(colorbuf->framebuf);
 
 	colorbuf_check_status();
 	colorbuf_prep_depth_stencil();
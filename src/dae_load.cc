@@ -33,9 +33,11 @@
 #include "object.h"
 #include "util.h"
 #include "mesh.h"
+#include "mesh_optimize.h"
 #include "matrix.h"
 #include "vbuf.h"
 #include "quat.h"
+#include "dae_load.h"
 
 using namespace std;
 
@@ -76,6 +78,7 @@ public:
 
 void *copy_out(void *target, size_t idx);
 void add_to_vbuf(vbuf_fmt_t *fmt);
+const char *get_name();
 
 DAEDataSource(domInputLocalOffsetRef input);
 ~DAEDataSource();
@@ -281,6 +284,15 @@ DAEDataSource::add_to_vbuf(vbuf_fmt_t *fmt)
 	vbuf_fmt_add(fmt, this->name, this->used_param_count, this->gl_type);
 }
 
+/**
+ * Get the name of the segment this class provides.
+ **/
+const char *
+DAEDataSource::get_name()
+{
+	return this->name;
+}
+
 /**
  * Construct this class from a COLLADA input.
  **/
@@ -341,7 +353,107 @@ dae_up_axis_to_xfrm(domUpAxisType up, float out[16])
 }
 
 /**
- * Load a mesh containing a polylist.
+ * Table of unique vertices, for merging polygon corners that have all the
+ * same attributes.
+ *
+ * data: Unique vertices, one after another, each segment in format order.
+ * vert_size: Size of a vertex in bytes.
+ * count: Number of unique vertices.
+ * slots: Open-addressed hash table of indices into data plus one, or 0 for an
+ *        empty slot.
+ * mask: Number of slots minus one.
+ **/
+struct dae_vertex_table {
+	char *data;
+	size_t vert_size;
+	size_t count;
+	uint32_t *slots;
+	size_t mask;
+};
+
+/**
+ * What the loader has done with the meshes it's loaded.
+ **/
+static dae_load_stats_t dae_stats;
+
+/**
+ * Set up a vertex table to hold up to max_verts vertices.
+ **/
+static void
+dae_vertex_table_init(struct dae_vertex_table *table, size_t vert_size,
+		      size_t max_verts)
+{
+	size_t slots = 1;
+
+	while (slots < 2 * max_verts)
+		slots <<= 1;
+
+	table->data = (char *)xmalloc(vert_size * max_verts);
+	table->vert_size = vert_size;
+	table->count = 0;
+	table->slots = (uint32_t *)xcalloc(slots, sizeof(uint32_t));
+	table->mask = slots - 1;
+}
+
+/**
+ * Free a vertex table's data.
+ **/
+static void
+dae_vertex_table_release(struct dae_vertex_table *table)
+{
+	free(table->data);
+	free(table->slots);
+}
+
+/**
+ * Hash the bytes of a vertex.
+ **/
+static uint64_t
+dae_vertex_hash(const char *vert, size_t size)
+{
+	static const uint64_t fnv_prime = 0x100000001b3ULL;
+	static const uint64_t fnv_osb = 0xcbf29ce484222325ULL;
+
+	uint64_t ret = fnv_osb;
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		ret ^= (unsigned char)vert[i];
+		ret *= fnv_prime;
+	}
+
+	return ret;
+}
+
+/**
+ * Find a vertex in the table, adding it if it isn't there.
+ *
+ * Returns: The index of the vertex.
+ **/
+static uint32_t
+dae_vertex_table_insert(struct dae_vertex_table *table, const char *vert)
+{
+	size_t slot = dae_vertex_hash(vert, table->vert_size) & table->mask;
+	char *found;
+
+	for (; table->slots[slot]; slot = (slot + 1) & table->mask) {
+		found = table->data + (table->slots[slot] - 1) *
+			table->vert_size;
+
+		if (! memcmp(found, vert, table->vert_size))
+			return table->slots[slot] - 1;
+	}
+
+	memcpy(table->data + table->count * table->vert_size, vert,
+	       table->vert_size);
+	table->slots[slot] = ++table->count;
+
+	return table->count - 1;
+}
+
+/**
+ * Load a mesh containing a polylist. Polygon corners with the same data for
+ * every input become one vertex, and the result goes through mesh_optimize.
  *
  * mesh: The mesh to load.
  *
@@ -353,25 +465,29 @@ dae_load_polylist(domMeshRef mesh)
 {
 	domPolylistRef polylist;
 	domPolylist_Array pa;
-	domVerticesRef verts;
 	domInputLocalOffset_Array inputs;
 	domListOfUInts vcounts;
 	domListOfUInts indices;
 	size_t i;
-	size_t vert_count;
-	size_t bufsize;
+	size_t corner_count;
 	vbuf_fmt_t fmt = 0;
 	vbuf_fmt_t iter;
 	size_t input_count;
 	size_t input_stride;
-	domSourceRef source;
 	daeTArray<DAEDataSource *> sources;
-	void *data;
-	uint16_t *ebuf;
-	void *loc;
-	size_t j;
+	daeTArray<size_t> seg_inputs;
+	struct dae_vertex_table table;
+	mesh_optimize_stats_t opt;
+	const char *name;
+	size_t vert_size;
+	size_t seg_size;
+	size_t offset;
+	char *corner;
+	char *data;
+	char *loc;
+	uint32_t *ebuf;
+	size_t j, k;
 	mesh_t *out_mesh;
-	GLenum type;
 	object_t *ret;
 
 	pa = mesh->getPolylist_array();
@@ -393,12 +509,31 @@ dae_load_polylist(domMeshRef mesh)
 	}
 	input_stride++;
 
+	/* We fill the data in segment by segment, but it's uploaded
+	 * interleaved so each vertex is fetched from one place. */
+	fmt |= VBUF_FMT_INTERLEAVED;
+
+	/* Segments come out of the format in their own order, so work out
+	 * which input feeds each one. */
+	iter = fmt;
+	while (vbuf_fmt_pop_segment(&iter, NULL, NULL, &name, NULL)) {
+		for (i = 0; i < input_count; i++)
+			if (! strcmp(sources[i]->get_name(), name))
+				break;
+
+		if (i == input_count)
+			errx(1, "COLLADA Polylist has no input for segment %s",
+			     name);
+
+		seg_inputs.append(i);
+	}
+
 	vcounts = polylist->getVcount()->getValue();
-	vert_count = 0;
+	corner_count = 0;
 
 	for (i = 0; i < vcounts.getCount(); i++) {
 		if (vcounts[i] == 3) {
-			vert_count += vcounts[i];
+			corner_count += vcounts[i];
 			continue;
 		}
 
@@ -408,40 +543,61 @@ dae_load_polylist(domMeshRef mesh)
 		return NULL;
 	}
 
-	if (vert_count >= 1 << 16)
-		errx(1, "Cannot load COLLADA mesh with %lu vertices (max %hu)",
-		     vert_count, ~(uint16_t)0);
+	vert_size = vbuf_fmt_vert_size(fmt);
+	corner = (char *)xmalloc(vert_size);
+	ebuf = (uint32_t *)xcalloc(corner_count, sizeof(uint32_t));
+	dae_vertex_table_init(&table, vert_size, corner_count);
 
-	bufsize = vbuf_fmt_vert_size(fmt) * vert_count;
+	indices = polylist->getP()->getValue();
 
-	data = xcalloc(1, bufsize);
-	loc = data;
-	bufsize = 0;
+	for (i = 0; i < corner_count; i++) {
+		loc = corner;
 
-	indices = polylist->getP()->getValue();
-	iter = fmt;
-	i = 0;
-	/* FIXME: Might read in wrong order since we don't use this pop thing
-	 */
-	while (vbuf_fmt_pop_segment(&iter, NULL, &type, NULL, NULL)) {
-		for (j = inputs[i]->getOffset(); j < vert_count * input_stride;
-		     j += input_stride) {
-			loc = sources[i]->copy_out(loc, indices[j]);
+		for (j = 0; j < seg_inputs.getCount(); j++) {
+			k = seg_inputs[j];
+			loc = (char *)sources[k]->copy_out(loc,
+				indices[i * input_stride +
+					inputs[k]->getOffset()]);
 		}
 
-		delete sources[i];
-
-		i++;
+		ebuf[i] = dae_vertex_table_insert(&table, corner);
 	}
 
-	ebuf = (uint16_t *)xcalloc(vert_count, sizeof(uint16_t));
+	for (i = 0; i < input_count; i++)
+		delete sources[i];
+
+	/* Meshes take their data with each segment stored whole. */
+	data = (char *)xmalloc(vert_size * table.count);
+	loc = data;
+	offset = 0;
+	iter = fmt;
 
-	for (i = 0; i < vert_count; i++)
-		ebuf[i] = i;
+	while (vbuf_fmt_pop_segment(&iter, NULL, NULL, NULL, &seg_size)) {
+		for (i = 0; i < table.count; i++, loc += seg_size)
+			memcpy(loc, table.data + i * vert_size + offset,
+			       seg_size);
 
-	out_mesh = mesh_create(vert_count, (float *)data, vert_count,
-			       (uint16_t *)ebuf, fmt, GL_TRIANGLES);
+		offset += seg_size;
+	}
 
+	/* mesh_create narrows these to 16 bits if the mesh is small enough */
+	out_mesh = mesh_create(table.count, data, corner_count, ebuf,
+			       GL_UNSIGNED_INT, fmt, GL_TRIANGLES);
+	mesh_optimize(out_mesh, &opt);
+
+	dae_stats.meshes++;
+	dae_stats.corners += corner_count;
+	dae_stats.verts += table.count;
+	dae_stats.bytes_in += corner_count * vert_size +
+		corner_count * (corner_count > (1 << 16) ? 4 : 2);
+	dae_stats.bytes_out += table.count * vert_size +
+		corner_count * ebuf_index_size(out_mesh->elem_type);
+	dae_stats.tris += opt.tris;
+	dae_stats.misses_before += opt.misses_before;
+	dae_stats.misses_after += opt.misses_after;
+
+	dae_vertex_table_release(&table);
+	free(corner);
 	free(data);
 	free(ebuf);
 
@@ -727,4 +883,15 @@ dae_load(const char *filename, size_t *count)
 }
 EXPORT(dae_load);
 
+/**
+ * Get totals for what the loader has done with the meshes it has loaded, to
+ * see how much merging shared vertices saved.
+ **/
+void
+dae_get_stats(dae_load_stats_t *out)
+{
+	*out = dae_stats;
+}
+EXPORT(dae_get_stats);
+
 } /* extern "C" */
@@ -25,7 +25,10 @@
 extern "C" {
 #endif
 
+typedef luft_dae_load_stats_t dae_load_stats_t;
+
 API_DECLARE(dae_load);
+API_DECLARE(dae_get_stats);
 
 #ifdef __cplusplus
 }
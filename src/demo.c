@@ -383,6 +383,7 @@ init_glfw(float clear_color[4])
 int
 main(void)
 {
+	const char *texmap_defines[] = { "LUFT_TEXMAP", NULL };
 	size_t aspect = (win_sz[0] / (float)win_sz[1]);
 
 	size_t dae_mesh_count;
@@ -440,8 +441,11 @@ main(void)
 	gather_cbuf = luft_colorbuf_create(LUFT_COLORBUF_CLEAR);
 	luft_colorbuf_clear_color(gather_cbuf, clear_color);
 
-	vcolor_shader = luft_shader_create("vertex.glsl", "fragment_vcolor.glsl");
-	textured_shader = luft_shader_create("vertex.glsl", "fragment_texmap.glsl");
+	vcolor_shader = luft_shader_create_variant("vertex.glsl",
+						   "fragment.glsl", NULL);
+	textured_shader = luft_shader_create_variant("vertex.glsl",
+						     "fragment.glsl",
+						     texmap_defines);
 	gather_shader = luft_shader_create("vertex_quad.glsl", "fragment_lighting.glsl");
 	output_shader = luft_shader_create("vertex_quad.glsl", "fragment_copy.glsl");
 
@@ -25,10 +25,36 @@
 #include "mesh.h"
 #include "shader.h"
 #include "state.h"
+#include "stats.h"
 
 bufpool_t **pools;
 size_t num_pools;
 
+/**
+ * Name IDs of the uniforms we set for every object we draw.
+ **/
+static size_t transform_id = SIZE_T_MAX;
+static size_t clip_transform_id;
+static size_t light_color_id;
+static size_t position_offset_id;
+static size_t position_scale_id;
+
+/**
+ * Look up the name IDs of our per-object uniforms.
+ **/
+static void
+draw_op_init_uniform_names(void)
+{
+	if (transform_id != SIZE_T_MAX)
+		return;
+
+	transform_id = uniform_name_id("transform");
+	clip_transform_id = uniform_name_id("clip_transform");
+	light_color_id = uniform_name_id("light_color");
+	position_offset_id = uniform_name_id("position_offset");
+	position_scale_id = uniform_name_id("position_scale");
+}
+
 /**
  * Destroy a draw operation.
  **/
@@ -62,6 +88,7 @@ draw_op_create(object_t *object, object_t *camera)
 	ret->object = object;
 	ret->camera = camera;
 	ret->material_gen = material_backlog_subscribe();
+	ret->name = stats_intern_name("draw_op");
 
 	refcount_init(&ret->refcount);
 	refcount_add_destructor(&ret->refcount, draw_op_destructor, ret);
@@ -99,7 +126,7 @@ draw_op_do_deactivate_material(draw_op_t *draw_op, material_t mat)
 static void
 draw_op_sync_mat_backlog(draw_op_t *op)
 {
-	material_t *backlog;
+	const material_t *backlog;
 	size_t num_backlog;
 	size_t i;
 
@@ -108,8 +135,6 @@ draw_op_sync_mat_backlog(draw_op_t *op)
 
 	for (i = 0; i < num_backlog; i++)
 		draw_op_do_deactivate_material(op, backlog[i]);
-
-	free(backlog);
 }
 
 /**
@@ -279,6 +304,16 @@ draw_op_set_uniform(draw_op_t *op, material_t mat, uniform_type_t type, ...)
 }
 EXPORT(draw_op_set_uniform);
 
+/**
+ * Set the name this draw operation is reported under in timing statistics.
+ **/
+void
+draw_op_set_name(draw_op_t *op, const char *name)
+{
+	op->name = stats_intern_name(name);
+}
+EXPORT(draw_op_set_name);
+
 /**
  * Grab a Operation.
  **/
@@ -333,42 +368,68 @@ draw_op_do_draw(object_t *object, float cspace[16],
 		   float clip[16], object_t *quad)
 {
 	uniform_t *un;
+	mesh_t *mesh;
 	float trans[16];
 	float fl[16];
 
 	if (! state_material_active(object->mat))
 		return 1;
 
+	/* The shader is still loading and has no fallback; skip, don't wait. */
+	if (! shader_can_draw())
+		return 1;
+
 	if (object->type == OBJ_NODE)
 		return 1;
 
 	if (object->type == OBJ_CAMERA)
 		return 1;
 
+	if (object->type == OBJ_MESH)
+		mesh = object->mesh;
+	else
+		mesh = quad->mesh;
+
+	if (shader_select_format(mesh->format) < 0)
+		return 1;
+
 	object_get_total_transform(object, trans);
+	draw_op_init_uniform_names();
+
+	if (mesh->format & VBUF_FMT_COMPRESSED) {
+		un = uniform_create_id(UNIFORM_VEC4, position_offset_id,
+				       mesh->position_offset);
+		shader_set_temp_uniform(un);
+		uniform_ungrab(un);
+
+		un = uniform_create_id(UNIFORM_VEC4, position_scale_id,
+				       mesh->position_scale);
+		shader_set_temp_uniform(un);
+		uniform_ungrab(un);
+	}
 
 	matrix_multiply(cspace, trans, fl);
-	un = uniform_create(UNIFORM_MAT4, "transform", fl);
+	un = uniform_create_id(UNIFORM_MAT4, transform_id, fl);
 	shader_set_temp_uniform(un);
 	uniform_ungrab(un);
 
-	un = uniform_create(UNIFORM_MAT4, "clip_transform", clip);
+	un = uniform_create_id(UNIFORM_MAT4, clip_transform_id, clip);
 	shader_set_temp_uniform(un);
 	uniform_ungrab(un);
 
 	if (object->type == OBJ_MESH) {
-		draw_op_add_mesh(object->mesh);
-		return mesh_draw(object->mesh);
+		draw_op_add_mesh(mesh);
+		return mesh_draw(mesh);
 	}
 
 	memcpy(fl, object->light_color, 3 * sizeof(float));
 	fl[3] = 1;
-	un = uniform_create(UNIFORM_VEC4, "light_color", fl);
+	un = uniform_create_id(UNIFORM_VEC4, light_color_id, fl);
 	shader_set_temp_uniform(un);
 	uniform_ungrab(un);
 
-	draw_op_add_mesh(quad->mesh);
-	return mesh_draw(quad->mesh);
+	draw_op_add_mesh(mesh);
+	return mesh_draw(mesh);
 }
 
 /**
@@ -408,6 +469,7 @@ draw_op_sort_objects_by_material(object_t **list, size_t size)
 void
 draw_op_exec(draw_op_t *op)
 {
+	size_t pass = stats_pass_begin(op->name);
 	float cspace[16];
 	float clip[16];
 	float distance;
@@ -480,5 +542,7 @@ draw_op_exec(draw_op_t *op)
 	object_ungrab(quad);
 
 	free(flat);
+
+	stats_pass_end(pass);
 }
 EXPORT(draw_op_exec);
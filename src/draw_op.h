@@ -39,6 +39,7 @@ extern "C" {
  * state: State to enter while drawing.
  * material_gen: Material backlog generation.
  * materials, num_materials: What materials to draw.
+ * name: Name this operation is reported under in timing statistics.
  * refcount: Reference count for this object.
  **/
 typedef struct draw_op {
@@ -50,6 +51,8 @@ typedef struct draw_op {
 	material_t *materials;
 	size_t num_materials;
 
+	const char *name;
+
 	refcounter_t refcount;
 } draw_op_t;
 
@@ -60,6 +63,7 @@ API_DECLARE(draw_op_ungrab);
 API_DECLARE(draw_op_exec);
 API_DECLARE(draw_op_activate_material);
 API_DECLARE(draw_op_deactivate_material);
+API_DECLARE(draw_op_set_name);
 
 #ifdef __cplusplus
 }
@@ -23,6 +23,7 @@
 #include "util.h"
 #include "draw_op.h"
 #include "uniform.h"
+#include "stats.h"
 
 /**
  * The destructor for a draw_proc_t
@@ -62,6 +63,7 @@ draw_proc_create(size_t repeat)
 	draw_proc_t *ret = xcalloc(1, sizeof(draw_proc_t));
 
 	ret->repeat = repeat;
+	ret->name = stats_intern_name("draw_proc");
 
 	refcount_init(&ret->refcount);
 	refcount_add_destructor(&ret->refcount, draw_proc_destructor, ret);
@@ -178,13 +180,21 @@ EXPORT(draw_proc_clear);
 static void
 draw_proc_do_step(draw_proc_step_t *step)
 {
+	static const char *clear_name = NULL;
+	size_t pass;
+
 	if (step->type == DRAW_PROC_STEP_DRAW) {
 		draw_op_exec(step->draw_op);
-	} else if (step->type == DRAW_PROC_STEP_PROC)
+	} else if (step->type == DRAW_PROC_STEP_PROC) {
 		draw_proc_run(step->draw_proc);
-	else if (step->type == DRAW_PROC_STEP_CLEAR)
+	} else if (step->type == DRAW_PROC_STEP_CLEAR) {
+		if (! clear_name)
+			clear_name = stats_intern_name("clear");
+
+		pass = stats_pass_begin(clear_name);
 		colorbuf_clear(step->cbuf);
-	else
+		stats_pass_end(pass);
+	} else
 		errx(1, "Encountered draw_proc step with unknown type");
 }
 
@@ -212,11 +222,14 @@ draw_proc_run_once(draw_proc_t *draw_proc)
 void
 draw_proc_run(draw_proc_t *draw_proc)
 {
+	size_t pass = stats_pass_begin(draw_proc->name);
 	size_t count = draw_proc->repeat;
 	size_t i;
 
 	for (i = 0; i < count; i++)
 		draw_proc_run_once(draw_proc);
+
+	stats_pass_end(pass);
 }
 EXPORT(draw_proc_run);
 
@@ -317,3 +330,13 @@ draw_proc_set_uniform(draw_proc_t *draw_proc, material_t mat,
 	uniform_ungrab(uniform);
 }
 EXPORT(draw_proc_set_uniform);
+
+/**
+ * Set the name this draw_proc is reported under in timing statistics.
+ **/
+void
+draw_proc_set_name(draw_proc_t *draw_proc, const char *name)
+{
+	draw_proc->name = stats_intern_name(name);
+}
+EXPORT(draw_proc_set_name);
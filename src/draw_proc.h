@@ -59,6 +59,7 @@ typedef struct draw_proc_step {
  * base_state: State to push before the individual states.
  * steps, num_steps: Steps to perform to complete this draw_proc.
  * repeat: Times to repeat this draw_proc's steps.
+ * name: Name this draw_proc is reported under in timing statistics.
  * refcount: Reference counter.
  **/
 typedef struct draw_proc {
@@ -69,6 +70,8 @@ typedef struct draw_proc {
 
 	size_t repeat;
 
+	const char *name;
+
 	refcounter_t refcount;
 } draw_proc_t;
 
@@ -91,6 +94,7 @@ API_DECLARE(draw_proc_clear_flags);
 API_DECLARE(draw_proc_ignore_flags);
 API_DECLARE(draw_proc_set_colorbuf);
 API_DECLARE(draw_proc_set_uniform);
+API_DECLARE(draw_proc_set_name);
 
 #ifdef __cplusplus
 }
@@ -23,20 +23,10 @@
 
 #include "ebuf.h"
 #include "util.h"
+#include "gl_state.h"
 
 ebuf_t *current_ebuf = NULL;
 
-/**
- * Bind an element buffer. Don't check to see if it's bound first.
- **/
-static void
-ebuf_do_activate(ebuf_t *buffer)
-{
-	current_ebuf = buffer;
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer->gl_handle);
-	CHECK_GL;
-}
-
 /**
  * Decrease a buffer's refcount. If the count becomes zero, free it.
  **/
@@ -45,26 +35,41 @@ ebuf_destructor(void *buffer_)
 {
 	ebuf_t *buffer = buffer_;
 
-	if (current_ebuf == buffer) {
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	if (current_ebuf == buffer)
 		current_ebuf = NULL;
-	}
 
-	glDeleteBuffers(1, &buffer->gl_handle);
+	gl_state_delete_buffer(buffer->gl_handle);
 
 	intervals_release(&buffer->free);
 	free(buffer);
 	CHECK_GL;
 }
 
+/**
+ * Get the size of an index of the given type.
+ **/
+size_t
+ebuf_index_size(GLenum type)
+{
+	if (type == GL_UNSIGNED_INT)
+		return sizeof(uint32_t);
+
+	if (type == GL_UNSIGNED_SHORT)
+		return sizeof(uint16_t);
+
+	errx(1, "Invalid element buffer index type");
+}
+
 /**
  * Create a new buffer object.
  *
  * size: Indices the buffer should accomodate.
+ * type: GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, the type of the indices.
  **/
 ebuf_t *
-ebuf_create(size_t size)
+ebuf_create(size_t size, GLenum type)
 {
+	size_t index_size = ebuf_index_size(type);
 	ebuf_t *ret;
 	GLuint handle;
 	int memfail;
@@ -72,31 +77,103 @@ ebuf_create(size_t size)
 	if (! size)
 		return NULL;
 
+	CLEAR_GL_MEM;
 	glGenBuffers(1, &handle);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, handle);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, size * sizeof(uint16_t), NULL,
+	gl_state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, handle);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, size * index_size, NULL,
 		     GL_STATIC_DRAW);
 	memfail = CHECK_GL_MEM;
 
 	if (current_ebuf)
-		ebuf_do_activate(current_ebuf);
+		gl_state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER,
+				     current_ebuf->gl_handle);
 
 	if (memfail)
 		return NULL;
 
 	ret = xmalloc(sizeof(ebuf_t));
 	ret->gl_handle = handle;
+	ret->type = type;
+	ret->index_size = index_size;
 	ret->size = size;
 
 	refcount_init(&ret->refcount);
 	refcount_add_destructor(&ret->refcount, ebuf_destructor, ret);
 
-	intervals_init(&ret->free);
-	interval_set(&ret->free, 0, size);
+	intervals_init(&ret->free, size);
 
 	return ret;
 }
 
+/**
+ * Grow a buffer to hold more indices. The data moves to a new, bigger GL
+ * buffer, copied on the GPU, and the old one is orphaned. Offsets of regions
+ * already allocated don't change.
+ *
+ * Returns: 0 on success, -1 if we ran out of GPU memory.
+ **/
+int
+ebuf_grow(ebuf_t *buffer, size_t size)
+{
+	GLuint handle;
+	int memfail;
+
+	if (size <= buffer->size)
+		return 0;
+
+	CLEAR_GL_MEM;
+
+	/* Binding to the element target would change the vertex array. */
+	glGenBuffers(1, &handle);
+	gl_state_bind_buffer(GL_COPY_WRITE_BUFFER, handle);
+	glBufferData(GL_COPY_WRITE_BUFFER, size * buffer->index_size, NULL,
+		     GL_STATIC_DRAW);
+	memfail = CHECK_GL_MEM;
+
+	if (memfail) {
+		gl_state_delete_buffer(handle);
+		return -1;
+	}
+
+	gl_state_bind_buffer(GL_COPY_READ_BUFFER, buffer->gl_handle);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+			    buffer->size * buffer->index_size);
+
+	gl_state_delete_buffer(buffer->gl_handle);
+	buffer->gl_handle = handle;
+	buffer->size = size;
+	intervals_grow(&buffer->free, size);
+
+	CHECK_GL;
+	return 0;
+}
+
+/**
+ * Move an allocated region of a buffer to a free place nearer the start, to
+ * gather up free space.
+ *
+ * Returns: The new offset of the region or -1 if there's nowhere to go.
+ **/
+ssize_t
+ebuf_move_region_down(ebuf_t *buffer, size_t offset, size_t size)
+{
+	ssize_t to = interval_alloc_below(&buffer->free, size, offset);
+
+	if (to < 0)
+		return -1;
+
+	gl_state_bind_buffer(GL_COPY_READ_BUFFER, buffer->gl_handle);
+	gl_state_bind_buffer(GL_COPY_WRITE_BUFFER, buffer->gl_handle);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+			    offset * buffer->index_size,
+			    to * buffer->index_size,
+			    size * buffer->index_size);
+
+	interval_free(&buffer->free, offset, size);
+	CHECK_GL;
+	return to;
+}
+
 /**
  * Increase a buffer's refcount.
  **/
@@ -116,46 +193,36 @@ ebuf_ungrab(ebuf_t *buffer)
 }
 
 /**
- * Create a new free region and add it to a buffer's lists.
+ * Free a region of a buffer allocated with ebuf_alloc_region.
  **/
 void
 ebuf_drop_data(ebuf_t *buffer, size_t offset, size_t size)
 {
-	interval_set(&buffer->free, offset, size);
+	interval_free(&buffer->free, offset, size);
 }
 
 /**
  * Allocate a region of a buffer.
+ *
+ * buffer: Buffer to allocate from.
+ * size: Size of the region.
+ *
+ * Returns: Offset to the region or -1 if not enough space found.
  **/
-void
-ebuf_alloc_region(ebuf_t *buffer, size_t offset, size_t size)
+ssize_t
+ebuf_alloc_region(ebuf_t *buffer, size_t size)
 {
-	interval_unset(&buffer->free, offset, size);
+	return interval_alloc(&buffer->free, size);
 }
 
 /**
- * Bind an element buffer.
+ * Bind an element buffer. The binding belongs to the bound vertex array, so
+ * it may have changed even if current_ebuf hasn't; gl_state knows which.
  **/
 void
 ebuf_activate(ebuf_t *buffer)
 {
-	if (current_ebuf == buffer)
-		return;
-
-	ebuf_do_activate(buffer);
-}
-
-/**
- * Locate some free space in a buffer.
- *
- * buffer: Buffer to search.
- * size: Size of free space to find.
- *
- * Returns: Offset to space or -1 if not enough space found.
- **/
-ssize_t
-ebuf_locate_free_space(ebuf_t *buffer, size_t size)
-{
-	return interval_find(&buffer->free, size);
+	current_ebuf = buffer;
+	gl_state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, buffer->gl_handle);
 }
 
@@ -30,12 +30,16 @@
  * Wrapper around an OpenGL buffer object for element buffers.
  *
  * gl_handle: OpenGL handle for the buffer.
- * size: total verts in this buffer.
+ * type: GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, the type of the indices.
+ * index_size: Size of an index in bytes.
+ * size: total indices in this buffer.
  * refcount: Reference counting.
  * free: Free space tracking.
  **/
 typedef struct ebuf {
 	GLuint gl_handle;
+	GLenum type;
+	size_t index_size;
 	size_t size;
 	refcounter_t refcount;
 	intervals_t free;
@@ -45,13 +49,15 @@ typedef struct ebuf {
 extern "C" {
 #endif
 
-ebuf_t *ebuf_create(size_t size);
+ebuf_t *ebuf_create(size_t size, GLenum type);
+size_t ebuf_index_size(GLenum type);
 void ebuf_grab(ebuf_t *buffer);
 void ebuf_ungrab(ebuf_t *buffer);
 void ebuf_drop_data(ebuf_t *buffer, size_t offset, size_t size);
 void ebuf_activate(ebuf_t *buffer);
-void ebuf_alloc_region(ebuf_t *buffer, size_t offset, size_t size);
-ssize_t ebuf_locate_free_space(ebuf_t *buffer, size_t size);
+ssize_t ebuf_alloc_region(ebuf_t *buffer, size_t size);
+int ebuf_grow(ebuf_t *buffer, size_t size);
+ssize_t ebuf_move_region_down(ebuf_t *buffer, size_t offset, size_t size);
 
 #ifdef __cplusplus
 }
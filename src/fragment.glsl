@@ -19,14 +19,20 @@
  * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
  **/
 
+/* Define LUFT_TEXMAP to color from diffusemap rather than vertex colors. */
+#if defined(LUFT_TEXMAP) && (! defined(LUFT_FORMAT) || defined(LUFT_HAVE_TEXCOORD))
+#define USE_DIFFUSEMAP
+#endif
+
 in vec4 colorout;
+in vec4 posout;
 in vec4 texcoordout;
 in vec4 normalout;
-in vec4 posout;
+#ifdef USE_DIFFUSEMAP
 uniform sampler2D diffusemap;
+#endif
 uniform sampler2D last_depth;
 uniform int last_depth_valid;
-uniform mat4 clip_transform;
 
 void main()
 {
@@ -36,5 +42,9 @@ void main()
 		discard;
 	gl_FragData[0] = normalout;
 	gl_FragData[1] = posout;
+#ifdef USE_DIFFUSEMAP
 	gl_FragData[2] = texture2D(diffusemap, texcoordout.st);
+#else
+	gl_FragData[2] = colorout;
+#endif
 }
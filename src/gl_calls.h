@@ -0,0 +1,189 @@
+/**
+ * Copyright © 2013 Casey Dahlin
+ *
+ * This file is part of Luftballons.
+ *
+ * Luftballons is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Luftballons is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/**
+ * Every GL entry point Luftballons uses, for the dispatch layer. This file is
+ * included repeatedly with different definitions of the following macros:
+ *
+ * GL_VOID(name, params, args): A call with no results. The null backend
+ * ignores it.
+ * GL_VOID_NULL(name, params, args): A call that returns results through its
+ * arguments, or affects what later calls return. The null backend has a
+ * hand-written version, null_<name>.
+ * GL_RET(ret, name, params, args): A call with a return value. The null
+ * backend has a hand-written version, null_<name>.
+ *
+ * Anything that starts calling a new GL function must add it here.
+ **/
+
+GL_VOID(glActiveTexture, (GLenum texture), (texture))
+GL_VOID_NULL(glAttachShader, (GLuint program, GLuint shader),
+	     (program, shader))
+GL_VOID(glBindBuffer, (GLenum target, GLuint buffer), (target, buffer))
+GL_VOID(glBindFramebuffer, (GLenum target, GLuint framebuffer),
+	(target, framebuffer))
+GL_VOID(glBindRenderbuffer, (GLenum target, GLuint renderbuffer),
+	(target, renderbuffer))
+GL_VOID(glBindSampler, (GLuint unit, GLuint sampler), (unit, sampler))
+GL_VOID(glBindTexture, (GLenum target, GLuint texture), (target, texture))
+GL_VOID(glBindVertexArray, (GLuint array), (array))
+GL_VOID(glBlendFunc, (GLenum sfactor, GLenum dfactor), (sfactor, dfactor))
+GL_VOID(glBufferData, (GLenum target, GLsizeiptr size, const void *data,
+		       GLenum usage), (target, size, data, usage))
+GL_VOID(glBufferStorage, (GLenum target, GLsizeiptr size, const void *data,
+			  GLbitfield flags), (target, size, data, flags))
+GL_VOID(glBufferSubData, (GLenum target, GLintptr offset, GLsizeiptr size,
+			  const void *data), (target, offset, size, data))
+GL_RET(GLenum, glCheckFramebufferStatus, (GLenum target), (target))
+GL_VOID(glClear, (GLbitfield mask), (mask))
+GL_VOID(glClearColor, (GLclampf red, GLclampf green, GLclampf blue,
+		       GLclampf alpha), (red, green, blue, alpha))
+GL_VOID(glClearDepth, (GLclampd depth), (depth))
+GL_VOID(glClearStencil, (GLint s), (s))
+GL_RET(GLenum, glClientWaitSync, (GLsync sync, GLbitfield flags,
+				  GLuint64 timeout), (sync, flags, timeout))
+GL_VOID(glCompileShader, (GLuint shader), (shader))
+GL_VOID(glCopyBufferSubData, (GLenum readTarget, GLenum writeTarget,
+			      GLintptr readOffset, GLintptr writeOffset,
+			      GLsizeiptr size),
+	(readTarget, writeTarget, readOffset, writeOffset, size))
+GL_RET(GLuint, glCreateProgram, (void), ())
+GL_RET(GLuint, glCreateShader, (GLenum type), (type))
+GL_VOID(glCullFace, (GLenum mode), (mode))
+GL_VOID(glDebugMessageCallback, (GLDEBUGPROC callback, const void *userParam),
+	(callback, userParam))
+GL_VOID(glDebugMessageControl, (GLenum source, GLenum type, GLenum severity,
+				GLsizei count, const GLuint *ids,
+				GLboolean enabled),
+	(source, type, severity, count, ids, enabled))
+GL_VOID(glDeleteBuffers, (GLsizei n, const GLuint *buffers), (n, buffers))
+GL_VOID(glDeleteFramebuffers, (GLsizei n, const GLuint *framebuffers),
+	(n, framebuffers))
+GL_VOID(glDeleteProgram, (GLuint program), (program))
+GL_VOID(glDeleteRenderbuffers, (GLsizei n, const GLuint *renderbuffers),
+	(n, renderbuffers))
+GL_VOID(glDeleteSamplers, (GLsizei count, const GLuint *samplers),
+	(count, samplers))
+GL_VOID(glDeleteShader, (GLuint shader), (shader))
+GL_VOID(glDeleteSync, (GLsync sync), (sync))
+GL_VOID(glDeleteTextures, (GLsizei n, const GLuint *textures), (n, textures))
+GL_VOID(glDeleteVertexArrays, (GLsizei n, const GLuint *arrays), (n, arrays))
+GL_VOID(glDetachShader, (GLuint program, GLuint shader), (program, shader))
+GL_VOID(glDisable, (GLenum cap), (cap))
+GL_VOID(glDrawBuffer, (GLenum mode), (mode))
+GL_VOID(glDrawBuffers, (GLsizei n, const GLenum *bufs), (n, bufs))
+GL_VOID(glDrawElementsBaseVertex, (GLenum mode, GLsizei count, GLenum type,
+				   const void *indices, GLint basevertex),
+	(mode, count, type, indices, basevertex))
+GL_VOID(glEnable, (GLenum cap), (cap))
+GL_VOID(glEnableVertexAttribArray, (GLuint index), (index))
+GL_RET(GLsync, glFenceSync, (GLenum condition, GLbitfield flags),
+       (condition, flags))
+GL_VOID(glFinish, (void), ())
+GL_VOID(glFramebufferRenderbuffer, (GLenum target, GLenum attachment,
+				    GLenum renderbuffertarget,
+				    GLuint renderbuffer),
+	(target, attachment, renderbuffertarget, renderbuffer))
+GL_VOID(glFramebufferTexture2D, (GLenum target, GLenum attachment,
+				 GLenum textarget, GLuint texture, GLint level),
+	(target, attachment, textarget, texture, level))
+GL_VOID(glFrontFace, (GLenum mode), (mode))
+GL_VOID_NULL(glGenBuffers, (GLsizei n, GLuint *buffers), (n, buffers))
+GL_VOID_NULL(glGenFramebuffers, (GLsizei n, GLuint *framebuffers),
+	     (n, framebuffers))
+GL_VOID_NULL(glGenQueries, (GLsizei n, GLuint *ids), (n, ids))
+GL_VOID_NULL(glGenRenderbuffers, (GLsizei n, GLuint *renderbuffers),
+	     (n, renderbuffers))
+GL_VOID_NULL(glGenSamplers, (GLsizei count, GLuint *samplers),
+	     (count, samplers))
+GL_VOID_NULL(glGenTextures, (GLsizei n, GLuint *textures), (n, textures))
+GL_VOID_NULL(glGenVertexArrays, (GLsizei n, GLuint *arrays), (n, arrays))
+GL_VOID_NULL(glGetActiveUniform, (GLuint program, GLuint index,
+				  GLsizei bufSize, GLsizei *length,
+				  GLint *size, GLenum *type, GLchar *name),
+	     (program, index, bufSize, length, size, type, name))
+GL_RET(GLint, glGetAttribLocation, (GLuint program, const GLchar *name),
+       (program, name))
+GL_RET(GLenum, glGetError, (void), ())
+GL_VOID_NULL(glGetInteger64v, (GLenum pname, GLint64 *data), (pname, data))
+GL_VOID_NULL(glGetIntegerv, (GLenum pname, GLint *params), (pname, params))
+GL_VOID_NULL(glGetProgramInfoLog, (GLuint program, GLsizei bufSize,
+				   GLsizei *length, GLchar *infoLog),
+	     (program, bufSize, length, infoLog))
+GL_VOID_NULL(glGetProgramBinary, (GLuint program, GLsizei bufSize,
+				  GLsizei *length, GLenum *binaryFormat,
+				  void *binary),
+	     (program, bufSize, length, binaryFormat, binary))
+GL_VOID_NULL(glGetProgramiv, (GLuint program, GLenum pname, GLint *params),
+	     (program, pname, params))
+GL_VOID_NULL(glGetQueryObjectiv, (GLuint id, GLenum pname, GLint *params),
+	     (id, pname, params))
+GL_VOID_NULL(glGetQueryObjectui64v, (GLuint id, GLenum pname,
+				     GLuint64 *params),
+	     (id, pname, params))
+GL_VOID_NULL(glGetShaderInfoLog, (GLuint shader, GLsizei bufSize,
+				  GLsizei *length, GLchar *infoLog),
+	     (shader, bufSize, length, infoLog))
+GL_VOID_NULL(glGetShaderiv, (GLuint shader, GLenum pname, GLint *params),
+	     (shader, pname, params))
+GL_RET(const GLubyte *, glGetString, (GLenum name), (name))
+GL_RET(const GLubyte *, glGetStringi, (GLenum name, GLuint index),
+       (name, index))
+GL_RET(GLint, glGetUniformLocation, (GLuint program, const GLchar *name),
+       (program, name))
+GL_VOID_NULL(glLinkProgram, (GLuint program), (program))
+GL_RET(void *, glMapBufferRange, (GLenum target, GLintptr offset,
+				  GLsizeiptr length, GLbitfield access),
+       (target, offset, length, access))
+GL_VOID(glMaxShaderCompilerThreadsKHR, (GLuint count), (count))
+GL_VOID(glProgramBinary, (GLuint program, GLenum binaryFormat,
+			  const void *binary, GLsizei length),
+	(program, binaryFormat, binary, length))
+GL_VOID(glProgramParameteri, (GLuint program, GLenum pname, GLint value),
+	(program, pname, value))
+GL_VOID(glQueryCounter, (GLuint id, GLenum target), (id, target))
+GL_VOID(glRenderbufferStorage, (GLenum target, GLenum internalformat,
+				GLsizei width, GLsizei height),
+	(target, internalformat, width, height))
+GL_VOID(glSamplerParameteri, (GLuint sampler, GLenum pname, GLint param),
+	(sampler, pname, param))
+GL_VOID_NULL(glShaderSource, (GLuint shader, GLsizei count,
+			      const GLchar *const *string,
+			      const GLint *length),
+	     (shader, count, string, length))
+GL_VOID(glTexImage2D, (GLenum target, GLint level, GLint internalFormat,
+		       GLsizei width, GLsizei height, GLint border,
+		       GLenum format, GLenum type, const GLvoid *pixels),
+	(target, level, internalFormat, width, height, border, format, type,
+	 pixels))
+GL_VOID(glTexParameteri, (GLenum target, GLenum pname, GLint param),
+	(target, pname, param))
+GL_VOID(glUniform1i, (GLint location, GLint v0), (location, v0))
+GL_VOID(glUniform4fv, (GLint location, GLsizei count, const GLfloat *value),
+	(location, count, value))
+GL_VOID(glUniformMatrix4fv, (GLint location, GLsizei count,
+			     GLboolean transpose, const GLfloat *value),
+	(location, count, transpose, value))
+GL_VOID(glUseProgram, (GLuint program), (program))
+GL_VOID(glVertexAttribPointer, (GLuint index, GLint size, GLenum type,
+				GLboolean normalized, GLsizei stride,
+				const void *pointer),
+	(index, size, type, normalized, stride, pointer))
+GL_VOID(glViewport, (GLint x, GLint y, GLsizei width, GLsizei height),
+	(x, y, width, height))
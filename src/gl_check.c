@@ -0,0 +1,177 @@
+/**
+ * Copyright © 2013 Casey Dahlin
+ *
+ * This file is part of Luftballons.
+ *
+ * Luftballons is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Luftballons is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdio.h>
+#include <string.h>
+#include <err.h>
+
+#include <GL/gl.h>
+
+#include "gl_check.h"
+#include "util.h"
+
+/**
+ * How often CHECK_GL and CHECK_GL_MEM actually check. Never above
+ * GL_CHECK_MAX, which the build can lower to compile checks out.
+ **/
+gl_check_level_t gl_check_level = GL_CHECK_MAX;
+
+/**
+ * Set how often we check for OpenGL errors. Levels above what the library
+ * was built with (see --with-gl-checks) are lowered to it.
+ **/
+void
+gl_check_set_level(gl_check_level_t level)
+{
+	if (level > GL_CHECK_MAX)
+		level = GL_CHECK_MAX;
+
+	gl_check_level = level;
+}
+EXPORT(gl_check_set_level);
+
+/**
+ * Get how often we check for OpenGL errors.
+ **/
+gl_check_level_t
+gl_check_get_level(void)
+{
+	return gl_check_level;
+}
+EXPORT(gl_check_get_level);
+
+/**
+ * Check whether the current context has an extension.
+ **/
+int
+gl_have_extension(const char *name)
+{
+	GLint count = 0;
+	GLint i;
+	const char *ext;
+	int ret = 0;
+
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+
+	for (i = 0; i < count && ! ret; i++) {
+		ext = (const char *)glGetStringi(GL_EXTENSIONS, i);
+
+		if (ext && ! strcmp(ext, name))
+			ret = 1;
+	}
+
+	return ret;
+}
+
+/**
+ * Describe a KHR_debug message type.
+ **/
+static const char *
+gl_debug_type_name(GLenum type)
+{
+	switch (type) {
+	case GL_DEBUG_TYPE_ERROR: return "error";
+	case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated behavior";
+	case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behavior";
+	case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+	case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+	default: return "message";
+	}
+}
+
+/**
+ * Describe a KHR_debug message severity.
+ **/
+static const char *
+gl_debug_severity_name(GLenum severity)
+{
+	switch (severity) {
+	case GL_DEBUG_SEVERITY_HIGH: return "high";
+	case GL_DEBUG_SEVERITY_MEDIUM: return "medium";
+	case GL_DEBUG_SEVERITY_LOW: return "low";
+	default: return "notification";
+	}
+}
+
+/**
+ * Report a message from the driver. We don't die here even for errors, as
+ * running out of memory is one of them, and we recover from that.
+ **/
+static void APIENTRY
+gl_debug_message(GLenum source, GLenum type, GLuint id, GLenum severity,
+		 GLsizei length, const GLchar *message, const void *data)
+{
+	(void)source;
+	(void)length;
+	(void)data;
+
+	warnx("OpenGL %s (%s severity, id %u): %s", gl_debug_type_name(type),
+	      gl_debug_severity_name(severity), id, message);
+}
+
+/**
+ * Have the driver report errors and warnings as they happen, through
+ * KHR_debug, rather than waiting for us to poll. Works alongside any check
+ * level, so checks can be turned down without losing diagnostics.
+ *
+ * synchronous: Report each message from within the call that caused it, so
+ *              a debugger can catch it there. Slower.
+ *
+ * Returns: 0 on success, -1 if the context doesn't support KHR_debug.
+ **/
+int
+gl_debug_enable(int synchronous)
+{
+	GLint major = 0;
+	GLint minor = 0;
+
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+	if ((major < 4 || (major == 4 && minor < 3)) &&
+	    ! gl_have_extension("GL_KHR_debug"))
+		return -1;
+
+	glDebugMessageCallback(gl_debug_message, NULL);
+	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE,
+			      GL_DEBUG_SEVERITY_NOTIFICATION, 0, NULL,
+			      GL_FALSE);
+	glEnable(GL_DEBUG_OUTPUT);
+
+	if (synchronous)
+		glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	else
+		glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+
+	CHECK_GL;
+	return 0;
+}
+EXPORT(gl_debug_enable);
+
+/**
+ * Stop reporting driver messages.
+ **/
+void
+gl_debug_disable(void)
+{
+	glDisable(GL_DEBUG_OUTPUT);
+	glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	CLEAR_GL;
+}
+EXPORT(gl_debug_disable);
@@ -0,0 +1,46 @@
+/**
+ * Copyright © 2013 Casey Dahlin
+ *
+ * This file is part of Luftballons.
+ *
+ * Luftballons is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Luftballons is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef GL_CHECK_H
+#define GL_CHECK_H
+#include <luftballons/gl_check.h>
+
+#include "util.h"
+
+typedef luft_gl_check_level_t gl_check_level_t;
+#define GL_CHECK_NONE LUFT_GL_CHECK_NONE
+#define GL_CHECK_MEM LUFT_GL_CHECK_MEM
+#define GL_CHECK_FULL LUFT_GL_CHECK_FULL
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+API_DECLARE(gl_check_set_level);
+API_DECLARE(gl_check_get_level);
+API_DECLARE(gl_debug_enable);
+API_DECLARE(gl_debug_disable);
+
+int gl_have_extension(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GL_CHECK_H */
@@ -0,0 +1,791 @@
+/**
+ * Copyright © 2013 Casey Dahlin
+ *
+ * This file is part of Luftballons.
+ *
+ * Luftballons is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Luftballons is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <err.h>
+
+/**
+ * When we're replacing the GL entry points, the definitions below must agree
+ * with the header's declarations about visibility. Protected visibility means
+ * our own calls always come here no matter what order libraries are loaded
+ * in.
+ **/
+#ifdef LUFT_GL_DISPATCH
+#pragma GCC visibility push(protected)
+#endif
+#include <GL/gl.h>
+#ifdef LUFT_GL_DISPATCH
+#pragma GCC visibility pop
+#endif
+
+#include "gl_dispatch.h"
+#include "util.h"
+
+#ifdef LUFT_GL_DISPATCH
+#include <dlfcn.h>
+#endif
+
+/**
+ * IDs for each entry point we dispatch.
+ **/
+enum gl_entry_id {
+#define GL_VOID(name, params, args) GL_ENTRY_ ## name,
+#define GL_VOID_NULL GL_VOID
+#define GL_RET(ret, name, params, args) GL_ENTRY_ ## name,
+#include "gl_calls.h"
+#undef GL_VOID
+#undef GL_VOID_NULL
+#undef GL_RET
+	GL_ENTRY_COUNT,
+};
+
+/**
+ * Names of each entry point, indexed by ID.
+ **/
+static const char *gl_entry_names[] = {
+#define GL_VOID(name, params, args) #name,
+#define GL_VOID_NULL GL_VOID
+#define GL_RET(ret, name, params, args) #name,
+#include "gl_calls.h"
+#undef GL_VOID
+#undef GL_VOID_NULL
+#undef GL_RET
+};
+
+/**
+ * Times each entry point has been called since the last reset.
+ **/
+static size_t gl_call_counts[GL_ENTRY_COUNT];
+
+/**
+ * Calls made since recording started, in order.
+ **/
+static int gl_recording = 0;
+static enum gl_entry_id *gl_recorded = NULL;
+static size_t gl_num_recorded = 0;
+
+/**
+ * Where calls are going right now.
+ **/
+static gl_backend_t gl_backend = GL_BACKEND_REAL;
+
+/**
+ * Find out whether Luftballons was built with the GL dispatch layer. If not,
+ * all calls go straight to the system GL and nothing is counted.
+ **/
+int
+gl_dispatch_available(void)
+{
+#ifdef LUFT_GL_DISPATCH
+	return 1;
+#else
+	return 0;
+#endif
+}
+EXPORT(gl_dispatch_available);
+
+/**
+ * Choose where GL calls go.
+ **/
+void
+gl_set_backend(gl_backend_t backend)
+{
+	if (! gl_dispatch_available() && backend != GL_BACKEND_REAL)
+		errx(1, "Luftballons was built without the GL dispatch layer");
+
+	gl_backend = backend;
+}
+EXPORT(gl_set_backend);
+
+/**
+ * Get the name of a GL entry point the dispatch layer knows about.
+ *
+ * Returns: The name, or NULL if idx is past the last entry point.
+ **/
+const char *
+gl_entry_point(size_t idx)
+{
+	if (idx >= GL_ENTRY_COUNT)
+		return NULL;
+
+	return gl_entry_names[idx];
+}
+EXPORT(gl_entry_point);
+
+/**
+ * Get the number of times an entry point was called since the last reset. If
+ * name is NULL, get the total for all entry points.
+ **/
+size_t
+gl_call_count(const char *name)
+{
+	size_t ret = 0;
+	size_t i;
+
+	for (i = 0; i < GL_ENTRY_COUNT; i++) {
+		if (! name)
+			ret += gl_call_counts[i];
+		else if (! strcmp(name, gl_entry_names[i]))
+			return gl_call_counts[i];
+	}
+
+	return ret;
+}
+EXPORT(gl_call_count);
+
+/**
+ * Reset all call counts to zero.
+ **/
+void
+gl_reset_counts(void)
+{
+	memset(gl_call_counts, 0, sizeof(gl_call_counts));
+}
+EXPORT(gl_reset_counts);
+
+/**
+ * Start or stop recording the sequence of GL calls. Starting a recording
+ * throws away the last one.
+ **/
+void
+gl_record(int enable)
+{
+	if (enable && ! gl_recording) {
+		free(gl_recorded);
+		gl_recorded = NULL;
+		gl_num_recorded = 0;
+	}
+
+	gl_recording = enable;
+}
+EXPORT(gl_record);
+
+/**
+ * Get the number of calls in the current recording.
+ **/
+size_t
+gl_recorded_calls(void)
+{
+	return gl_num_recorded;
+}
+EXPORT(gl_recorded_calls);
+
+/**
+ * Get the name of a call from the current recording.
+ *
+ * Returns: The name, or NULL if idx is past the end of the recording.
+ **/
+const char *
+gl_recorded_call(size_t idx)
+{
+	if (idx >= gl_num_recorded)
+		return NULL;
+
+	return gl_entry_names[gl_recorded[idx]];
+}
+EXPORT(gl_recorded_call);
+
+#ifdef LUFT_GL_DISPATCH
+
+/**
+ * Count a call, and record it if we're recording.
+ **/
+static void
+gl_dispatch_note(enum gl_entry_id id)
+{
+	gl_call_counts[id]++;
+
+	if (! gl_recording)
+		return;
+
+	gl_recorded = vec_expand(gl_recorded, gl_num_recorded);
+	gl_recorded[gl_num_recorded++] = id;
+}
+
+/**
+ * Find an entry point in the system GL.
+ **/
+static void *
+gl_dispatch_lookup(const char *name)
+{
+	static void *libgl = NULL;
+	void *ret;
+
+	if (! libgl)
+		libgl = dlopen("libGL.so.1", RTLD_LAZY | RTLD_LOCAL);
+
+	if (! libgl)
+		errx(1, "Could not load system GL: %s", dlerror());
+
+	ret = dlsym(libgl, name);
+
+	if (! ret)
+		errx(1, "System GL has no entry point %s", name);
+
+	return ret;
+}
+
+/**
+ * Next object name the null backend will hand out.
+ **/
+static GLuint null_next_name = 1;
+
+/**
+ * Null backend for all the glGen* calls.
+ **/
+static void
+null_gen(GLsizei n, GLuint *names)
+{
+	GLsizei i;
+
+	for (i = 0; i < n; i++)
+		names[i] = null_next_name++;
+}
+
+static void
+null_glGenBuffers(GLsizei n, GLuint *buffers)
+{
+	null_gen(n, buffers);
+}
+
+static void
+null_glGenFramebuffers(GLsizei n, GLuint *framebuffers)
+{
+	null_gen(n, framebuffers);
+}
+
+static void
+null_glGenQueries(GLsizei n, GLuint *ids)
+{
+	null_gen(n, ids);
+}
+
+static void
+null_glGenVertexArrays(GLsizei n, GLuint *arrays)
+{
+	null_gen(n, arrays);
+}
+
+static void
+null_glGenRenderbuffers(GLsizei n, GLuint *renderbuffers)
+{
+	null_gen(n, renderbuffers);
+}
+
+static void
+null_glGenSamplers(GLsizei count, GLuint *samplers)
+{
+	null_gen(count, samplers);
+}
+
+static void
+null_glGenTextures(GLsizei n, GLuint *textures)
+{
+	null_gen(n, textures);
+}
+
+static GLuint
+null_glCreateProgram(void)
+{
+	return null_next_name++;
+}
+
+static GLuint
+null_glCreateShader(GLenum type)
+{
+	(void)type;
+	return null_next_name++;
+}
+
+static GLenum
+null_glCheckFramebufferStatus(GLenum target)
+{
+	(void)target;
+	return GL_FRAMEBUFFER_COMPLETE;
+}
+
+static GLenum
+null_glGetError(void)
+{
+	return GL_NO_ERROR;
+}
+
+/**
+ * Null backend for glGetIntegerv. Limits are reported as the minimums GL 3.3
+ * guarantees; everything else is zero.
+ **/
+static void
+null_glGetIntegerv(GLenum pname, GLint *params)
+{
+	if (pname == GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS)
+		*params = 48;
+	else if (pname == GL_MAX_COLOR_ATTACHMENTS)
+		*params = 8;
+	else if (pname == GL_MAX_DRAW_BUFFERS)
+		*params = 8;
+	else
+		*params = 0;
+}
+
+static void
+null_glGetInteger64v(GLenum pname, GLint64 *data)
+{
+	(void)pname;
+	*data = 0;
+}
+
+/**
+ * What the null backend knows about a shader or program: the uniforms its
+ * source declares, and for programs, which shaders are attached. Enough for
+ * the engine to find its uniforms the way it would with a real driver.
+ *
+ * name: GL name of the shader or program.
+ * uniforms, num_uniforms: Names of declared (or, once linked, active)
+ *                         uniforms.
+ * attached, num_attached: Shaders attached to a program.
+ **/
+struct null_object {
+	GLuint name;
+	char **uniforms;
+	size_t num_uniforms;
+	GLuint *attached;
+	size_t num_attached;
+};
+
+static struct null_object *null_objects = NULL;
+static size_t num_null_objects = 0;
+
+/**
+ * Find the null backend's record for a shader or program, creating it if need
+ * be.
+ **/
+static struct null_object *
+null_object(GLuint name)
+{
+	size_t i;
+
+	for (i = 0; i < num_null_objects; i++)
+		if (null_objects[i].name == name)
+			return &null_objects[i];
+
+	null_objects = vec_expand(null_objects, num_null_objects);
+	memset(&null_objects[i], 0, sizeof(struct null_object));
+	null_objects[i].name = name;
+	num_null_objects++;
+
+	return &null_objects[i];
+}
+
+/**
+ * Add a uniform name to an object if it isn't there already.
+ **/
+static void
+null_object_add_uniform(struct null_object *obj, const char *name, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < obj->num_uniforms; i++)
+		if (strlen(obj->uniforms[i]) == len &&
+		    ! strncmp(obj->uniforms[i], name, len))
+			return;
+
+	obj->uniforms = vec_expand(obj->uniforms, obj->num_uniforms);
+	obj->uniforms[obj->num_uniforms] = xmalloc(len + 1);
+	memcpy(obj->uniforms[obj->num_uniforms], name, len);
+	obj->uniforms[obj->num_uniforms++][len] = '\0';
+}
+
+/**
+ * Whether a character can appear in a GLSL identifier.
+ **/
+static int
+null_is_ident(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+		(c >= '0' && c <= '9') || c == '_';
+}
+
+/**
+ * Pick the uniform declarations out of some GLSL. We only need to handle
+ * "uniform <type> <name>;" and the like, which is all our shaders use.
+ **/
+static void
+null_parse_uniforms(struct null_object *obj, const char *src, size_t len)
+{
+	const char *end = src + len;
+	const char *pos = src;
+	const char *word = NULL;
+	size_t word_len = 0;
+	int in_decl = 0;
+
+	while (pos < end) {
+		if (! null_is_ident(*pos)) {
+			if (in_decl && word && (*pos == ';' || *pos == '[' ||
+						*pos == ',' || *pos == '=')) {
+				null_object_add_uniform(obj, word, word_len);
+				in_decl = (*pos == ',');
+				word = NULL;
+			} else if (in_decl && *pos == '{') {
+				in_decl = 0;
+			}
+
+			pos++;
+			continue;
+		}
+
+		word = pos;
+
+		while (pos < end && null_is_ident(*pos))
+			pos++;
+
+		word_len = pos - word;
+
+		if ((word == src || ! null_is_ident(word[-1])) &&
+		    word_len == 7 && ! strncmp(word, "uniform", 7)) {
+			in_decl = 1;
+			word = NULL;
+		}
+	}
+}
+
+static void
+null_glShaderSource(GLuint shader, GLsizei count, const GLchar *const *string,
+		    const GLint *length)
+{
+	struct null_object *obj = null_object(shader);
+	GLsizei i;
+
+	for (i = 0; i < count; i++)
+		null_parse_uniforms(obj, string[i],
+				    (length && length[i] >= 0) ? (size_t)length[i]
+				    : strlen(string[i]));
+}
+
+static void
+null_glAttachShader(GLuint program, GLuint shader)
+{
+	struct null_object *obj = null_object(program);
+
+	obj->attached = vec_expand(obj->attached, obj->num_attached);
+	obj->attached[obj->num_attached++] = shader;
+}
+
+static void
+null_glLinkProgram(GLuint program)
+{
+	struct null_object *shader;
+	size_t i, j;
+
+	for (i = 0; i < null_object(program)->num_attached; i++) {
+		shader = null_object(null_object(program)->attached[i]);
+
+		for (j = 0; j < shader->num_uniforms; j++)
+			null_object_add_uniform(null_object(program),
+						shader->uniforms[j],
+						strlen(shader->uniforms[j]));
+	}
+}
+
+static void
+null_glGetActiveUniform(GLuint program, GLuint index, GLsizei bufSize,
+			GLsizei *length, GLint *size, GLenum *type,
+			GLchar *name)
+{
+	struct null_object *obj = null_object(program);
+	size_t len;
+
+	*size = 1;
+	*type = GL_FLOAT;
+
+	if (index >= obj->num_uniforms || bufSize <= 0) {
+		if (length)
+			*length = 0;
+		if (bufSize > 0)
+			name[0] = '\0';
+		return;
+	}
+
+	len = strlen(obj->uniforms[index]);
+
+	if (len >= (size_t)bufSize)
+		len = bufSize - 1;
+
+	memcpy(name, obj->uniforms[index], len);
+	name[len] = '\0';
+
+	if (length)
+		*length = len;
+}
+
+/**
+ * Null backend for glGetProgramiv and glGetShaderiv. Everything compiles and
+ * links, and nothing has any attributes or log.
+ **/
+static void
+null_glGetProgramiv(GLuint program, GLenum pname, GLint *params)
+{
+	struct null_object *obj;
+	size_t i;
+
+	if (pname == GL_LINK_STATUS) {
+		*params = GL_TRUE;
+	} else if (pname == GL_ACTIVE_UNIFORMS) {
+		*params = null_object(program)->num_uniforms;
+	} else if (pname == GL_ACTIVE_UNIFORM_MAX_LENGTH) {
+		obj = null_object(program);
+		*params = 1;
+
+		for (i = 0; i < obj->num_uniforms; i++)
+			if ((GLint)strlen(obj->uniforms[i]) >= *params)
+				*params = strlen(obj->uniforms[i]) + 1;
+	} else {
+		*params = 0;
+	}
+}
+
+/**
+ * Null backend for glGetProgramBinary. The null backend advertises no binary
+ * formats, so there is never a binary to get.
+ **/
+static void
+null_glGetProgramBinary(GLuint program, GLsizei bufSize, GLsizei *length,
+			GLenum *binaryFormat, void *binary)
+{
+	(void)program;
+	(void)bufSize;
+	(void)binary;
+
+	if (length)
+		*length = 0;
+
+	*binaryFormat = 0;
+}
+
+static void
+null_glGetShaderiv(GLuint shader, GLenum pname, GLint *params)
+{
+	(void)shader;
+
+	if (pname == GL_COMPILE_STATUS)
+		*params = GL_TRUE;
+	else
+		*params = 0;
+}
+
+/**
+ * Null backend for the info log calls. Logs are always empty.
+ **/
+static void
+null_info_log(GLsizei bufSize, GLsizei *length, GLchar *infoLog)
+{
+	if (length)
+		*length = 0;
+
+	if (bufSize > 0)
+		infoLog[0] = '\0';
+}
+
+static void
+null_glGetProgramInfoLog(GLuint program, GLsizei bufSize, GLsizei *length,
+			 GLchar *infoLog)
+{
+	(void)program;
+	null_info_log(bufSize, length, infoLog);
+}
+
+static void
+null_glGetShaderInfoLog(GLuint shader, GLsizei bufSize, GLsizei *length,
+			GLchar *infoLog)
+{
+	(void)shader;
+	null_info_log(bufSize, length, infoLog);
+}
+
+static GLint
+null_glGetAttribLocation(GLuint program, const GLchar *name)
+{
+	(void)program;
+	(void)name;
+
+	return -1;
+}
+
+/**
+ * Null backend for queries. Results are always ready, and always zero.
+ **/
+static void
+null_glGetQueryObjectiv(GLuint id, GLenum pname, GLint *params)
+{
+	(void)id;
+
+	if (pname == GL_QUERY_RESULT_AVAILABLE)
+		*params = GL_TRUE;
+	else
+		*params = 0;
+}
+
+static void
+null_glGetQueryObjectui64v(GLuint id, GLenum pname, GLuint64 *params)
+{
+	(void)id;
+	(void)pname;
+	*params = 0;
+}
+
+static const GLubyte *
+null_glGetString(GLenum name)
+{
+	if (name == GL_VENDOR)
+		return (const GLubyte *)"Luftballons";
+	if (name == GL_RENDERER)
+		return (const GLubyte *)"Luftballons null GL";
+	if (name == GL_VERSION)
+		return (const GLubyte *)"3.3 (null)";
+	if (name == GL_SHADING_LANGUAGE_VERSION)
+		return (const GLubyte *)"3.30 (null)";
+
+	return (const GLubyte *)"";
+}
+
+static const GLubyte *
+null_glGetStringi(GLenum name, GLuint index)
+{
+	(void)name;
+	(void)index;
+
+	return (const GLubyte *)"";
+}
+
+/**
+ * Null backend for sync objects. Everything has always finished.
+ **/
+static GLsync
+null_glFenceSync(GLenum condition, GLbitfield flags)
+{
+	(void)condition;
+	(void)flags;
+
+	return (GLsync)(uintptr_t)null_next_name++;
+}
+
+static GLenum
+null_glClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout)
+{
+	(void)sync;
+	(void)flags;
+	(void)timeout;
+
+	return GL_ALREADY_SIGNALED;
+}
+
+/**
+ * Null backend for glMapBufferRange. Buffers have no storage to map.
+ **/
+static void *
+null_glMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length,
+		      GLbitfield access)
+{
+	(void)target;
+	(void)offset;
+	(void)length;
+	(void)access;
+
+	return NULL;
+}
+
+static GLint
+null_glGetUniformLocation(GLuint program, const GLchar *name)
+{
+	struct null_object *obj = null_object(program);
+	size_t i;
+
+	for (i = 0; i < obj->num_uniforms; i++)
+		if (! strcmp(obj->uniforms[i], name))
+			return i;
+
+	return -1;
+}
+
+/**
+ * The dispatch functions themselves. They take the place of the system GL's
+ * entry points.
+ **/
+#define GL_DISPATCH_DEFINE(ret, name, params)				\
+	ret name params
+
+#define GL_VOID(name, params, args)					\
+GL_DISPATCH_DEFINE(void, name, params)					\
+{									\
+	static void (*real) params = NULL;				\
+									\
+	gl_dispatch_note(GL_ENTRY_ ## name);				\
+									\
+	if (gl_backend == GL_BACKEND_NULL)				\
+		return;							\
+									\
+	if (! real)							\
+		real = gl_dispatch_lookup(#name);			\
+									\
+	real args;							\
+}
+
+#define GL_VOID_NULL(name, params, args)				\
+GL_DISPATCH_DEFINE(void, name, params)					\
+{									\
+	static void (*real) params = NULL;				\
+									\
+	gl_dispatch_note(GL_ENTRY_ ## name);				\
+									\
+	if (gl_backend == GL_BACKEND_NULL) {				\
+		null_ ## name args;					\
+		return;							\
+	}								\
+									\
+	if (! real)							\
+		real = gl_dispatch_lookup(#name);			\
+									\
+	real args;							\
+}
+
+#define GL_RET(ret, name, params, args)				\
+GL_DISPATCH_DEFINE(ret, name, params)					\
+{									\
+	static ret (*real) params = NULL;				\
+									\
+	gl_dispatch_note(GL_ENTRY_ ## name);				\
+									\
+	if (gl_backend == GL_BACKEND_NULL)				\
+		return null_ ## name args;				\
+									\
+	if (! real)							\
+		real = gl_dispatch_lookup(#name);			\
+									\
+	return real args;						\
+}
+
+#include "gl_calls.h"
+
+#undef GL_VOID
+#undef GL_VOID_NULL
+#undef GL_RET
+#undef GL_DISPATCH_DEFINE
+
+#endif /* LUFT_GL_DISPATCH */
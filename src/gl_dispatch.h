@@ -0,0 +1,47 @@
+/**
+ * Copyright © 2013 Casey Dahlin
+ *
+ * This file is part of Luftballons.
+ *
+ * Luftballons is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Luftballons is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef GL_DISPATCH_H
+#define GL_DISPATCH_H
+#include <luftballons/gl_dispatch.h>
+
+#include "util.h"
+
+typedef luft_gl_backend_t gl_backend_t;
+#define GL_BACKEND_REAL LUFT_GL_BACKEND_REAL
+#define GL_BACKEND_NULL LUFT_GL_BACKEND_NULL
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+API_DECLARE(gl_dispatch_available);
+API_DECLARE(gl_set_backend);
+API_DECLARE(gl_entry_point);
+API_DECLARE(gl_call_count);
+API_DECLARE(gl_reset_counts);
+API_DECLARE(gl_record);
+API_DECLARE(gl_recorded_calls);
+API_DECLARE(gl_recorded_call);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GL_DISPATCH_H */
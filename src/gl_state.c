@@ -0,0 +1,644 @@
+/**
+ * Copyright © 2013 Casey Dahlin
+ *
+ * This file is part of Luftballons.
+ *
+ * Luftballons is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Luftballons is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <string.h>
+
+#include <GL/gl.h>
+
+#include "gl_state.h"
+#include "stats.h"
+#include "util.h"
+
+/* Texture units we shadow. Units past this are always sent to the driver. */
+#ifndef GL_STATE_MAX_UNITS
+#define GL_STATE_MAX_UNITS 192
+#endif
+
+/* Draw buffers we shadow per framebuffer. */
+#ifndef GL_STATE_MAX_DRAW_BUFFERS
+#define GL_STATE_MAX_DRAW_BUFFERS 16
+#endif
+
+/* Value for any shadowed enum or name we don't know the driver's idea of. */
+#define GL_STATE_UNKNOWN ((GLuint)-1)
+
+/**
+ * Capabilities we shadow. Others go straight to the driver.
+ **/
+static const GLenum gl_state_caps[] = {
+	GL_DEPTH_TEST,
+	GL_CULL_FACE,
+	GL_BLEND,
+	GL_STENCIL_TEST,
+	GL_SCISSOR_TEST,
+};
+
+#define GL_STATE_NUM_CAPS (sizeof(gl_state_caps) / sizeof(GLenum))
+
+/**
+ * Buffer binding points we shadow.
+ **/
+static const GLenum gl_state_buffer_targets[] = {
+	GL_ARRAY_BUFFER,
+	GL_ELEMENT_ARRAY_BUFFER,
+	GL_COPY_READ_BUFFER,
+	GL_COPY_WRITE_BUFFER,
+	GL_PIXEL_UNPACK_BUFFER,
+	GL_UNIFORM_BUFFER,
+};
+
+#define GL_STATE_NUM_BUFFER_TARGETS \
+	(sizeof(gl_state_buffer_targets) / sizeof(GLenum))
+
+/**
+ * Draw buffers last set for a framebuffer. This is framebuffer object state
+ * in OpenGL, so it survives binding other framebuffers.
+ *
+ * framebuffer: Framebuffer the draw buffers belong to.
+ * count, buffers: The draw buffers.
+ **/
+struct gl_state_draw_buffers {
+	GLuint framebuffer;
+	size_t count;
+	GLenum buffers[GL_STATE_MAX_DRAW_BUFFERS];
+};
+
+/**
+ * Element buffer last bound while a vertex array was bound. This is vertex
+ * array object state in OpenGL, so it changes when the vertex array does.
+ *
+ * vertex_array: Vertex array the binding belongs to.
+ * element_buffer: Bound element buffer, or GL_STATE_UNKNOWN.
+ **/
+struct gl_state_vertex_array {
+	GLuint vertex_array;
+	GLuint element_buffer;
+};
+
+/**
+ * What we believe the driver's state to be.
+ *
+ * caps: Enabled state of each capability, or -1 if unknown.
+ * blend_src, blend_dst: Blend function.
+ * cull_face, front_face: Face culling parameters.
+ * program: Program in use.
+ * buffers: Buffer bound to each target in gl_state_buffer_targets.
+ * vertex_array: Bound vertex array object.
+ * vertex_arrays, num_vertex_arrays: Element buffer bindings of vertex arrays
+ *                                   other than the bound one.
+ * active_unit: Active texture unit.
+ * textures: 2D texture bound to each unit.
+ * samplers: Sampler bound to each unit.
+ * framebuffer: Bound draw framebuffer.
+ * draw_buffers, num_draw_buffers: Draw buffers for each framebuffer we've
+ *                                 set them on.
+ * viewport: Viewport rectangle.
+ * viewport_known: Whether viewport is valid.
+ **/
+static struct {
+	int caps[GL_STATE_NUM_CAPS];
+	GLenum blend_src;
+	GLenum blend_dst;
+	GLenum cull_face;
+	GLenum front_face;
+	GLuint program;
+	GLuint buffers[GL_STATE_NUM_BUFFER_TARGETS];
+	GLuint vertex_array;
+	struct gl_state_vertex_array *vertex_arrays;
+	size_t num_vertex_arrays;
+	GLuint active_unit;
+	GLuint textures[GL_STATE_MAX_UNITS];
+	GLuint samplers[GL_STATE_MAX_UNITS];
+	GLuint framebuffer;
+	struct gl_state_draw_buffers *draw_buffers;
+	size_t num_draw_buffers;
+	GLint viewport[4];
+	int viewport_known;
+} gl_state;
+
+/**
+ * Whether gl_state has been set up yet.
+ **/
+static int gl_state_initialized = 0;
+
+/**
+ * Forget everything we know about the driver's state. The next call for
+ * every piece of state goes through.
+ **/
+void
+gl_state_invalidate(void)
+{
+	size_t i;
+
+	for (i = 0; i < GL_STATE_NUM_CAPS; i++)
+		gl_state.caps[i] = -1;
+
+	for (i = 0; i < GL_STATE_NUM_BUFFER_TARGETS; i++)
+		gl_state.buffers[i] = GL_STATE_UNKNOWN;
+
+	for (i = 0; i < GL_STATE_MAX_UNITS; i++) {
+		gl_state.textures[i] = GL_STATE_UNKNOWN;
+		gl_state.samplers[i] = GL_STATE_UNKNOWN;
+	}
+
+	gl_state.blend_src = GL_STATE_UNKNOWN;
+	gl_state.blend_dst = GL_STATE_UNKNOWN;
+	gl_state.cull_face = GL_STATE_UNKNOWN;
+	gl_state.front_face = GL_STATE_UNKNOWN;
+	gl_state.program = GL_STATE_UNKNOWN;
+	gl_state.vertex_array = GL_STATE_UNKNOWN;
+	gl_state.num_vertex_arrays = 0;
+	gl_state.active_unit = GL_STATE_UNKNOWN;
+	gl_state.framebuffer = GL_STATE_UNKNOWN;
+	gl_state.num_draw_buffers = 0;
+	gl_state.viewport_known = 0;
+
+	gl_state_initialized = 1;
+}
+
+/**
+ * Make sure the shadow state is set up.
+ **/
+static inline void
+gl_state_init(void)
+{
+	if (! gl_state_initialized)
+		gl_state_invalidate();
+}
+
+/**
+ * Enable or disable a capability.
+ **/
+void
+gl_state_set_cap(GLenum cap, int enabled)
+{
+	size_t i;
+
+	gl_state_init();
+	enabled = !!enabled;
+
+	for (i = 0; i < GL_STATE_NUM_CAPS; i++)
+		if (gl_state_caps[i] == cap)
+			break;
+
+	if (i < GL_STATE_NUM_CAPS && gl_state.caps[i] == enabled) {
+		stats_count_gl_skipped();
+		return;
+	}
+
+	if (i < GL_STATE_NUM_CAPS)
+		gl_state.caps[i] = enabled;
+
+	if (enabled)
+		glEnable(cap);
+	else
+		glDisable(cap);
+}
+
+/**
+ * Set the blend function.
+ **/
+void
+gl_state_blend_func(GLenum sfactor, GLenum dfactor)
+{
+	gl_state_init();
+
+	if (gl_state.blend_src == sfactor && gl_state.blend_dst == dfactor) {
+		stats_count_gl_skipped();
+		return;
+	}
+
+	gl_state.blend_src = sfactor;
+	gl_state.blend_dst = dfactor;
+	glBlendFunc(sfactor, dfactor);
+}
+
+/**
+ * Set which faces get culled.
+ **/
+void
+gl_state_cull_face(GLenum mode)
+{
+	gl_state_init();
+
+	if (gl_state.cull_face == mode) {
+		stats_count_gl_skipped();
+		return;
+	}
+
+	gl_state.cull_face = mode;
+	glCullFace(mode);
+}
+
+/**
+ * Set which winding is front-facing.
+ **/
+void
+gl_state_front_face(GLenum mode)
+{
+	gl_state_init();
+
+	if (gl_state.front_face == mode) {
+		stats_count_gl_skipped();
+		return;
+	}
+
+	gl_state.front_face = mode;
+	glFrontFace(mode);
+}
+
+/**
+ * Put a program in use.
+ **/
+void
+gl_state_use_program(GLuint program)
+{
+	gl_state_init();
+
+	if (gl_state.program == program) {
+		stats_count_gl_skipped();
+		return;
+	}
+
+	gl_state.program = program;
+	glUseProgram(program);
+}
+
+/**
+ * Find the shadow slot for a buffer target, or -1 if we don't shadow it.
+ **/
+static ssize_t
+gl_state_buffer_slot(GLenum target)
+{
+	size_t i;
+
+	for (i = 0; i < GL_STATE_NUM_BUFFER_TARGETS; i++)
+		if (gl_state_buffer_targets[i] == target)
+			return i;
+
+	return -1;
+}
+
+/**
+ * Bind a buffer to a target.
+ **/
+void
+gl_state_bind_buffer(GLenum target, GLuint buffer)
+{
+	ssize_t slot;
+
+	gl_state_init();
+	slot = gl_state_buffer_slot(target);
+
+	if (slot >= 0 && gl_state.buffers[slot] == buffer) {
+		stats_count_gl_skipped();
+		return;
+	}
+
+	if (slot >= 0)
+		gl_state.buffers[slot] = buffer;
+
+	glBindBuffer(target, buffer);
+}
+
+/**
+ * Delete a buffer. Deleting a bound buffer unbinds it.
+ **/
+void
+gl_state_delete_buffer(GLuint buffer)
+{
+	size_t i;
+
+	gl_state_init();
+
+	for (i = 0; i < GL_STATE_NUM_BUFFER_TARGETS; i++)
+		if (gl_state.buffers[i] == buffer)
+			gl_state.buffers[i] = 0;
+
+	/* Unbound vertex arrays keep the deleted buffer alive under a name
+	 * that may be handed out again, so we can't trust their bindings. */
+	for (i = 0; i < gl_state.num_vertex_arrays; i++)
+		if (gl_state.vertex_arrays[i].element_buffer == buffer)
+			gl_state.vertex_arrays[i].element_buffer =
+				GL_STATE_UNKNOWN;
+
+	glDeleteBuffers(1, &buffer);
+}
+
+/**
+ * Find the element buffer record for a vertex array, or NULL if there is
+ * none.
+ **/
+static struct gl_state_vertex_array *
+gl_state_find_vertex_array(GLuint vertex_array)
+{
+	size_t i;
+
+	for (i = 0; i < gl_state.num_vertex_arrays; i++)
+		if (gl_state.vertex_arrays[i].vertex_array == vertex_array)
+			return &gl_state.vertex_arrays[i];
+
+	return NULL;
+}
+
+/**
+ * Switch the shadowed element buffer binding over to a new vertex array.
+ **/
+static void
+gl_state_switch_vertex_array(GLuint vertex_array)
+{
+	struct gl_state_vertex_array *record;
+	ssize_t slot = gl_state_buffer_slot(GL_ELEMENT_ARRAY_BUFFER);
+
+	if (gl_state.vertex_array != GL_STATE_UNKNOWN) {
+		record = gl_state_find_vertex_array(gl_state.vertex_array);
+
+		if (! record) {
+			gl_state.vertex_arrays =
+				vec_expand(gl_state.vertex_arrays,
+					   gl_state.num_vertex_arrays);
+			record = &gl_state.vertex_arrays[
+				gl_state.num_vertex_arrays++];
+			record->vertex_array = gl_state.vertex_array;
+		}
+
+		record->element_buffer = gl_state.buffers[slot];
+	}
+
+	gl_state.vertex_array = vertex_array;
+	record = gl_state_find_vertex_array(vertex_array);
+	gl_state.buffers[slot] = record ? record->element_buffer :
+		GL_STATE_UNKNOWN;
+}
+
+/**
+ * Bind a vertex array object.
+ **/
+void
+gl_state_bind_vertex_array(GLuint vertex_array)
+{
+	gl_state_init();
+
+	if (gl_state.vertex_array == vertex_array) {
+		stats_count_gl_skipped();
+		return;
+	}
+
+	gl_state_switch_vertex_array(vertex_array);
+	glBindVertexArray(vertex_array);
+}
+
+/**
+ * Delete a vertex array object. Deleting the bound vertex array binds the
+ * default one.
+ **/
+void
+gl_state_delete_vertex_array(GLuint vertex_array)
+{
+	struct gl_state_vertex_array *record;
+	size_t idx;
+
+	gl_state_init();
+
+	if (gl_state.vertex_array == vertex_array)
+		gl_state_switch_vertex_array(0);
+
+	record = gl_state_find_vertex_array(vertex_array);
+
+	if (record) {
+		idx = record - gl_state.vertex_arrays;
+		gl_state.vertex_arrays = vec_del(gl_state.vertex_arrays,
+						 gl_state.num_vertex_arrays,
+						 idx);
+		gl_state.num_vertex_arrays--;
+	}
+
+	glDeleteVertexArrays(1, &vertex_array);
+}
+
+/**
+ * Select the active texture unit.
+ **/
+void
+gl_state_active_texture(GLuint unit)
+{
+	gl_state_init();
+
+	if (gl_state.active_unit == unit) {
+		stats_count_gl_skipped();
+		return;
+	}
+
+	gl_state.active_unit = unit;
+	glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+/**
+ * Bind a 2D texture to a unit. The unit is left active, so callers may go on
+ * to modify the texture.
+ **/
+void
+gl_state_bind_texture(GLuint unit, GLuint texture)
+{
+	gl_state_active_texture(unit);
+
+	if (unit < GL_STATE_MAX_UNITS && gl_state.textures[unit] == texture) {
+		stats_count_gl_skipped();
+		return;
+	}
+
+	if (unit < GL_STATE_MAX_UNITS)
+		gl_state.textures[unit] = texture;
+
+	glBindTexture(GL_TEXTURE_2D, texture);
+	stats_count_texture_bind();
+}
+
+/**
+ * Delete a texture. Deleting a bound texture unbinds it from every unit.
+ **/
+void
+gl_state_delete_texture(GLuint texture)
+{
+	size_t i;
+
+	gl_state_init();
+
+	for (i = 0; i < GL_STATE_MAX_UNITS; i++)
+		if (gl_state.textures[i] == texture)
+			gl_state.textures[i] = 0;
+
+	glDeleteTextures(1, &texture);
+}
+
+/**
+ * Bind a sampler to a unit.
+ **/
+void
+gl_state_bind_sampler(GLuint unit, GLuint sampler)
+{
+	gl_state_init();
+
+	if (unit < GL_STATE_MAX_UNITS && gl_state.samplers[unit] == sampler) {
+		stats_count_gl_skipped();
+		return;
+	}
+
+	if (unit < GL_STATE_MAX_UNITS)
+		gl_state.samplers[unit] = sampler;
+
+	glBindSampler(unit, sampler);
+}
+
+/**
+ * Delete a sampler. Deleting a bound sampler unbinds it from every unit.
+ **/
+void
+gl_state_delete_sampler(GLuint sampler)
+{
+	size_t i;
+
+	gl_state_init();
+
+	for (i = 0; i < GL_STATE_MAX_UNITS; i++)
+		if (gl_state.samplers[i] == sampler)
+			gl_state.samplers[i] = 0;
+
+	glDeleteSamplers(1, &sampler);
+}
+
+/**
+ * Bind a framebuffer.
+ **/
+void
+gl_state_bind_framebuffer(GLuint framebuffer)
+{
+	gl_state_init();
+
+	if (gl_state.framebuffer == framebuffer) {
+		stats_count_gl_skipped();
+		return;
+	}
+
+	gl_state.framebuffer = framebuffer;
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+/**
+ * Find the draw buffer record for a framebuffer, or NULL if there is none.
+ **/
+static struct gl_state_draw_buffers *
+gl_state_find_draw_buffers(GLuint framebuffer)
+{
+	size_t i;
+
+	for (i = 0; i < gl_state.num_draw_buffers; i++)
+		if (gl_state.draw_buffers[i].framebuffer == framebuffer)
+			return &gl_state.draw_buffers[i];
+
+	return NULL;
+}
+
+/**
+ * Delete a framebuffer. Deleting the bound framebuffer binds the default one.
+ **/
+void
+gl_state_delete_framebuffer(GLuint framebuffer)
+{
+	struct gl_state_draw_buffers *record;
+	size_t idx;
+
+	gl_state_init();
+
+	if (gl_state.framebuffer == framebuffer)
+		gl_state.framebuffer = 0;
+
+	record = gl_state_find_draw_buffers(framebuffer);
+
+	if (record) {
+		idx = record - gl_state.draw_buffers;
+		gl_state.draw_buffers = vec_del(gl_state.draw_buffers,
+						gl_state.num_draw_buffers, idx);
+		gl_state.num_draw_buffers--;
+	}
+
+	glDeleteFramebuffers(1, &framebuffer);
+}
+
+/**
+ * Set the draw buffers for the bound framebuffer.
+ **/
+void
+gl_state_draw_buffers(size_t count, const GLenum *buffers)
+{
+	struct gl_state_draw_buffers *record = NULL;
+
+	gl_state_init();
+
+	if (gl_state.framebuffer != GL_STATE_UNKNOWN &&
+	    count <= GL_STATE_MAX_DRAW_BUFFERS)
+		record = gl_state_find_draw_buffers(gl_state.framebuffer);
+
+	if (record && record->count == count &&
+	    ! memcmp(record->buffers, buffers, count * sizeof(GLenum))) {
+		stats_count_gl_skipped();
+		return;
+	}
+
+	if (! record && gl_state.framebuffer != GL_STATE_UNKNOWN &&
+	    count <= GL_STATE_MAX_DRAW_BUFFERS) {
+		gl_state.draw_buffers = vec_expand(gl_state.draw_buffers,
+						   gl_state.num_draw_buffers);
+		record = &gl_state.draw_buffers[gl_state.num_draw_buffers++];
+		record->framebuffer = gl_state.framebuffer;
+	}
+
+	if (record) {
+		record->count = count;
+		memcpy(record->buffers, buffers, count * sizeof(GLenum));
+	}
+
+	if (count == 1)
+		glDrawBuffer(buffers[0]);
+	else
+		glDrawBuffers(count, buffers);
+}
+
+/**
+ * Set the viewport.
+ **/
+void
+gl_state_viewport(GLint x, GLint y, GLsizei w, GLsizei h)
+{
+	gl_state_init();
+
+	if (gl_state.viewport_known && gl_state.viewport[0] == x &&
+	    gl_state.viewport[1] == y && gl_state.viewport[2] == w &&
+	    gl_state.viewport[3] == h) {
+		stats_count_gl_skipped();
+		return;
+	}
+
+	gl_state.viewport[0] = x;
+	gl_state.viewport[1] = y;
+	gl_state.viewport[2] = w;
+	gl_state.viewport[3] = h;
+	gl_state.viewport_known = 1;
+	glViewport(x, y, w, h);
+}
@@ -0,0 +1,55 @@
+/**
+ * Copyright © 2013 Casey Dahlin
+ *
+ * This file is part of Luftballons.
+ *
+ * Luftballons is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Luftballons is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <GL/gl.h>
+
+#include "util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void gl_state_invalidate(void);
+void gl_state_set_cap(GLenum cap, int enabled);
+void gl_state_blend_func(GLenum sfactor, GLenum dfactor);
+void gl_state_cull_face(GLenum mode);
+void gl_state_front_face(GLenum mode);
+void gl_state_use_program(GLuint program);
+void gl_state_bind_buffer(GLenum target, GLuint buffer);
+void gl_state_delete_buffer(GLuint buffer);
+void gl_state_bind_vertex_array(GLuint vertex_array);
+void gl_state_delete_vertex_array(GLuint vertex_array);
+void gl_state_active_texture(GLuint unit);
+void gl_state_bind_texture(GLuint unit, GLuint texture);
+void gl_state_delete_texture(GLuint texture);
+void gl_state_bind_sampler(GLuint unit, GLuint sampler);
+void gl_state_delete_sampler(GLuint sampler);
+void gl_state_bind_framebuffer(GLuint framebuffer);
+void gl_state_delete_framebuffer(GLuint framebuffer);
+void gl_state_draw_buffers(size_t count, const GLenum *buffers);
+void gl_state_viewport(GLint x, GLint y, GLsizei w, GLsizei h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GL_STATE_H */
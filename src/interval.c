@@ -6,7 +6,7 @@
  * Luftballons is free software: you can redistribute it and/or modify it under
  * the terms of the GNU Lesser General Public License as published by the Free
  * Software Foundation, either version 3 of the License, or (at your option)
- * any later version/
+ * any later version.
  *
  * Luftballons is distributed in the hope that it will be useful, but WITHOUT
  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
@@ -24,369 +24,547 @@
 #include "interval.h"
 #include "util.h"
 
+/* Smallest size of the allocated block table; must be a power of two. */
+#ifndef INTERVAL_TABLE_MIN
+#define INTERVAL_TABLE_MIN 16
+#endif
+
 /**
- * Initialize an interval set.
+ * Find the size class holding blocks of the given size. Each class covers
+ * sizes from its own minimum up to the next class's.
  **/
-void
-intervals_init(intervals_t *set)
+static size_t
+interval_bin_floor(size_t size)
 {
-	set->by_start = xmalloc(sizeof(intervals_t *));
-	set->by_size = xmalloc(sizeof(intervals_t *));
-	set->count = 0;
+	size_t top;
+
+	if (size < INTERVAL_SUB_BINS)
+		return size;
+
+	top = sizeof(unsigned long long) * 8 - 1 - __builtin_clzll(size);
+
+	return (top - INTERVAL_SUB_BITS + 1) * INTERVAL_SUB_BINS +
+		((size >> (top - INTERVAL_SUB_BITS)) & (INTERVAL_SUB_BINS - 1));
 }
 
 /**
- * Free an interval set's resources
+ * Find the smallest size class whose blocks are all at least the given size.
  **/
-void
-intervals_release(intervals_t *set)
+static size_t
+interval_bin_ceil(size_t size)
 {
-	size_t i;
+	size_t bin = interval_bin_floor(size);
+	size_t top;
 
-	for (i = 0; i < set->count; i++)
-		free(set->by_size[i]);
+	if (size < INTERVAL_SUB_BINS)
+		return bin;
 
-	free(set->by_size);
-	free(set->by_start);
+	top = sizeof(unsigned long long) * 8 - 1 - __builtin_clzll(size);
+
+	if (size & ((1ull << (top - INTERVAL_SUB_BITS)) - 1))
+		bin++;
+
+	return bin;
 }
 
 /**
- * Find an index into the offset-sorted free list of an object that has the
- * given offset. Will return the next consecutive item if there is none.
+ * Find the first size class at or above bin that has free blocks.
+ *
+ * Returns: The size class, or INTERVAL_NUM_BINS if there is none.
  **/
 static size_t
-interval_bisect_start(intervals_t *set, size_t offset)
+interval_bin_search(intervals_t *set, size_t bin)
 {
-	size_t pos;
-	size_t start = 0;
-	size_t end = set->count;
-
-	interval_t *cmp;
-
-	while (end != start) {
-		pos = (start + end) / 2;
-		cmp = set->by_start[pos];
-
-		if (cmp->start < offset && (pos + 1) != end)
-			start = pos;
-		else if (cmp->start < offset)
-			return end;
-		else if (cmp->start > offset)
-			end = pos;
-		else if (cmp->start == offset)
-			return pos;
-		else if (pos == (end - 1) && end == set->count)
-			return set->count;
-		else
-			return pos;
-	}
+	size_t top = bin / INTERVAL_SUB_BINS;
+	unsigned int sub = bin % INTERVAL_SUB_BINS;
+	unsigned int sub_bits;
+	uint64_t top_bits;
+
+	if (top >= INTERVAL_TOP_BINS)
+		return INTERVAL_NUM_BINS;
+
+	sub_bits = set->sub_bits[top] & (0xFFu << sub);
 
-	return start;
+	if (sub_bits)
+		return top * INTERVAL_SUB_BINS + __builtin_ctz(sub_bits);
+
+	if (top + 1 >= INTERVAL_TOP_BINS)
+		return INTERVAL_NUM_BINS;
+
+	top_bits = set->top_bits & (~0ull << (top + 1));
+
+	if (! top_bits)
+		return INTERVAL_NUM_BINS;
+
+	top = __builtin_ctzll(top_bits);
+	return top * INTERVAL_SUB_BINS + __builtin_ctz(set->sub_bits[top]);
 }
 
 /**
- * Find an index into the by_size list of an interval that has the given size.
- * Will return the next consecutive item if there is none.
+ * Put a free block in the list for its size class.
  **/
-static size_t
-interval_bisect_size(intervals_t *set, size_t size)
+static void
+interval_bin_insert(intervals_t *set, uint32_t idx)
 {
-	size_t pos;
-	size_t start = 0;
-	size_t end = set->count;
-
-	interval_t *cmp;
-
-	while (end != start) {
-		pos = (start + end) / 2;
-		cmp = set->by_size[pos];
-
-		if (cmp->size > size && (pos + 1) != end)
-			start = pos;
-		else if (cmp->size > size)
-			return end;
-		else if (cmp->size < size)
-			end = pos;
-		else if (cmp->size == size)
-			return pos;
-		else if (pos == (end - 1) && end == set->count)
-			return set->count;
-		else
-			return pos;
-	}
+	interval_node_t *node = &set->nodes[idx];
+	size_t bin = interval_bin_floor(node->size);
+	uint32_t head = set->bins[bin];
+
+	node->bin_prev = INTERVAL_NONE;
+	node->bin_next = head;
 
-	return start;
+	if (head != INTERVAL_NONE)
+		set->nodes[head].bin_prev = idx;
+
+	set->bins[bin] = idx;
+	set->sub_bits[bin / INTERVAL_SUB_BINS] |= 1u << (bin % INTERVAL_SUB_BINS);
+	set->top_bits |= 1ull << (bin / INTERVAL_SUB_BINS);
+	set->free_space += node->size;
 }
 
 /**
- * Remove an interval from a set that is at the given index in the offset list.
+ * Take a free block out of the list for its size class.
  **/
 static void
-interval_remove_at_pos(intervals_t *set, size_t offset_idx)
+interval_bin_remove(intervals_t *set, uint32_t idx)
 {
-	size_t pos;
-
-	interval_t *interval = set->by_start[offset_idx];
-
-	memmove(&set->by_start[offset_idx], &set->by_start[offset_idx + 1],
-		(set->count - offset_idx - 1) * sizeof(interval_t *));
+	interval_node_t *node = &set->nodes[idx];
+	size_t bin = interval_bin_floor(node->size);
+	size_t top = bin / INTERVAL_SUB_BINS;
 
-	pos = interval_bisect_size(set, interval->size);
+	if (node->bin_prev != INTERVAL_NONE)
+		set->nodes[node->bin_prev].bin_next = node->bin_next;
+	else
+		set->bins[bin] = node->bin_next;
 
-	if (set->by_size[pos]->size != interval->size)
-		errx(1, "Item missing from interval size list");
+	if (node->bin_next != INTERVAL_NONE)
+		set->nodes[node->bin_next].bin_prev = node->bin_prev;
 
-	while (pos && set->by_size[pos - 1]->size == interval->size)
-		pos--;
+	set->free_space -= node->size;
 
-	while(set->by_size[pos] != interval)
-		pos++;
+	if (set->bins[bin] != INTERVAL_NONE)
+		return;
 
-	memmove(&set->by_size[offset_idx], &set->by_size[offset_idx + 1],
-		(set->count - offset_idx - 1) *
-		sizeof(interval_t *));
+	set->sub_bits[top] &= ~(1u << (bin % INTERVAL_SUB_BINS));
 
-	set->count--;
-	free(interval);
+	if (! set->sub_bits[top])
+		set->top_bits &= ~(1ull << top);
 }
 
 /**
- * Reposition an item in the size array because it has changed size.
+ * Get an unused node.
  **/
-static void
-interval_reposition_by_size(intervals_t *set, size_t idx)
+static uint32_t
+interval_node_get(intervals_t *set)
 {
-	size_t idx_new = idx;
-	interval_t *interval = set->by_size[idx];
+	uint32_t ret = set->unused_node;
+	size_t i;
 
-	while (idx && interval->size < set->by_size[idx - 1]->size)
-		idx_new--;
+	if (ret == INTERVAL_NONE) {
+		ret = set->num_nodes;
+		set->num_nodes = set->num_nodes ? set->num_nodes * 2 : 8;
 
-	while (idx < (set->count - 1) &&
-	       interval->size < set->by_size[idx + 1]->size)
-		idx_new++;
+		if (set->num_nodes >= INTERVAL_NONE)
+			errx(1, "Too many intervals");
 
-	if (idx_new == idx)
-		return;
+		set->nodes = xrealloc(set->nodes, set->num_nodes *
+				      sizeof(interval_node_t));
 
-	if (idx_new > idx)
-		memmove(&set->by_size[idx], &set->by_size[idx + 1],
-			(idx_new - idx) * sizeof(interval_t *));
-	else
-		memmove(&set->by_size[idx_new + 1], &set->by_size[idx_new],
-			(idx - idx_new) * sizeof(interval_t *));
+		for (i = ret; i < set->num_nodes; i++)
+			set->nodes[i].bin_next = i + 1;
 
-	set->by_size[idx_new] = interval;
+		set->nodes[set->num_nodes - 1].bin_next = INTERVAL_NONE;
+	}
+
+	set->unused_node = set->nodes[ret].bin_next;
+	return ret;
 }
 
 /**
- * Reposition an item in the size array because it has changed size.
+ * Return a node to the unused list.
  **/
 static void
-interval_handle_resize(intervals_t *set, size_t idx)
+interval_node_put(intervals_t *set, uint32_t idx)
 {
-	size_t idx_new = idx;
-	interval_t *interval = set->by_size[idx];
+	set->nodes[idx].bin_next = set->unused_node;
+	set->unused_node = idx;
+}
 
-	while (idx && interval->size < set->by_size[idx - 1]->size)
-		idx_new--;
+/**
+ * Find the slot in the allocated block table where a start offset belongs.
+ **/
+static size_t
+interval_table_home(intervals_t *set, size_t start)
+{
+	return ((uint64_t)start * 0x9E3779B97F4A7C15ull >> 32) &
+		set->by_start_mask;
+}
 
-	while (idx < (set->count - 1) &&
-	       interval->size < set->by_size[idx + 1]->size)
-		idx_new++;
+/**
+ * Add an allocated block to the table.
+ **/
+static void
+interval_table_insert(intervals_t *set, uint32_t idx)
+{
+	uint32_t *old = set->by_start;
+	size_t old_size = old ? set->by_start_mask + 1 : 0;
+	size_t slot;
+	size_t i;
 
-	if (idx_new == idx)
-		return;
+	/* Keep the table at most half full. */
+	if ((set->num_used + 1) * 2 > old_size) {
+		set->by_start_mask = old_size ? old_size * 2 - 1 :
+			INTERVAL_TABLE_MIN - 1;
+		set->by_start = xmalloc((set->by_start_mask + 1) *
+					sizeof(uint32_t));
+		memset(set->by_start, 0xFF,
+		       (set->by_start_mask + 1) * sizeof(uint32_t));
+		set->num_used = 0;
+
+		for (i = 0; i < old_size; i++)
+			if (old[i] != INTERVAL_NONE)
+				interval_table_insert(set, old[i]);
+
+		free(old);
+	}
 
-	if (idx_new > idx)
-		memmove(&set->by_size[idx], &set->by_size[idx + 1],
-			(idx_new - idx) * sizeof(interval_t *));
-	else
-		memmove(&set->by_size[idx_new + 1], &set->by_size[idx_new],
-			(idx - idx_new) * sizeof(interval_t *));
+	slot = interval_table_home(set, set->nodes[idx].start);
+
+	while (set->by_start[slot] != INTERVAL_NONE)
+		slot = (slot + 1) & set->by_start_mask;
 
-	set->by_size[idx_new] = interval;
+	set->by_start[slot] = idx;
+	set->num_used++;
 }
 
 /**
- * Merge an interval with intervals on either side of it if there is no space
- * between them.
+ * Find and remove the allocated block at a start offset.
  *
- * set: Interval set to act on.
- * idx: Index in the start list of the interval to merge.
+ * Returns: The block, or INTERVAL_NONE if no block starts there.
  **/
-static void
-interval_do_merge(intervals_t *set, size_t idx)
+static uint32_t
+interval_table_remove(intervals_t *set, size_t start)
 {
-	size_t count = 0;
-	size_t end_size;
-	interval_t *pos = set->by_start[idx];
-	interval_t *cmp;
+	size_t slot;
+	size_t next;
+	size_t home;
+	uint32_t ret;
+
+	if (! set->by_start)
+		return INTERVAL_NONE;
 
-	if (idx + 1 < set->count) {
-		cmp = set->by_start[idx + 1];
+	slot = interval_table_home(set, start);
 
-		if (cmp->start == pos->start + pos->size)
-			count++;
+	for (;;) {
+		ret = set->by_start[slot];
+
+		if (ret == INTERVAL_NONE)
+			return INTERVAL_NONE;
+
+		if (set->nodes[ret].start == start)
+			break;
+
+		slot = (slot + 1) & set->by_start_mask;
 	}
 
-	if (idx > 0) {
-		cmp = set->by_start[idx - 1];
+	/* Shift later entries back so lookups never stop short at a hole. */
+	next = slot;
+
+	for (;;) {
+		set->by_start[slot] = INTERVAL_NONE;
+
+		for (;;) {
+			next = (next + 1) & set->by_start_mask;
+
+			if (set->by_start[next] == INTERVAL_NONE) {
+				set->num_used--;
+				return ret;
+			}
 
-		if (cmp->start == pos->start + pos->size) {
-			count++;
-			idx--;
+			home = interval_table_home(set,
+				set->nodes[set->by_start[next]].start);
+
+			/* Stay put if home lies cyclically in (slot, next]. */
+			if (slot <= next ? (slot < home && home <= next) :
+			    (slot < home || home <= next))
+				continue;
+
+			break;
 		}
+
+		set->by_start[slot] = set->by_start[next];
+		slot = next;
 	}
+}
+
+/**
+ * Initialize an interval set, with the whole range free.
+ **/
+void
+intervals_init(intervals_t *set, size_t size)
+{
+	size_t i;
 
-	if (count) {
-		cmp = set->by_start[idx + count];
-		end_size = cmp->start - pos->start + cmp->size;
+	set->nodes = NULL;
+	set->num_nodes = 0;
+	set->unused_node = INTERVAL_NONE;
 
-		for(;count; count--)
-			interval_remove_at_pos(set, idx + count);
+	for (i = 0; i < INTERVAL_NUM_BINS; i++)
+		set->bins[i] = INTERVAL_NONE;
 
-		pos->size = end_size;
-	}
+	set->top_bits = 0;
+	memset(set->sub_bits, 0, sizeof(set->sub_bits));
+
+	set->by_start = NULL;
+	set->by_start_mask = 0;
+	set->num_used = 0;
+
+	set->size = size;
+	set->free_space = 0;
+	set->changes = 0;
+	set->last = INTERVAL_NONE;
 
-	interval_handle_resize(set, idx);
+	if (! size)
+		return;
+
+	set->last = interval_node_get(set);
+	set->nodes[set->last].start = 0;
+	set->nodes[set->last].size = size;
+	set->nodes[set->last].prev = INTERVAL_NONE;
+	set->nodes[set->last].next = INTERVAL_NONE;
+	set->nodes[set->last].used = 0;
+	interval_bin_insert(set, set->last);
 }
 
 /**
- * Set an interval in the intervals set.
+ * Free an interval set's resources
  **/
 void
-interval_set(intervals_t *set, size_t start, size_t size)
+intervals_release(intervals_t *set)
 {
-	size_t sz_pos;
-	size_t off_pos;
+	free(set->nodes);
+	free(set->by_start);
+}
 
-	interval_t *new = xmalloc(sizeof(interval_t));
-	interval_t *cmp = NULL;
+/**
+ * Allocate the start of a free block, returning the rest to the free lists.
+ **/
+static size_t
+interval_take(intervals_t *set, uint32_t idx, size_t size)
+{
+	uint32_t rest;
+	interval_node_t *node;
 
-	new->start = start;
-	new->size = size;
+	interval_bin_remove(set, idx);
 
-	off_pos = interval_bisect_start(set, new->start);
+	if (set->nodes[idx].size > size) {
+		rest = interval_node_get(set);
+		node = &set->nodes[idx];
 
-	if (off_pos > 0) {
-		cmp = set->by_start[off_pos - 1];
+		set->nodes[rest].start = node->start + size;
+		set->nodes[rest].size = node->size - size;
+		set->nodes[rest].prev = idx;
+		set->nodes[rest].next = node->next;
+		set->nodes[rest].used = 0;
 
-		if (cmp->start + cmp->size == start) {
-			cmp->size += size;
-			interval_do_merge(set, off_pos - 1);
-			free(new);
-			return;
-		}
+		if (node->next != INTERVAL_NONE)
+			set->nodes[node->next].prev = rest;
+		else
+			set->last = rest;
+
+		node->next = rest;
+		node->size = size;
+		interval_bin_insert(set, rest);
 	}
 
-	if (off_pos < set->count) {
-		cmp = set->by_start[off_pos];
+	set->nodes[idx].used = 1;
+	interval_table_insert(set, idx);
+	return set->nodes[idx].start;
+}
 
-		if (cmp->start == start + size) {
-			cmp->start = start;
-			cmp->size += size;
-			interval_do_merge(set, off_pos);
-			free(new);
-			return;
-		}
-	}
+/**
+ * Allocate space from an interval set.
+ *
+ * Returns: The offset of the space or -1 if there isn't a big enough block.
+ **/
+ssize_t
+interval_alloc(intervals_t *set, size_t size)
+{
+	size_t bin;
+	uint32_t idx;
 
-	if (cmp) {
-		if (cmp->start <= start && cmp->start + cmp->size > start)
-			errx(1, "Interval already set");
+	if (! size)
+		return 0;
 
-		if (start <= cmp->start && start + size > cmp->start)
-			errx(1, "Interval already set");
-	}
+	bin = interval_bin_search(set, interval_bin_ceil(size));
+
+	if (bin < INTERVAL_NUM_BINS)
+		return interval_take(set, set->bins[bin], size);
 
-	sz_pos = interval_bisect_size(set, new->size);
+	/* Blocks in the size's own class may still be big enough. */
+	idx = set->bins[interval_bin_floor(size)];
 
-	set->by_size = vec_expand(set->by_size, set->count);
-	set->by_start = vec_expand(set->by_start, set->count);
+	while (idx != INTERVAL_NONE && set->nodes[idx].size < size)
+		idx = set->nodes[idx].bin_next;
 
-	memmove(&set->by_size[sz_pos + 1], &set->by_size[sz_pos],
-		(set->count - sz_pos) * sizeof(interval_t *));
-	memmove(&set->by_start[off_pos + 1], &set->by_start[off_pos],
-		(set->count - off_pos) * sizeof(interval_t *));
-	set->count++;
+	if (idx == INTERVAL_NONE)
+		return -1;
 
-	set->by_size[sz_pos] = new;
-	set->by_start[off_pos] = new;
+	return interval_take(set, idx, size);
 }
 
 /**
- * Unset an interval in the intervals set.
+ * Allocate space that ends at or before a given offset. Slower than
+ * interval_alloc, as it may have to look through many free blocks, so it's
+ * meant for moving things toward the start to compact a set.
+ *
+ * Returns: The offset of the space or -1 if there isn't a block that fits.
  **/
-void
-interval_unset(intervals_t *set, size_t offset, size_t size)
+ssize_t
+interval_alloc_below(intervals_t *set, size_t size, size_t limit)
 {
-	size_t start = 0;
-	size_t end = set->count;
-	size_t split;
-	size_t create_size = 0;
-	interval_t *pos;
+	size_t bin;
+	uint32_t idx;
+	interval_node_t *node;
 
-	if (! end)
-		errx(1, "No intervals set");
+	if (! size || size > limit)
+		return -1;
 
-	/* We get away with some stuff here because we MUST find a result */
-	for (;;) {
-		split = (start + end) / 2;
-		pos = set->by_start[split];
-
-		if (pos->start > offset) {
-			if (! end)
-				errx(1, "Interval not set");
-			end = split;
-		} else if (pos->start + pos->size <= offset) {
-			if (start == split)
-				errx(1, "Interval not set");
-			start = split;
-		} else {
-			break;
+	for (bin = interval_bin_search(set, interval_bin_floor(size));
+	     bin < INTERVAL_NUM_BINS;
+	     bin = interval_bin_search(set, bin + 1)) {
+		for (idx = set->bins[bin]; idx != INTERVAL_NONE;
+		     idx = node->bin_next) {
+			node = &set->nodes[idx];
+
+			if (node->size >= size && node->start <= limit - size)
+				return interval_take(set, idx, size);
 		}
 	}
 
-	if ((pos->start + pos->size) > offset + size)
-		errx(1, "Interval too large");
+	return -1;
+}
+
+/**
+ * Extend the range an interval set covers. The new space is free.
+ **/
+void
+intervals_grow(intervals_t *set, size_t size)
+{
+	uint32_t last = set->last;
+	uint32_t idx;
+
+	if (size <= set->size)
+		return;
+
+	set->changes++;
 
-	if (pos->start == offset && pos->size == size) {
-		interval_remove_at_pos(set, split);
+	if (last != INTERVAL_NONE && ! set->nodes[last].used) {
+		interval_bin_remove(set, last);
+		set->nodes[last].size += size - set->size;
+		interval_bin_insert(set, last);
+		set->size = size;
 		return;
 	}
 
-	if (pos->start == offset) {
-		pos->start += size;
+	idx = interval_node_get(set);
+	set->nodes[idx].start = set->size;
+	set->nodes[idx].size = size - set->size;
+	set->nodes[idx].prev = last;
+	set->nodes[idx].next = INTERVAL_NONE;
+	set->nodes[idx].used = 0;
+
+	if (last != INTERVAL_NONE)
+		set->nodes[last].next = idx;
+
+	set->last = idx;
+	set->size = size;
+	interval_bin_insert(set, idx);
+}
+
+/**
+ * Merge a free block into the free block after it.
+ **/
+static void
+interval_merge_next(intervals_t *set, uint32_t idx)
+{
+	interval_node_t *node = &set->nodes[idx];
+	uint32_t next = node->next;
+
+	node->size += set->nodes[next].size;
+	node->next = set->nodes[next].next;
+
+	if (node->next != INTERVAL_NONE)
+		set->nodes[node->next].prev = idx;
+	else
+		set->last = idx;
+
+	interval_node_put(set, next);
+}
+
+/**
+ * Free space allocated with interval_alloc.
+ **/
+void
+interval_free(intervals_t *set, size_t start, size_t size)
+{
+	uint32_t idx;
+	uint32_t prev;
+	uint32_t next;
+
+	if (! size)
 		return;
+
+	idx = interval_table_remove(set, start);
+
+	if (idx == INTERVAL_NONE)
+		errx(1, "Interval not set");
+
+	if (set->nodes[idx].size != size)
+		errx(1, "Interval freed with the wrong size");
+
+	set->changes++;
+	set->nodes[idx].used = 0;
+	next = set->nodes[idx].next;
+	prev = set->nodes[idx].prev;
+
+	if (next != INTERVAL_NONE && ! set->nodes[next].used) {
+		interval_bin_remove(set, next);
+		interval_merge_next(set, idx);
 	}
 
-	create_size = pos->size - size - (offset - pos->start);
-	pos->size = (offset - pos->start);
+	if (prev != INTERVAL_NONE && ! set->nodes[prev].used) {
+		interval_bin_remove(set, prev);
+		interval_merge_next(set, prev);
+		idx = prev;
+	}
 
-	interval_reposition_by_size(set, split);
-	if (create_size)
-		interval_set(set, pos->start + pos->size + size,
-			     create_size);
+	interval_bin_insert(set, idx);
 }
 
 /**
- * Find a set interval of the given size and get its offset.
- *
- * Returns: The offset or -1 if not found.
+ * Get the size of the biggest free block in an interval set.
  **/
-ssize_t
-interval_find(intervals_t *set, size_t size)
+size_t
+intervals_largest_free(intervals_t *set)
 {
-	interval_t *pos;
+	size_t top;
+	size_t bin;
+	size_t ret = 0;
+	uint32_t idx;
 
-	if (! set->count)
-		return -1;
+	if (! set->top_bits)
+		return 0;
 
-	pos = set->by_size[0];
+	top = sizeof(unsigned long long) * 8 - 1 -
+		__builtin_clzll(set->top_bits);
+	bin = top * INTERVAL_SUB_BINS + 31 -
+		__builtin_clz(set->sub_bits[top]);
 
-	if (pos->size < size)
-		return -1;
+	for (idx = set->bins[bin]; idx != INTERVAL_NONE;
+	     idx = set->nodes[idx].bin_next)
+		if (set->nodes[idx].size > ret)
+			ret = set->nodes[idx].size;
 
-	return pos->start + pos->size - size;
+	return ret;
 }
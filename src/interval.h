@@ -21,38 +21,90 @@
 #define INTERVAL_H
 
 #include <stdlib.h>
+#include <stdint.h>
+
+/* Size classes: one per power of two, each split into this many (log2). */
+#define INTERVAL_SUB_BITS 3
+#define INTERVAL_SUB_BINS (1 << INTERVAL_SUB_BITS)
+#define INTERVAL_TOP_BINS 64
+#define INTERVAL_NUM_BINS (INTERVAL_TOP_BINS * INTERVAL_SUB_BINS)
+
+/* Node index meaning "no node" */
+#define INTERVAL_NONE UINT32_MAX
 
 /**
- * An interval, which is to say a start and length.
+ * A block of space, free or allocated. Blocks tile the whole range managed by
+ * an intervals_t, and are linked to their neighbours in address order so
+ * freed space can merge with the space around it.
+ *
+ * start, size: Where the block is.
+ * prev, next: Neighbouring blocks by address.
+ * bin_prev, bin_next: Neighbouring free blocks in the same size class, or the
+ *                     next unused node if this node is unused.
+ * used: Set if the block is allocated.
  **/
-typedef struct interval {
+typedef struct interval_node {
 	size_t start;
 	size_t size;
-} interval_t;
+	uint32_t prev;
+	uint32_t next;
+	uint32_t bin_prev;
+	uint32_t bin_next;
+	int used;
+} interval_node_t;
 
 /**
- * A set of non-overlapping, merged intervals.
+ * An allocator for space in a range, like a GPU buffer.
+ *
+ * Free blocks are kept in lists by size class, with a bitmap of which classes
+ * have blocks in them, so allocating and freeing take constant time and
+ * nothing is allocated per block.
  *
- * by_size: List of intervals sorted biggest to smallest.
- * by_start: List of intervals sorted first to last.
- * count: Number of intervals.
+ * nodes, num_nodes: Storage for blocks.
+ * unused_node: Head of the list of unused entries in nodes.
+ * bins: Head of the free block list for each size class.
+ * top_bits: Bit n is set if any size class in the nth power of two has
+ *           free blocks.
+ * sub_bits: Which size classes in each power of two have free blocks.
+ * by_start, by_start_mask: Open-addressed table of allocated blocks by
+ *                          start offset, so they can be freed by offset.
+ * num_used: Number of allocated blocks.
+ * last: Block at the end of the range.
+ * size: Size of the whole range.
+ * free_space: Total free space.
+ * changes: Counts frees and grows, so callers can tell whether blocks have
+ *          come free since they last looked.
  **/
 typedef struct intervals {
-	interval_t **by_size;
-	interval_t **by_start;
+	interval_node_t *nodes;
+	size_t num_nodes;
+	uint32_t unused_node;
 
-	size_t count;
+	uint32_t bins[INTERVAL_NUM_BINS];
+	uint64_t top_bits;
+	uint8_t sub_bits[INTERVAL_TOP_BINS];
+
+	uint32_t *by_start;
+	size_t by_start_mask;
+	size_t num_used;
+
+	uint32_t last;
+	size_t size;
+	size_t free_space;
+	uint64_t changes;
 } intervals_t;
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-void intervals_init(intervals_t *set);
+void intervals_init(intervals_t *set, size_t size);
 void intervals_release(intervals_t *set);
-void interval_set(intervals_t *set, size_t start, size_t size);
-void interval_unset(intervals_t *set, size_t start, size_t size);
-ssize_t interval_find(intervals_t *set, size_t size);
+ssize_t interval_alloc(intervals_t *set, size_t size);
+ssize_t interval_alloc_below(intervals_t *set, size_t size, size_t limit);
+void intervals_grow(intervals_t *set, size_t size);
+void interval_free(intervals_t *set, size_t start, size_t size);
+size_t intervals_largest_free(intervals_t *set);
 
 #ifdef __cplusplus
 }
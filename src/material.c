@@ -18,174 +18,173 @@
  **/ 
 
 #include <err.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "material.h"
 #include "util.h"
 
+/* Most entries the deletion log holds before its oldest half is dropped.
+ * Must be a power of two. */
+#ifndef MATERIAL_LOG_MAX
+#define MATERIAL_LOG_MAX 4096
+#endif
+
 /**
- * Deletion backlog. Indicates that there are objects out there which may not
- * have heard about the disappearance of a certain material ID. We track
- * generations so IDs getting thrown out and reallocated doesn't trip us up.
+ * Deletion log. Every destroyed material ID is appended here, and objects
+ * which track materials keep a cursor into it, so they can find out which IDs
+ * went away since they last looked. Cursors count deletions since startup, so
+ * IDs getting thrown out and reallocated doesn't trip us up.
+ *
+ * deletion_log, log_size: Material IDs destroyed since log_base.
+ * log_base: Cursor value of the first entry in the log.
+ *
+ * The log is capped at MATERIAL_LOG_MAX entries so a subscriber that never
+ * syncs can't make it grow forever. Subscribers whose cursor falls off the
+ * front of the log are caught up from deleted_at instead.
  **/
-struct backlog {
-	size_t gen_id;
-	size_t users_outstanding;
-	size_t *releases;
-	size_t num_releases;
-};
+static material_t *deletion_log = NULL;
+static size_t log_size = 0;
+static size_t log_base = 0;
 
 /**
- * Material ID after the highest allocated.
+ * Cursor value at which each material ID was last destroyed, or SIZE_T_MAX
+ * if it never has been while anyone was subscribed. Indexed by material ID.
  **/
-static size_t alloc_watermark = 0;
+static size_t *deleted_at = NULL;
 
 /**
- * List of free'd material IDs.
+ * Scratch list handed back by material_backlog_sync when a subscriber has
+ * to be caught up from deleted_at.
  **/
-static size_t *free_ids = NULL;
-static size_t num_free_ids = 0;
+static material_t *resync_list = NULL;
 
 /**
- * ID of the next backlog generation.
+ * Number of objects subscribed to the log.
  **/
-static size_t gen_id = 0;
+static size_t users_outstanding = 0;
 
 /**
- * Number of objects subscribed to the backlog.
+ * Number of subscribers whose cursor is behind the end of the log. When this
+ * reaches zero nobody needs the log anymore and we can empty it.
  **/
-static size_t users_outstanding = 0;
+static size_t users_lagging = 0;
 
 /**
- * List of backlogs.
+ * Material ID after the highest allocated.
  **/
-static struct backlog *backlogs;
-static size_t num_backlogs;
+static size_t alloc_watermark = 0;
 
 /**
- * Acquire a current generation ID.
+ * Bitmap of allocated material IDs.
  **/
-static size_t
-material_acquire_gen_id(void)
-{
-	if (!num_backlogs || backlogs[num_backlogs - 1].num_releases) {
-		backlogs = vec_expand(backlogs, num_backlogs);
-		backlogs[num_backlogs].gen_id = gen_id++;
-		backlogs[num_backlogs].users_outstanding = users_outstanding;
-		backlogs[num_backlogs].releases = NULL;
-		backlogs[num_backlogs].num_releases = 0;
-		num_backlogs++;
-	} else {
-		backlogs[num_backlogs - 1].users_outstanding++;
-	}
+static uint64_t *alloc_bits = NULL;
 
-	return backlogs[num_backlogs - 1].gen_id;
+/**
+ * List of free'd material IDs.
+ **/
+static size_t *free_ids = NULL;
+static size_t num_free_ids = 0;
+
+/**
+ * Cursor value for the end of the log.
+ **/
+static inline size_t
+material_log_end(void)
+{
+	return log_base + log_size;
 }
 
 /**
- * Get rid of all no-longer-referenced backlogs.
+ * Note that a subscriber has caught up with the log, or gone away while
+ * behind it. Empty the log if nobody is behind anymore.
  **/
 static void
-material_sweep_backlogs(void)
+material_log_user_caught_up(void)
 {
-	size_t i;
-
-	for (i = 0; i < num_backlogs;) {
-		if (backlogs[i].users_outstanding) {
-			i++;
-			continue;
-		}
+	if (--users_lagging)
+		return;
 
-		free(backlogs[i].releases);
-		backlogs = vec_del(backlogs, num_backlogs, i);
-		num_backlogs--;
-	}
+	log_base += log_size;
+	log_size = 0;
 }
 
 /**
- * Subscribe to the backlogs.
+ * Subscribe to the deletion log. Returns a cursor.
  **/
 size_t
 material_backlog_subscribe(void)
 {
 	users_outstanding++;
-	return material_acquire_gen_id();
+	return material_log_end();
 }
 
 /**
- * Unsubscribe from the backlogs.
+ * Unsubscribe from the deletion log.
  **/
 void
 material_backlog_unsubscribe(size_t gen_id)
 {
-	size_t i;
-
-	for (i = 0; i < num_backlogs; i++)
-		if (backlogs[i].gen_id >= gen_id)
-			backlogs[i].users_outstanding--;
-
 	users_outstanding--;
-	material_sweep_backlogs();
+
+	if (gen_id < material_log_end())
+		material_log_user_caught_up();
 }
 
 /**
- * Merge a list of releases into the given.
+ * Get the materials deleted since the given cursor when the log no longer
+ * goes back that far. We can't tell the order they went in, but each ID is
+ * only listed once, which is all the subscribers need.
  **/
 static void
-material_backlog_release_merge(material_t **releases, size_t *num_releases,
-			       material_t *other, size_t num_others)
+material_backlog_resync(size_t gen_id, const material_t **releases,
+			size_t *num_releases)
 {
-	size_t i, j;
+	size_t count = 0;
+	size_t i;
 
-	for (i = 0, j = 0; i < *num_releases && j < num_others;) {
-		if ((*releases)[i] < other[j]) {
-			i++;
-			continue;
-		}
+	free(resync_list);
+	resync_list = NULL;
 
-		if ((*releases)[i] > other[j]) {
-			*releases = vec_add(*releases, *num_releases, i, other[j]);
-			(*num_releases)++;
-		}
+	for (i = 0; i < alloc_watermark; i++) {
+		if (deleted_at[i] == SIZE_T_MAX || deleted_at[i] < gen_id)
+			continue;
 
-		i++;
-		j++;
+		resync_list = vec_expand(resync_list, count);
+		resync_list[count++] = i;
 	}
 
-	if (j == num_others)
-		return;
-
-	*releases = vec_expand(*releases, *num_releases + num_others - j);
-	memcpy(*releases + *num_releases, other + j,
-	       (num_others - j) * sizeof(material_t));
-
-	*num_releases += num_others - j;
+	*releases = resync_list;
+	*num_releases = count;
 }
 
 /**
- * Get a list of releases for this backlog, and a new gen_id.
+ * Get the materials deleted since the given cursor, and a new cursor. The
+ * returned list is only valid until the next call to material_destroy or
+ * material_backlog_sync.
  **/
 size_t
-material_backlog_sync(size_t gen_id, material_t **releases,
+material_backlog_sync(size_t gen_id, const material_t **releases,
 		      size_t *num_releases)
 {
-	size_t i;
+	size_t end = material_log_end();
 
 	*releases = NULL;
 	*num_releases = 0;
 
-	for (i = 0; i < num_backlogs; i++) {
-		if (backlogs[i].gen_id < gen_id)
-			continue;
+	if (gen_id >= end)
+		return end;
 
-		backlogs[i].users_outstanding--;
-		material_backlog_release_merge(releases, num_releases,
-					       backlogs[i].releases,
-					       backlogs[i].num_releases);
+	if (gen_id < log_base) {
+		material_backlog_resync(gen_id, releases, num_releases);
+	} else {
+		*releases = &deletion_log[gen_id - log_base];
+		*num_releases = end - gen_id;
 	}
 
-	i = material_acquire_gen_id();
-	material_sweep_backlogs();
-	return i;
+	material_log_user_caught_up();
+	return end;
 }
 
 /**
@@ -195,12 +194,26 @@ material_t
 material_alloc(void)
 {
 	size_t ret;
+	size_t words;
 
-	if (! num_free_ids)
-		return alloc_watermark++;
+	if (num_free_ids) {
+		ret = free_ids[--num_free_ids];
+		free_ids = vec_contract(free_ids, num_free_ids);
+	} else {
+		ret = alloc_watermark++;
+
+		if (! (ret % 64)) {
+			words = ret / 64 + 1;
+			alloc_bits = xrealloc(alloc_bits,
+					      words * sizeof(uint64_t));
+			alloc_bits[words - 1] = 0;
+		}
+
+		deleted_at = vec_expand(deleted_at, ret);
+		deleted_at[ret] = SIZE_T_MAX;
+	}
 
-	ret = free_ids[--num_free_ids];
-	free_ids = vec_contract(free_ids, num_free_ids);
+	alloc_bits[ret / 64] |= 1ULL << (ret % 64);
 	return ret;
 }
 EXPORT(material_alloc);
@@ -211,19 +224,13 @@ EXPORT(material_alloc);
 int
 material_is_allocd(material_t mat)
 {
-	size_t i;
-
 	if (mat == NO_MATERIAL)
 		return 0;
 
 	if (mat >= alloc_watermark)
 		return 0;
 
-	for (i = 0; i < num_free_ids; i++)
-		if (free_ids[i] == mat)
-			return 0;
-
-	return 1;
+	return !! (alloc_bits[mat / 64] & (1ULL << (mat % 64)));
 }
 EXPORT(material_is_allocd);
 
@@ -233,25 +240,30 @@ EXPORT(material_is_allocd);
 void
 material_destroy(material_t mat)
 {
-	size_t i, j;
-
 	if (mat == NO_MATERIAL)
 		errx(1, "Must pass a material ID to material_destroy");
 
+	if (! material_is_allocd(mat))
+		errx(1, "Tried to destroy a material that isn't allocated");
+
+	alloc_bits[mat / 64] &= ~(1ULL << (mat % 64));
+
 	free_ids = vec_expand(free_ids, num_free_ids);
 	free_ids[num_free_ids++] = mat;
 
-	for (i = 0; i < num_backlogs; i++) {
-		for (j = 0; j < backlogs[i].num_releases &&
-		     backlogs[i].releases[j] < mat; j++);
-
-		if (backlogs[i].releases[j] == mat)
-			continue;
+	if (! users_outstanding)
+		return;
 
-		backlogs[i].releases = vec_add(backlogs[i].releases,
-					       backlogs[i].num_releases,
-					       j, mat);
-		backlogs[i].num_releases++;
+	if (log_size == MATERIAL_LOG_MAX) {
+		memmove(deletion_log, &deletion_log[MATERIAL_LOG_MAX / 2],
+			MATERIAL_LOG_MAX / 2 * sizeof(material_t));
+		log_base += MATERIAL_LOG_MAX / 2;
+		log_size -= MATERIAL_LOG_MAX / 2;
 	}
+
+	deleted_at[mat] = material_log_end();
+	deletion_log = vec_expand(deletion_log, log_size);
+	deletion_log[log_size++] = mat;
+	users_lagging = users_outstanding;
 }
 EXPORT(material_destroy);
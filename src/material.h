@@ -32,7 +32,7 @@ extern "C" {
 
 size_t material_backlog_subscribe(void);
 void material_backlog_unsubscribe(size_t gen_id);
-size_t material_backlog_sync(size_t gen_id, material_t **releases,
+size_t material_backlog_sync(size_t gen_id, const material_t **releases,
 			     size_t *num_releases);
 
 API_DECLARE(material_alloc);
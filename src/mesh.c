@@ -19,10 +19,43 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <err.h>
 
 #include "mesh.h"
+#include "mesh_compress.h"
+#include "mesh_cache.h"
 #include "util.h"
 #include "texmap.h"
+#include "stats.h"
+#include "stream.h"
+
+/**
+ * Size of a mesh's vertex data.
+ **/
+static size_t
+mesh_vert_bytes(mesh_t *mesh)
+{
+	return vbuf_fmt_vert_size(mesh->format) * mesh->verts;
+}
+
+/**
+ * Size of a mesh's element data.
+ **/
+static size_t
+mesh_elem_bytes(mesh_t *mesh)
+{
+	return ebuf_index_size(mesh->elem_type) * mesh->elems;
+}
+
+/**
+ * Where a mesh's element data starts when it's stored after its vertex
+ * data in the mesh cache.
+ **/
+static size_t
+mesh_elem_offset(mesh_t *mesh)
+{
+	return (mesh_vert_bytes(mesh) + 3) & ~(size_t)3;
+}
 
 /**
  * Destroy and free a mesh object.
@@ -31,40 +64,216 @@ static void
 mesh_destructor(void *mesh_)
 {
 	mesh_t *mesh = mesh_;
+	size_t size = mesh_elem_offset(mesh) + mesh_elem_bytes(mesh);
+
 	mesh_remove_from_vbuf(mesh);
 	mesh_remove_from_ebuf(mesh);
 	mesh_remove_from_generation(mesh);
 
+	if (mesh->data_mapped) {
+		mesh_cache_unmap(mesh->vert_data, size);
+	} else if (mesh->vert_data) {
+		mesh_data_bytes -= mesh_vert_bytes(mesh) +
+			mesh_elem_bytes(mesh);
+		free(mesh->vert_data);
+		free(mesh->elem_data);
+	}
+
+	if (mesh->cache_offset != SIZE_T_MAX)
+		mesh_cache_free(mesh->cache_offset, size);
+
+	free(mesh);
+}
+
+/**
+ * Let go of a mesh's copy of its data once it's all on the GPU, if the
+ * residency policy says to. The data goes to the mesh cache first, and if
+ * that fails we hang on to it.
+ **/
+static void
+mesh_release_data(mesh_t *mesh)
+{
+	static const char pad[4];
+	size_t vert_bytes = mesh_vert_bytes(mesh);
+	size_t elem_bytes = mesh_elem_bytes(mesh);
+	size_t elem_offset = mesh_elem_offset(mesh);
+	struct iovec iov[3];
+	ssize_t offset;
+
+	if (mesh_get_residency() != MESH_RELEASE_DATA)
+		return;
+
+	if (mesh->format & VBUF_FMT_DYNAMIC)
+		return;
+
+	if (! mesh->vert_data || ! mesh->vbuf || ! mesh->ebuf)
+		return;
+
+	if (! vert_bytes || ! elem_bytes)
+		return;
+
+	if (mesh->data_mapped) {
+		mesh_cache_unmap(mesh->vert_data, elem_offset + elem_bytes);
+		mesh->data_mapped = 0;
+		mesh->vert_data = NULL;
+		mesh->elem_data = NULL;
+		return;
+	}
+
+	if (mesh->cache_offset == SIZE_T_MAX) {
+		iov[0].iov_base = mesh->vert_data;
+		iov[0].iov_len = vert_bytes;
+		iov[1].iov_base = (void *)pad;
+		iov[1].iov_len = elem_offset - vert_bytes;
+		iov[2].iov_base = mesh->elem_data;
+		iov[2].iov_len = elem_bytes;
+
+		offset = mesh_cache_store(iov, 3);
+
+		if (offset < 0)
+			return;
+
+		mesh->cache_offset = offset;
+	}
+
+	mesh_data_bytes -= vert_bytes + elem_bytes;
 	free(mesh->vert_data);
 	free(mesh->elem_data);
-	free(mesh);
+	mesh->vert_data = NULL;
+	mesh->elem_data = NULL;
+}
+
+/**
+ * Get a mesh's data back after it's been released by mapping it in from the
+ * mesh cache.
+ **/
+static void
+mesh_restore_data(mesh_t *mesh)
+{
+	size_t elem_bytes = mesh_elem_bytes(mesh);
+	char *map;
+
+	if (mesh->vert_data)
+		return;
+
+	map = mesh_cache_map(mesh->cache_offset,
+			     mesh_elem_offset(mesh) + elem_bytes);
+
+	if (! map)
+		err(1, "Could not map mesh data back in from the cache");
+
+	mesh->vert_data = map;
+	mesh->elem_data = map + mesh_elem_offset(mesh);
+	mesh->data_mapped = 1;
+}
+
+/**
+ * Make sure a mesh has a copy of its data of its own, so the data can be
+ * changed. Any copy in the mesh cache is dropped, since it's about to go
+ * out of date.
+ **/
+void
+mesh_hold_data(mesh_t *mesh)
+{
+	size_t vert_bytes = mesh_vert_bytes(mesh);
+	size_t elem_bytes = mesh_elem_bytes(mesh);
+	size_t size = mesh_elem_offset(mesh) + elem_bytes;
+	void *map;
+
+	mesh_restore_data(mesh);
+
+	if (mesh->data_mapped) {
+		map = mesh->vert_data;
+		mesh->vert_data = xmemdup(map, vert_bytes);
+		mesh->elem_data = xmemdup(mesh->elem_data, elem_bytes);
+		mesh->data_mapped = 0;
+		mesh_cache_unmap(map, size);
+		mesh_data_bytes += vert_bytes + elem_bytes;
+	}
+
+	if (mesh->cache_offset != SIZE_T_MAX) {
+		mesh_cache_free(mesh->cache_offset, size);
+		mesh->cache_offset = SIZE_T_MAX;
+	}
+}
+
+/**
+ * Copy a mesh's indices in, narrowing them to 16 bits if there are few
+ * enough vertices that they all fit.
+ **/
+static void
+mesh_set_elem_data(mesh_t *mesh, const void *elem_data, GLenum elem_type)
+{
+	const uint32_t *wide = elem_data;
+	uint16_t *narrow;
+	size_t i;
+
+	if (elem_type != GL_UNSIGNED_INT && elem_type != GL_UNSIGNED_SHORT)
+		errx(1, "Mesh indices must be GL_UNSIGNED_SHORT or "
+		     "GL_UNSIGNED_INT");
+
+	if (elem_type == GL_UNSIGNED_SHORT || mesh->verts > (1 << 16)) {
+		mesh->elem_type = elem_type;
+		mesh->elem_data = xmalloc(ebuf_index_size(elem_type) *
+					  mesh->elems);
+		memcpy(mesh->elem_data, elem_data,
+		       ebuf_index_size(elem_type) * mesh->elems);
+		return;
+	}
+
+	narrow = xmalloc(sizeof(uint16_t) * mesh->elems);
+
+	for (i = 0; i < mesh->elems; i++)
+		narrow[i] = wide[i];
+
+	mesh->elem_type = GL_UNSIGNED_SHORT;
+	mesh->elem_data = (char *)narrow;
 }
 
 /**
  * Create a new mesh object.
+ *
+ * elem_type: GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, the type of elem_data.
+ *            32-bit indices are stored as 16-bit if the mesh has few enough
+ *            vertices.
+ * format: Format of vert_data. If VBUF_FMT_COMPRESSED is set the data is
+ *         quantised and the mesh gets a smaller format of its own. If
+ *         VBUF_FMT_DYNAMIC is set the mesh can be changed with mesh_update.
  **/
 mesh_t *
 mesh_create(size_t verts, const void *vert_data,
-	    size_t elems, const uint16_t *elem_data,
+	    size_t elems, const void *elem_data, GLenum elem_type,
 	    vbuf_fmt_t format, GLenum type)
 {
 	mesh_t *ret = xmalloc(sizeof(mesh_t));
 	size_t data_size = vbuf_fmt_vert_size(format);
+	size_t i;
 
 	data_size *= verts;
 
-	ret->vert_data = xmalloc(data_size);
-	memcpy(ret->vert_data, vert_data, data_size);
 	ret->verts = verts;
+	ret->format = format;
+
+	for (i = 0; i < 4; i++) {
+		ret->position_offset[i] = 0;
+		ret->position_scale[i] = 1;
+	}
+
+	if ((format & VBUF_FMT_COMPRESSED) && (format & VBUF_FMT_DYNAMIC))
+		errx(1, "Dynamic meshes cannot be compressed");
+
+	if (format & VBUF_FMT_COMPRESSED) {
+		mesh_compress(ret, vert_data);
+	} else {
+		ret->vert_data = xmalloc(data_size);
+		memcpy(ret->vert_data, vert_data, data_size);
+	}
 
-	ret->elem_data = xmalloc(2 * elems);
-	memcpy(ret->elem_data, elem_data, 2 * elems);
 	ret->elems = elems;
+	mesh_set_elem_data(ret, elem_data, elem_type);
 
 	ret->generation = NULL;
 
-	ret->format = format;
-
 	ret->type = type;
 
 	ret->vbuf = NULL;
@@ -73,6 +282,12 @@ mesh_create(size_t verts, const void *vert_data,
 	ret->ebuf = NULL;
 	ret->ebuf_pos = 0;
 
+	ret->num_dirty = 0;
+
+	ret->cache_offset = SIZE_T_MAX;
+	ret->data_mapped = 0;
+	mesh_data_bytes += mesh_vert_bytes(ret) + mesh_elem_bytes(ret);
+
 	refcount_init(&ret->refcount);
 	refcount_add_destructor(&ret->refcount, mesh_destructor, ret);
 
@@ -105,28 +320,113 @@ mesh_ungrab(mesh_t *mesh)
 int
 mesh_add_to_ebuf(mesh_t *mesh, ebuf_t *buffer)
 {
-	ssize_t offset = ebuf_locate_free_space(buffer, mesh->elems);
+	ssize_t offset;
+
+	if (buffer->type != mesh->elem_type)
+		errx(1, "Cannot load mesh in to element buffer of wrong type");
+
+	offset = ebuf_alloc_region(buffer, mesh->elems);
 
 	if (offset < 0)
 		return -1;
 
 	mesh_remove_from_ebuf(mesh);
-
-	ebuf_alloc_region(buffer, offset, mesh->elems);
+	mesh_restore_data(mesh);
 
 	ebuf_activate(buffer);
 
-	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, offset * sizeof(uint16_t),
-			mesh->elems * sizeof(uint16_t), mesh->elem_data);
+	stream_buffer_sub_data(GL_ELEMENT_ARRAY_BUFFER,
+			       offset * buffer->index_size,
+			       mesh->elems * buffer->index_size,
+			       mesh->elem_data);
+	stats_count_buffer_bytes(mesh->elems * buffer->index_size);
 
 	mesh->ebuf = buffer;
 	mesh->ebuf_pos = offset;
 	ebuf_grab(buffer);
+	mesh_release_data(mesh);
 
 	CHECK_GL;
 	return 0;
 }
 
+/**
+ * Upload some of a mesh's vertices to a buffer that stores each segment
+ * whole.
+ *
+ * first, count: Range of the mesh's vertices to upload.
+ **/
+static void
+mesh_upload_planar(mesh_t *mesh, vbuf_t *buffer, size_t first, size_t count)
+{
+	vbuf_fmt_t iter = buffer->format;
+	size_t offset = mesh->vbuf_pos + first;
+	size_t base = 0;
+	size_t local_base = 0;
+	size_t size;
+
+	while (vbuf_fmt_pop_segment(&iter, NULL, NULL, NULL, &size)) {
+		stream_buffer_sub_data(GL_ARRAY_BUFFER,
+				       base + offset * size,
+				       count * size,
+				       mesh->vert_data + local_base +
+				       first * size);
+		stats_count_buffer_bytes(count * size);
+
+		base += size * buffer->vert_count;
+		local_base += size * mesh->verts;
+	}
+}
+
+/**
+ * Upload some of a mesh's vertices to an interleaved buffer. Meshes keep
+ * their data with each segment whole, so we shuffle it in to place first.
+ *
+ * first, count: Range of the mesh's vertices to upload.
+ **/
+static void
+mesh_upload_interleaved(mesh_t *mesh, vbuf_t *buffer, size_t first,
+			size_t count)
+{
+	char *data = xcalloc(count, buffer->vert_size);
+	const char *src = mesh->vert_data;
+	vbuf_fmt_t iter = buffer->format;
+	size_t position = 0;
+	size_t size;
+	size_t i;
+
+	while (vbuf_fmt_pop_segment(&iter, NULL, NULL, NULL, &size)) {
+		for (i = 0; i < count; i++)
+			memcpy(data + i * buffer->vert_size + position,
+			       src + (first + i) * size, size);
+
+		src += size * mesh->verts;
+		position += vbuf_fmt_pad(size);
+	}
+
+	stream_buffer_sub_data(GL_ARRAY_BUFFER,
+			       (mesh->vbuf_pos + first) * buffer->vert_size,
+			       count * buffer->vert_size, data);
+	stats_count_buffer_bytes(count * buffer->vert_size);
+	free(data);
+}
+
+/**
+ * Upload some of a mesh's vertices to the buffer it's in.
+ *
+ * first, count: Range of the mesh's vertices to upload.
+ **/
+static void
+mesh_upload(mesh_t *mesh, size_t first, size_t count)
+{
+	vbuf_activate(mesh->vbuf);
+
+	if (mesh->vbuf->format & VBUF_FMT_INTERLEAVED)
+		mesh_upload_interleaved(mesh, mesh->vbuf, first, count);
+	else
+		mesh_upload_planar(mesh, mesh->vbuf, first, count);
+}
+
 /**
  * Attach a mesh to a vertex buffer.
  *
@@ -135,42 +435,28 @@ mesh_add_to_ebuf(mesh_t *mesh, ebuf_t *buffer)
 int
 mesh_add_to_vbuf(mesh_t *mesh, vbuf_t *buffer)
 {
-	ssize_t offset = vbuf_locate_free_space(buffer, mesh->verts);
-	size_t base = 0;
-	size_t local_base = 0;
-	size_t size;
-	vbuf_fmt_t iter;
+	ssize_t offset = vbuf_alloc_region(buffer, mesh->verts);
 
 	if (offset < 0)
 		return -1;
 
 	mesh_remove_from_vbuf(mesh);
 
-	vbuf_alloc_region(buffer, offset, mesh->verts);
-
 	mesh->vbuf = buffer;
 	mesh->vbuf_pos = offset;
 
-	vbuf_activate(buffer);
-
 	/* FIXME: We could use a buffer with a superset of features with some
 	 * slightly more powerful tools.
 	 */
 	if (buffer->format != mesh->format)
 		errx(1, "Cannot load mesh in to incompatible buffer");
 
-	iter = buffer->format;
-	while (vbuf_fmt_pop_segment(&iter, NULL, NULL, NULL, &size)) {
-		glBufferSubData(GL_ARRAY_BUFFER,
-				base + offset * size,
-				mesh->verts * size,
-				mesh->vert_data + local_base);
-
-		base += size * buffer->vert_count;
-		local_base += size * mesh->verts;
-	}
+	mesh_restore_data(mesh);
+	mesh_upload(mesh, 0, mesh->verts);
+	mesh->num_dirty = 0;
 
 	vbuf_grab(buffer);
+	mesh_release_data(mesh);
 
 	CHECK_GL;
 	return 0;
@@ -204,6 +490,163 @@ mesh_remove_from_vbuf(mesh_t *mesh)
 	mesh->vbuf = NULL;
 }
 
+/**
+ * Move a mesh's vertices nearer the start of its vertex buffer, if there's
+ * room.
+ *
+ * Returns: 0 if the mesh moved, -1 otherwise.
+ **/
+int
+mesh_move_down_in_vbuf(mesh_t *mesh)
+{
+	ssize_t offset;
+
+	if (! mesh->vbuf)
+		return -1;
+
+	offset = vbuf_move_region_down(mesh->vbuf, mesh->vbuf_pos,
+				       mesh->verts);
+
+	if (offset < 0)
+		return -1;
+
+	mesh->vbuf_pos = offset;
+	return 0;
+}
+
+/**
+ * Move a mesh's indices nearer the start of its element buffer, if there's
+ * room.
+ *
+ * Returns: 0 if the mesh moved, -1 otherwise.
+ **/
+int
+mesh_move_down_in_ebuf(mesh_t *mesh)
+{
+	ssize_t offset;
+
+	if (! mesh->ebuf)
+		return -1;
+
+	offset = ebuf_move_region_down(mesh->ebuf, mesh->ebuf_pos,
+				       mesh->elems);
+
+	if (offset < 0)
+		return -1;
+
+	mesh->ebuf_pos = offset;
+	return 0;
+}
+
+/**
+ * Note that a range of a dynamic mesh's vertices has changed. Ranges that
+ * overlap or nearly touch are merged, and if we run out of room the new
+ * range takes in the nearest old one.
+ **/
+static void
+mesh_mark_dirty(mesh_t *mesh, size_t start, size_t end)
+{
+	struct mesh_range *range;
+	size_t nearest = 0;
+	size_t best = SIZE_T_MAX;
+	size_t gap;
+	size_t i;
+
+	for (i = 0; i < mesh->num_dirty;) {
+		range = &mesh->dirty[i];
+
+		if (range->start > end + MESH_DIRTY_GAP ||
+		    start > range->end + MESH_DIRTY_GAP) {
+			i++;
+			continue;
+		}
+
+		if (range->start < start)
+			start = range->start;
+
+		if (range->end > end)
+			end = range->end;
+
+		*range = mesh->dirty[--mesh->num_dirty];
+	}
+
+	if (mesh->num_dirty == MESH_DIRTY_RANGES) {
+		for (i = 0; i < mesh->num_dirty; i++) {
+			range = &mesh->dirty[i];
+			gap = range->start > end ? range->start - end :
+				start - range->end;
+
+			if (gap < best) {
+				best = gap;
+				nearest = i;
+			}
+		}
+
+		range = &mesh->dirty[nearest];
+
+		if (range->start < start)
+			start = range->start;
+
+		if (range->end > end)
+			end = range->end;
+
+		*range = mesh->dirty[--mesh->num_dirty];
+	}
+
+	range = &mesh->dirty[mesh->num_dirty++];
+	range->start = start;
+	range->end = end;
+}
+
+/**
+ * Change some of a dynamic mesh's vertices. The new data goes to the GPU
+ * the next time the mesh is drawn, and only the changed ranges are sent.
+ *
+ * first_vert: First vertex to change.
+ * count: Number of vertices to change.
+ * data: The new vertices, laid out as for mesh_create.
+ **/
+void
+mesh_update(mesh_t *mesh, size_t first_vert, size_t count, const void *data)
+{
+	vbuf_fmt_t iter = mesh->format;
+	const char *src = data;
+	char *dest = mesh->vert_data;
+	size_t size;
+
+	if (! (mesh->format & VBUF_FMT_DYNAMIC))
+		errx(1, "Cannot update a mesh that wasn't created dynamic");
+
+	if (first_vert > mesh->verts || count > mesh->verts - first_vert)
+		errx(1, "Mesh update runs past the last vertex");
+
+	if (! count)
+		return;
+
+	while (vbuf_fmt_pop_segment(&iter, NULL, NULL, NULL, &size)) {
+		memcpy(dest + first_vert * size, src, count * size);
+		src += count * size;
+		dest += mesh->verts * size;
+	}
+
+	mesh_mark_dirty(mesh, first_vert, first_vert + count);
+}
+
+/**
+ * Send a dynamic mesh's changed vertices to its buffer.
+ **/
+static void
+mesh_flush_updates(mesh_t *mesh)
+{
+	size_t i;
+
+	for (i = 0; i < mesh->num_dirty; i++)
+		mesh_upload(mesh, mesh->dirty[i].start,
+			    mesh->dirty[i].end - mesh->dirty[i].start);
+
+	mesh->num_dirty = 0;
+}
+
 /**
  * Draw a mesh.
  *
@@ -219,13 +662,17 @@ mesh_draw(mesh_t *mesh)
 	if (! mesh->ebuf)
 		return 0;
 
+	mesh_flush_updates(mesh);
+
 	vbuf_activate(mesh->vbuf);
 	ebuf_activate(mesh->ebuf);
 
 	texmap_end_unit_generation();
-	glDrawElementsBaseVertex(mesh->type, mesh->elems, GL_UNSIGNED_SHORT,
-				 (void *)(mesh->ebuf_pos * sizeof(uint16_t)),
+	glDrawElementsBaseVertex(mesh->type, mesh->elems, mesh->elem_type,
+				 (void *)(mesh->ebuf_pos *
+					  mesh->ebuf->index_size),
 				 mesh->vbuf_pos);
+	stats_count_draw();
 
 	return 1;
 }
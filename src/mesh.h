@@ -35,20 +35,47 @@ typedef struct generation {
 	size_t num_meshes;
 } mesh_generation_t;
 
+/* Most separate ranges of changed vertices a dynamic mesh keeps track of. */
+#ifndef MESH_DIRTY_RANGES
+#define MESH_DIRTY_RANGES 8
+#endif
+
+/* Changed ranges closer than this many vertices are uploaded as one. */
+#ifndef MESH_DIRTY_GAP
+#define MESH_DIRTY_GAP 16
+#endif
+
+/**
+ * A range of vertices, from start up to but not including end.
+ **/
+struct mesh_range {
+	size_t start;
+	size_t end;
+};
+
 /**
  * A collection of vertex data ready to be passed to a draw call.
  *
- * vert_data: Copy of the vertex data we will pass in to the shader.
+ * vert_data: Copy of the vertex data we will pass in to the shader, or NULL
+ *            if it's been released.
  * verts: Number of vertices.
  * type: Type of GL primitives this vertex data represents.
  * elem_data: Element buffer for this vertex data.
+ * elem_type: GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, the type of elem_data.
  * elems: Number of elements in this vertex data.
  * format: Format of the vertex data.
+ * position_offset, position_scale: How to turn compressed positions back in
+ *                                  to model space, in vec4 form.
  * generation: Generation this mesh is part of.
  * vbuf: Vertex buffer we are currently copied in to.
  * vbuf_pos: Where in the vertex buffer we've been loaded.
  * ebuf: ELement buffer we are currently copied in to.
  * ebuf_pos: Where in the element buffer we've been loaded.
+ * dirty, num_dirty: Ranges of vertices changed by mesh_update since they
+ *                   were last uploaded. They never overlap.
+ * cache_offset: Where the data is in the mesh cache, or SIZE_T_MAX.
+ * data_mapped: Set if vert_data and elem_data are mapped in from the mesh
+ *              cache rather than allocated.
  * refcount: Refcount for tracking and freeing this object.
  **/
 typedef struct mesh {
@@ -57,11 +84,14 @@ typedef struct mesh {
 	GLenum type;
 
 	char *elem_data;
+	GLenum elem_type;
 	size_t elems;
 
 	mesh_generation_t *generation;
 
 	vbuf_fmt_t format;
+	float position_offset[4];
+	float position_scale[4];
 
 	vbuf_t *vbuf;
 	size_t vbuf_pos;
@@ -69,6 +99,12 @@ typedef struct mesh {
 	ebuf_t *ebuf;
 	size_t ebuf_pos;
 
+	struct mesh_range dirty[MESH_DIRTY_RANGES];
+	size_t num_dirty;
+
+	size_t cache_offset;
+	int data_mapped;
+
 	refcounter_t refcount;
 } mesh_t;
 
@@ -77,12 +113,18 @@ extern "C" {
 #endif
 
 mesh_t *mesh_create(size_t verts, const void *vert_data, size_t elems,
-		    const uint16_t *elem_data, vbuf_fmt_t format, GLenum type);
+		    const void *elem_data, GLenum elem_type, vbuf_fmt_t format,
+		    GLenum type);
 size_t mesh_data_size(mesh_t *mesh);
+void mesh_update(mesh_t *mesh, size_t first_vert, size_t count,
+		 const void *data);
+void mesh_hold_data(mesh_t *mesh);
 int mesh_add_to_vbuf(mesh_t *mesh, vbuf_t *buffer);
 int mesh_add_to_ebuf(mesh_t *mesh, ebuf_t *buffer);
 void mesh_remove_from_vbuf(mesh_t *mesh);
 void mesh_remove_from_ebuf(mesh_t *mesh);
+int mesh_move_down_in_vbuf(mesh_t *mesh);
+int mesh_move_down_in_ebuf(mesh_t *mesh);
 int mesh_draw(mesh_t *mesh);
 void mesh_grab(mesh_t *mesh);
 void mesh_ungrab(mesh_t *mesh);
@@ -0,0 +1,231 @@
+/**
+ * Copyright © 2013 Casey Dahlin
+ *
+ * This file is part of Luftballons.
+ *
+ * Luftballons is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Luftballons is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "mesh_cache.h"
+#include "interval.h"
+
+/* Pages the cache file has room for before it first grows. */
+#ifndef MESH_CACHE_INITIAL_PAGES
+#define MESH_CACHE_INITIAL_PAGES 256
+#endif
+
+/**
+ * What we do with mesh data once it's uploaded.
+ **/
+static mesh_residency_t mesh_residency = MESH_KEEP_DATA;
+
+/**
+ * Directory to put the cache file in, or NULL for $TMPDIR or /tmp.
+ **/
+static char *mesh_cache_dir = NULL;
+
+/**
+ * The cache file. It's unlinked as soon as it's made, so it goes away with
+ * us. Space in it is handed out a page at a time so data can be mapped
+ * straight back in.
+ *
+ * fd: The open file, or -1 if it isn't open yet.
+ * page: Page size.
+ * space: Which pages are in use.
+ **/
+static struct {
+	int fd;
+	size_t page;
+	intervals_t space;
+} mesh_cache = { .fd = -1 };
+
+size_t mesh_data_bytes = 0;
+
+/**
+ * Set what happens to a mesh's data once it's uploaded. Applies to meshes
+ * uploaded from now on.
+ **/
+void
+mesh_set_residency(mesh_residency_t residency)
+{
+	mesh_residency = residency;
+}
+EXPORT(mesh_set_residency);
+
+/**
+ * Get what happens to a mesh's data once it's uploaded.
+ **/
+mesh_residency_t
+mesh_get_residency(void)
+{
+	return mesh_residency;
+}
+
+/**
+ * Set the directory the mesh cache file goes in. Pass NULL for $TMPDIR, or
+ * /tmp if that isn't set. Only takes effect if the file hasn't been made
+ * yet.
+ **/
+void
+mesh_cache_set_dir(const char *dir)
+{
+	free(mesh_cache_dir);
+	mesh_cache_dir = dir ? xstrdup(dir) : NULL;
+}
+EXPORT(mesh_cache_set_dir);
+
+/**
+ * Get how many bytes of mesh data we're holding in memory.
+ **/
+size_t
+mesh_get_data_bytes(void)
+{
+	return mesh_data_bytes;
+}
+EXPORT(mesh_get_data_bytes);
+
+/**
+ * Make the cache file if we haven't yet.
+ *
+ * Returns: 0 on success, -1 if the file couldn't be made.
+ **/
+static int
+mesh_cache_open(void)
+{
+	const char *dir = mesh_cache_dir;
+	size_t len;
+	char *path;
+
+	if (mesh_cache.fd >= 0)
+		return 0;
+
+	if (! dir)
+		dir = getenv("TMPDIR");
+
+	if (! dir)
+		dir = "/tmp";
+
+	len = strlen(dir) + sizeof("/luftballons-meshes-XXXXXX");
+	path = xmalloc(len);
+	snprintf(path, len, "%s/luftballons-meshes-XXXXXX", dir);
+	mesh_cache.fd = mkstemp(path);
+
+	if (mesh_cache.fd >= 0)
+		unlink(path);
+
+	free(path);
+
+	if (mesh_cache.fd < 0)
+		return -1;
+
+	mesh_cache.page = sysconf(_SC_PAGESIZE);
+	intervals_init(&mesh_cache.space, MESH_CACHE_INITIAL_PAGES);
+	return 0;
+}
+
+/**
+ * Number of pages a piece of data takes up in the cache file.
+ **/
+static size_t
+mesh_cache_pages(size_t size)
+{
+	return (size + mesh_cache.page - 1) / mesh_cache.page;
+}
+
+/**
+ * Write some data to the cache file.
+ *
+ * iov, count: The data, which is written in one piece.
+ *
+ * Returns: Where the data went, which is page aligned, or -1 on failure.
+ **/
+ssize_t
+mesh_cache_store(const struct iovec *iov, int count)
+{
+	size_t size = 0;
+	size_t pages;
+	ssize_t start;
+	int i;
+
+	for (i = 0; i < count; i++)
+		size += iov[i].iov_len;
+
+	if (! size || mesh_cache_open())
+		return -1;
+
+	pages = mesh_cache_pages(size);
+	start = interval_alloc(&mesh_cache.space, pages);
+
+	if (start < 0) {
+		intervals_grow(&mesh_cache.space,
+			       mesh_cache.space.size * 2 + pages);
+		start = interval_alloc(&mesh_cache.space, pages);
+	}
+
+	if (pwritev(mesh_cache.fd, iov, count,
+		    start * mesh_cache.page) != (ssize_t)size) {
+		interval_free(&mesh_cache.space, start, pages);
+		return -1;
+	}
+
+	return start * mesh_cache.page;
+}
+
+/**
+ * Map data from the cache file back in, read only.
+ *
+ * Returns: The data, or NULL on failure.
+ **/
+void *
+mesh_cache_map(size_t offset, size_t size)
+{
+	void *ret;
+
+	if (mesh_cache.fd < 0)
+		return NULL;
+
+	ret = mmap(NULL, size, PROT_READ, MAP_PRIVATE, mesh_cache.fd, offset);
+
+	if (ret == MAP_FAILED)
+		return NULL;
+
+	return ret;
+}
+
+/**
+ * Unmap data mapped with mesh_cache_map.
+ **/
+void
+mesh_cache_unmap(void *data, size_t size)
+{
+	munmap(data, size);
+}
+
+/**
+ * Give back space in the cache file.
+ *
+ * offset, size: Where the data was stored and how big it was.
+ **/
+void
+mesh_cache_free(size_t offset, size_t size)
+{
+	interval_free(&mesh_cache.space, offset / mesh_cache.page,
+		      mesh_cache_pages(size));
+}
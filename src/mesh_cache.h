@@ -0,0 +1,57 @@
+/**
+ * Copyright © 2013 Casey Dahlin
+ *
+ * This file is part of Luftballons.
+ *
+ * Luftballons is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Luftballons is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+#include <luftballons/mesh_cache.h>
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "util.h"
+
+typedef luft_mesh_residency_t mesh_residency_t;
+#define MESH_KEEP_DATA LUFT_MESH_KEEP_DATA
+#define MESH_RELEASE_DATA LUFT_MESH_RELEASE_DATA
+
+/**
+ * Bytes of mesh data held in memory we allocated, not counting data mapped
+ * in from the cache.
+ **/
+extern size_t mesh_data_bytes;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+API_DECLARE(mesh_set_residency);
+API_DECLARE(mesh_cache_set_dir);
+API_DECLARE(mesh_get_data_bytes);
+
+mesh_residency_t mesh_get_residency(void);
+ssize_t mesh_cache_store(const struct iovec *iov, int count);
+void *mesh_cache_map(size_t offset, size_t size);
+void mesh_cache_unmap(void *data, size_t size);
+void mesh_cache_free(size_t offset, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MESH_CACHE_H */
@@ -0,0 +1,383 @@
+/**
+ * Copyright © 2013 Casey Dahlin
+ *
+ * This file is part of Luftballons.
+ *
+ * Luftballons is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Luftballons is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "mesh_compress.h"
+#include "util.h"
+
+/**
+ * Ways we can store a segment.
+ **/
+enum mesh_compress_kind {
+	MESH_COMPRESS_COPY,
+	MESH_COMPRESS_SNORM16_BOX,
+	MESH_COMPRESS_1010102,
+	MESH_COMPRESS_UNORM16,
+	MESH_COMPRESS_UNORM8,
+	MESH_COMPRESS_HALF,
+};
+
+/**
+ * A segment of the mesh as given to us and how we're going to store it.
+ *
+ * name, elems, type, size: The segment as given.
+ * data: The given data for this segment.
+ * kind: How we'll store it.
+ **/
+struct mesh_compress_seg {
+	const char *name;
+	size_t elems;
+	GLenum type;
+	size_t size;
+	const char *data;
+	enum mesh_compress_kind kind;
+};
+
+/**
+ * Read one element of a floating point segment as given.
+ **/
+static double
+mesh_compress_get(const struct mesh_compress_seg *seg, size_t idx)
+{
+	if (seg->type == GL_DOUBLE)
+		return ((const double *)seg->data)[idx];
+
+	return ((const float *)seg->data)[idx];
+}
+
+/**
+ * Check whether every element of a segment is within a range.
+ **/
+static int
+mesh_compress_in_range(const struct mesh_compress_seg *seg, size_t verts,
+		       double min, double max)
+{
+	double v;
+	size_t i;
+
+	for (i = 0; i < verts * seg->elems; i++) {
+		v = mesh_compress_get(seg, i);
+
+		if (v < min || v > max)
+			return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Decide how to store a segment. We only touch floating point data with the
+ * names the stock shaders use, since we know what range they're in.
+ **/
+static void
+mesh_compress_choose(struct mesh_compress_seg *seg, size_t verts)
+{
+	size_t i;
+
+	seg->kind = MESH_COMPRESS_COPY;
+
+	if (seg->type != GL_FLOAT && seg->type != GL_DOUBLE)
+		return;
+
+	if (! strcmp(seg->name, "position")) {
+		if (seg->elems != 3 && seg->elems != 4)
+			return;
+
+		/* Only the box-relative part of the position is stored. */
+		for (i = 0; seg->elems == 4 && i < verts; i++)
+			if (mesh_compress_get(seg, 4 * i + 3) != 1)
+				return;
+
+		seg->kind = MESH_COMPRESS_SNORM16_BOX;
+	} else if (! strcmp(seg->name, "normal")) {
+		if (seg->elems == 3)
+			seg->kind = MESH_COMPRESS_1010102;
+	} else if (! strcmp(seg->name, "texcoord")) {
+		if (mesh_compress_in_range(seg, verts, 0, 1))
+			seg->kind = MESH_COMPRESS_UNORM16;
+		else
+			seg->kind = MESH_COMPRESS_HALF;
+	} else if (! strcmp(seg->name, "color")) {
+		if (mesh_compress_in_range(seg, verts, 0, 1))
+			seg->kind = MESH_COMPRESS_UNORM8;
+	}
+}
+
+/**
+ * Add the stored version of a segment to a format.
+ **/
+static void
+mesh_compress_add_to_fmt(struct mesh_compress_seg *seg, vbuf_fmt_t *fmt)
+{
+	switch (seg->kind) {
+	case MESH_COMPRESS_SNORM16_BOX:
+		vbuf_fmt_add_normalized(fmt, seg->name, 4, GL_SHORT);
+		break;
+	case MESH_COMPRESS_1010102:
+		vbuf_fmt_add_normalized(fmt, seg->name, 4,
+					GL_INT_2_10_10_10_REV);
+		break;
+	case MESH_COMPRESS_UNORM16:
+		vbuf_fmt_add_normalized(fmt, seg->name, seg->elems,
+					GL_UNSIGNED_SHORT);
+		break;
+	case MESH_COMPRESS_UNORM8:
+		vbuf_fmt_add_normalized(fmt, seg->name, seg->elems,
+					GL_UNSIGNED_BYTE);
+		break;
+	case MESH_COMPRESS_HALF:
+		vbuf_fmt_add(fmt, seg->name, seg->elems, GL_HALF_FLOAT);
+		break;
+	default:
+		vbuf_fmt_add(fmt, seg->name, seg->elems, seg->type);
+	}
+}
+
+/**
+ * Convert a float to a half float, rounding to nearest even.
+ **/
+static uint16_t
+mesh_compress_half(float value)
+{
+	union { float f; uint32_t u; } in = { value };
+	uint32_t sign = (in.u >> 16) & 0x8000;
+	uint32_t mag = in.u & 0x7fffffff;
+	uint32_t mant;
+	int exp;
+
+	/* NaN stays NaN, anything too big becomes infinity. */
+	if (mag > 0x7f800000)
+		return sign | 0x7e00;
+
+	if (mag >= 0x477ff000)
+		return sign | 0x7c00;
+
+	exp = (int)(mag >> 23) - 127 + 15;
+
+	/* Too small for a normal half: shift in to a denormal. */
+	if (exp <= 0) {
+		if (exp < -10)
+			return sign;
+
+		mant = (mag & 0x7fffff) | 0x800000;
+		mant = (mant + (1 << (13 - exp)) - 1 +
+			((mant >> (14 - exp)) & 1)) >> (14 - exp);
+		return sign | mant;
+	}
+
+	mant = mag + 0xfff + ((mag >> 13) & 1);
+	return sign | ((mant - ((uint32_t)(127 - 15) << 23)) >> 13);
+}
+
+/**
+ * Quantise a value in [-1, 1] to signed fixed point with the given maximum.
+ **/
+static int32_t
+mesh_compress_snorm(double value, int32_t max)
+{
+	if (value > 1)
+		value = 1;
+
+	if (value < -1)
+		value = -1;
+
+	return (int32_t)lround(value * max);
+}
+
+/**
+ * Quantise a value in [0, 1] to unsigned fixed point with the given maximum.
+ **/
+static uint32_t
+mesh_compress_unorm(double value, uint32_t max)
+{
+	return (uint32_t)lround(value * max);
+}
+
+/**
+ * Store positions as signed 16-bit fixed point within the mesh's bounding
+ * box. The box goes in to the mesh so the shader can undo this.
+ **/
+static void
+mesh_compress_positions(mesh_t *mesh, const struct mesh_compress_seg *seg,
+			int16_t *out)
+{
+	double min[3], max[3];
+	double v;
+	size_t i, k;
+
+	for (k = 0; k < 3; k++) {
+		min[k] = mesh->verts ? mesh_compress_get(seg, k) : 0;
+		max[k] = min[k];
+	}
+
+	for (i = 0; i < mesh->verts; i++) {
+		for (k = 0; k < 3; k++) {
+			v = mesh_compress_get(seg, i * seg->elems + k);
+
+			if (v < min[k])
+				min[k] = v;
+
+			if (v > max[k])
+				max[k] = v;
+		}
+	}
+
+	for (k = 0; k < 3; k++) {
+		mesh->position_offset[k] = (min[k] + max[k]) / 2;
+		mesh->position_scale[k] = (max[k] - min[k]) / 2;
+
+		if (mesh->position_scale[k] <= 0)
+			mesh->position_scale[k] = 1;
+	}
+
+	for (i = 0; i < mesh->verts; i++) {
+		for (k = 0; k < 3; k++) {
+			v = mesh_compress_get(seg, i * seg->elems + k);
+			v = (v - mesh->position_offset[k]) /
+				mesh->position_scale[k];
+			out[4 * i + k] = mesh_compress_snorm(v, 32767);
+		}
+
+		out[4 * i + 3] = 32767;
+	}
+}
+
+/**
+ * Store normals as signed 10-bit fixed point, packed three to a word.
+ **/
+static void
+mesh_compress_normals(mesh_t *mesh, const struct mesh_compress_seg *seg,
+		      uint32_t *out)
+{
+	double n[3];
+	double len;
+	size_t i, k;
+
+	for (i = 0; i < mesh->verts; i++) {
+		for (k = 0; k < 3; k++)
+			n[k] = mesh_compress_get(seg, 3 * i + k);
+
+		len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		out[i] = 0;
+
+		for (k = 0; k < 3; k++) {
+			if (len > 0)
+				n[k] /= len;
+
+			out[i] |= ((uint32_t)mesh_compress_snorm(n[k], 511) &
+				   0x3ff) << (10 * k);
+		}
+	}
+}
+
+/**
+ * Write the stored version of a segment.
+ **/
+static void
+mesh_compress_convert(mesh_t *mesh, const struct mesh_compress_seg *seg,
+		      char *out)
+{
+	size_t count = mesh->verts * seg->elems;
+	size_t i;
+
+	switch (seg->kind) {
+	case MESH_COMPRESS_SNORM16_BOX:
+		mesh_compress_positions(mesh, seg, (int16_t *)out);
+		break;
+	case MESH_COMPRESS_1010102:
+		mesh_compress_normals(mesh, seg, (uint32_t *)out);
+		break;
+	case MESH_COMPRESS_UNORM16:
+		for (i = 0; i < count; i++)
+			((uint16_t *)out)[i] =
+				mesh_compress_unorm(mesh_compress_get(seg, i),
+						    65535);
+		break;
+	case MESH_COMPRESS_UNORM8:
+		for (i = 0; i < count; i++)
+			((uint8_t *)out)[i] =
+				mesh_compress_unorm(mesh_compress_get(seg, i),
+						    255);
+		break;
+	case MESH_COMPRESS_HALF:
+		for (i = 0; i < count; i++)
+			((uint16_t *)out)[i] =
+				mesh_compress_half(mesh_compress_get(seg, i));
+		break;
+	default:
+		memcpy(out, seg->data, seg->size * mesh->verts);
+	}
+}
+
+/**
+ * Quantise a mesh's vertex data as it's created: positions to 16-bit fixed
+ * point within the mesh's bounding box, normals to 10-10-10-2, texture
+ * coordinates to 16-bit fixed point (or half floats if they leave [0, 1])
+ * and colors to 8-bit fixed point. Other segments are copied as they are.
+ * The mesh's format is replaced with the format of the stored data.
+ *
+ * vert_data: Vertex data in the mesh's current format.
+ **/
+void
+mesh_compress(mesh_t *mesh, const void *vert_data)
+{
+	vbuf_fmt_t iter = mesh->format;
+	vbuf_fmt_t format = mesh->format & VBUF_FMT_FLAGS;
+	struct mesh_compress_seg *segs = NULL;
+	struct mesh_compress_seg *seg;
+	const char *data = vert_data;
+	size_t num_segs = 0;
+	const char *name;
+	char *out;
+	size_t size;
+	size_t i;
+
+	while (1) {
+		segs = vec_expand(segs, num_segs);
+		seg = &segs[num_segs];
+
+		if (! vbuf_fmt_pop_segment(&iter, &seg->elems, &seg->type,
+					   &seg->name, &seg->size))
+			break;
+
+		seg->data = data;
+		data += seg->size * mesh->verts;
+		mesh_compress_choose(seg, mesh->verts);
+		mesh_compress_add_to_fmt(seg, &format);
+		num_segs++;
+	}
+
+	mesh->format = format;
+	mesh->vert_data = xmalloc(vbuf_fmt_vert_size(format) * mesh->verts);
+	out = mesh->vert_data;
+
+	/* The new segments can come out in a different order. */
+	while (vbuf_fmt_pop_segment(&format, NULL, NULL, &name, &size)) {
+		for (i = 0; strcmp(segs[i].name, name); i++);
+
+		mesh_compress_convert(mesh, &segs[i], out);
+		out += size * mesh->verts;
+	}
+
+	free(segs);
+}
@@ -0,0 +1,509 @@
+/**
+ * Copyright © 2013 Casey Dahlin
+ *
+ * This file is part of Luftballons.
+ *
+ * Luftballons is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Luftballons is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mesh_optimize.h"
+#include "util.h"
+
+/**
+ * The triangles using each vertex, all in one array.
+ *
+ * offsets: Where each vertex's triangles start in tris, with one more entry
+ *          at the end marking where the last vertex's stop.
+ * tris: Triangle numbers.
+ **/
+struct mesh_adjacency {
+	size_t *offsets;
+	uint32_t *tris;
+};
+
+/**
+ * A run of triangles to be kept together when ordering for overdraw.
+ *
+ * start, count: Which triangles are in the cluster, in Tipsify's order.
+ * score: How far the cluster faces out from the middle of the mesh.
+ **/
+struct mesh_cluster {
+	size_t start;
+	size_t count;
+	float score;
+};
+
+/**
+ * Build the triangle adjacency for a mesh.
+ **/
+static void
+mesh_adjacency_build(struct mesh_adjacency *adj, const uint32_t *elems,
+		     size_t count, size_t verts)
+{
+	size_t *fill = xcalloc(verts + 1, sizeof(size_t));
+	size_t i;
+
+	adj->offsets = xcalloc(verts + 1, sizeof(size_t));
+	adj->tris = xcalloc(count + 1, sizeof(uint32_t));
+
+	for (i = 0; i < count; i++)
+		adj->offsets[elems[i] + 1]++;
+
+	for (i = 0; i < verts; i++)
+		adj->offsets[i + 1] += adj->offsets[i];
+
+	memcpy(fill, adj->offsets, (verts + 1) * sizeof(size_t));
+
+	for (i = 0; i < count; i++)
+		adj->tris[fill[elems[i]]++] = i / 3;
+
+	free(fill);
+}
+
+/**
+ * Free the triangle adjacency for a mesh.
+ **/
+static void
+mesh_adjacency_release(struct mesh_adjacency *adj)
+{
+	free(adj->offsets);
+	free(adj->tris);
+}
+
+/**
+ * Count how many vertices a FIFO post-transform cache of
+ * MESH_OPTIMIZE_CACHE_SIZE entries would miss drawing the given triangles.
+ **/
+size_t
+mesh_optimize_cache_misses(const uint32_t *elems, size_t count, size_t verts)
+{
+	size_t *stamp = xcalloc(verts, sizeof(size_t));
+	size_t time = 0;
+	size_t misses = 0;
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		if (stamp[elems[i]] &&
+		    time - stamp[elems[i]] < MESH_OPTIMIZE_CACHE_SIZE)
+			continue;
+
+		stamp[elems[i]] = ++time;
+		misses++;
+	}
+
+	free(stamp);
+	return misses;
+}
+
+/**
+ * Reorder triangles for the vertex cache with Tipsify (Sander, Nehab and
+ * Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced
+ * Overdraw", 2007). We emit every triangle around one vertex, then move on
+ * to a vertex we just used that should still be in the cache when we're
+ * done with it. When there's no such vertex we start a new cluster from
+ * the most recent vertex with triangles left, or failing that the next one
+ * in the mesh.
+ *
+ * out: Gets the triangles in their new order.
+ * cluster_starts: Set for each triangle of out that starts a cluster.
+ *
+ * Returns: The number of clusters.
+ **/
+static size_t
+mesh_optimize_tipsify(const uint32_t *elems, size_t tris, size_t verts,
+		      uint32_t *out, char *cluster_starts)
+{
+	struct mesh_adjacency adj;
+	size_t *live = xcalloc(verts, sizeof(size_t));
+	size_t *stamp = xcalloc(verts, sizeof(size_t));
+	char *emitted = xcalloc(tris, 1);
+	uint32_t *dead_end = xcalloc(3 * tris, sizeof(uint32_t));
+	uint32_t *candidates = xcalloc(3 * tris, sizeof(uint32_t));
+	size_t time = MESH_OPTIMIZE_CACHE_SIZE + 1;
+	size_t num_dead_end = 0;
+	size_t num_candidates;
+	size_t cursor = 0;
+	size_t pos = 0;
+	size_t clusters = 0;
+	int new_cluster = 1;
+	ssize_t fan = 0;
+	ssize_t priority;
+	ssize_t best;
+	uint32_t t, v;
+	size_t i, j;
+
+	mesh_adjacency_build(&adj, elems, 3 * tris, verts);
+
+	for (i = 0; i < verts; i++)
+		live[i] = adj.offsets[i + 1] - adj.offsets[i];
+
+	while (fan >= 0) {
+		num_candidates = 0;
+
+		for (i = adj.offsets[fan]; i < adj.offsets[fan + 1]; i++) {
+			t = adj.tris[i];
+
+			if (emitted[t])
+				continue;
+
+			emitted[t] = 1;
+			cluster_starts[pos] = new_cluster;
+			clusters += new_cluster;
+			new_cluster = 0;
+
+			for (j = 0; j < 3; j++) {
+				v = elems[3 * t + j];
+				out[3 * pos + j] = v;
+				dead_end[num_dead_end++] = v;
+				candidates[num_candidates++] = v;
+				live[v]--;
+
+				if (time - stamp[v] > MESH_OPTIMIZE_CACHE_SIZE)
+					stamp[v] = time++;
+			}
+
+			pos++;
+		}
+
+		/* Prefer the vertex that's been in the cache longest but will
+		 * still be there once all its triangles are drawn. */
+		fan = -1;
+		best = -1;
+
+		for (i = 0; i < num_candidates; i++) {
+			v = candidates[i];
+
+			if (! live[v])
+				continue;
+
+			priority = 0;
+
+			if (time - stamp[v] + 2 * live[v] <=
+			    MESH_OPTIMIZE_CACHE_SIZE)
+				priority = time - stamp[v];
+
+			if (priority > best) {
+				best = priority;
+				fan = v;
+			}
+		}
+
+		if (fan >= 0)
+			continue;
+
+		new_cluster = 1;
+
+		while (num_dead_end && fan < 0) {
+			v = dead_end[--num_dead_end];
+
+			if (live[v])
+				fan = v;
+		}
+
+		for (; cursor < verts && fan < 0; cursor++)
+			if (live[cursor])
+				fan = cursor;
+	}
+
+	mesh_adjacency_release(&adj);
+	free(live);
+	free(stamp);
+	free(emitted);
+	free(dead_end);
+	free(candidates);
+
+	return clusters;
+}
+
+/**
+ * Find a mesh's positions, if it has a float segment called "position" with
+ * at least three components.
+ *
+ * stride: Gets the number of floats per position.
+ **/
+static const float *
+mesh_optimize_positions(mesh_t *mesh, size_t *stride)
+{
+	vbuf_fmt_t iter = mesh->format;
+	const char *name;
+	size_t base = 0;
+	size_t elems;
+	size_t size;
+	GLenum type;
+
+	while (vbuf_fmt_pop_segment(&iter, &elems, &type, &name, &size)) {
+		if (! strcmp(name, "position") && type == GL_FLOAT &&
+		    elems >= 3) {
+			*stride = elems;
+			return (const float *)((char *)mesh->vert_data + base);
+		}
+
+		base += size * mesh->verts;
+	}
+
+	return NULL;
+}
+
+/**
+ * qsort comparator putting the clusters that face furthest outward first.
+ **/
+static int
+mesh_cluster_cmp(const void *a, const void *b)
+{
+	const struct mesh_cluster *ca = a;
+	const struct mesh_cluster *cb = b;
+
+	if (ca->score != cb->score)
+		return ca->score < cb->score ? 1 : -1;
+
+	return (ca->start > cb->start) - (ca->start < cb->start);
+}
+
+/**
+ * Reorder clusters of triangles to cut overdraw without knowing the view,
+ * as in the Tipsify paper. Clusters on the outside of the mesh facing away
+ * from its middle are likely to hide the rest, so they go first.
+ **/
+static void
+mesh_optimize_overdraw(mesh_t *mesh, uint32_t *elems, size_t tris,
+		       const char *cluster_starts, size_t num_clusters)
+{
+	struct mesh_cluster *clusters;
+	const float *pos;
+	const float *p[3];
+	uint32_t *sorted;
+	float mesh_centre[3] = { 0, 0, 0 };
+	float mesh_area = 0;
+	float (*centres)[3];
+	float (*normals)[3];
+	float *areas;
+	float edge[2][3];
+	float cross[3];
+	float centre;
+	float area;
+	float len;
+	size_t stride;
+	size_t c = 0;
+	size_t i, j, k;
+
+	pos = mesh_optimize_positions(mesh, &stride);
+
+	if (! pos || num_clusters < 2)
+		return;
+
+	clusters = xcalloc(num_clusters, sizeof(struct mesh_cluster));
+	centres = xcalloc(num_clusters, sizeof(*centres));
+	normals = xcalloc(num_clusters, sizeof(*normals));
+	areas = xcalloc(num_clusters, sizeof(float));
+
+	for (i = 0; i < tris; i++) {
+		if (cluster_starts[i] && i)
+			clusters[++c].start = i;
+
+		clusters[c].count++;
+
+		for (j = 0; j < 3; j++)
+			p[j] = pos + elems[3 * i + j] * stride;
+
+		for (k = 0; k < 3; k++) {
+			edge[0][k] = p[1][k] - p[0][k];
+			edge[1][k] = p[2][k] - p[0][k];
+		}
+
+		cross[0] = edge[0][1] * edge[1][2] - edge[0][2] * edge[1][1];
+		cross[1] = edge[0][2] * edge[1][0] - edge[0][0] * edge[1][2];
+		cross[2] = edge[0][0] * edge[1][1] - edge[0][1] * edge[1][0];
+		area = sqrtf(cross[0] * cross[0] + cross[1] * cross[1] +
+			     cross[2] * cross[2]);
+
+		for (k = 0; k < 3; k++) {
+			centre = area * (p[0][k] + p[1][k] + p[2][k]) / 3;
+			normals[c][k] += cross[k];
+			centres[c][k] += centre;
+			mesh_centre[k] += centre;
+		}
+
+		areas[c] += area;
+		mesh_area += area;
+	}
+
+	for (k = 0; k < 3 && mesh_area > 0; k++)
+		mesh_centre[k] /= mesh_area;
+
+	for (c = 0; c < num_clusters; c++) {
+		len = sqrtf(normals[c][0] * normals[c][0] +
+			    normals[c][1] * normals[c][1] +
+			    normals[c][2] * normals[c][2]);
+
+		if (areas[c] <= 0 || len <= 0)
+			continue;
+
+		for (k = 0; k < 3; k++)
+			clusters[c].score += (centres[c][k] / areas[c] -
+					      mesh_centre[k]) *
+				normals[c][k] / len;
+	}
+
+	qsort(clusters, num_clusters, sizeof(struct mesh_cluster),
+	      mesh_cluster_cmp);
+
+	sorted = xcalloc(3 * tris, sizeof(uint32_t));
+
+	for (c = 0, i = 0; c < num_clusters; c++) {
+		memcpy(sorted + 3 * i, elems + 3 * clusters[c].start,
+		       3 * clusters[c].count * sizeof(uint32_t));
+		i += clusters[c].count;
+	}
+
+	memcpy(elems, sorted, 3 * tris * sizeof(uint32_t));
+
+	free(sorted);
+	free(clusters);
+	free(centres);
+	free(normals);
+	free(areas);
+}
+
+/**
+ * Renumber vertices in the order the triangles first use them, and move
+ * the vertex data to match, so drawing reads it front to back. Vertices no
+ * triangle uses go at the end.
+ **/
+static void
+mesh_optimize_fetch(mesh_t *mesh, uint32_t *elems, size_t count)
+{
+	uint32_t *remap = xcalloc(mesh->verts, sizeof(uint32_t));
+	char *data = xmalloc(vbuf_fmt_vert_size(mesh->format) * mesh->verts);
+	char *old = mesh->vert_data;
+	vbuf_fmt_t iter = mesh->format;
+	uint32_t next = 0;
+	size_t base = 0;
+	size_t size;
+	size_t i;
+
+	/* Numbers are stored plus one so zero means not seen yet. */
+	for (i = 0; i < count; i++) {
+		if (! remap[elems[i]])
+			remap[elems[i]] = ++next;
+
+		elems[i] = remap[elems[i]] - 1;
+	}
+
+	for (i = 0; i < mesh->verts; i++)
+		if (! remap[i])
+			remap[i] = ++next;
+
+	while (vbuf_fmt_pop_segment(&iter, NULL, NULL, NULL, &size)) {
+		for (i = 0; i < mesh->verts; i++)
+			memcpy(data + base + (remap[i] - 1) * size,
+			       old + base + i * size, size);
+
+		base += size * mesh->verts;
+	}
+
+	free(mesh->vert_data);
+	mesh->vert_data = data;
+	free(remap);
+}
+
+/**
+ * Reorder a mesh's triangles and vertices to draw faster: triangles for the
+ * post-transform vertex cache, then clusters of them for overdraw, then
+ * vertices in the order they're fetched. The mesh is unbacked if it was in
+ * any buffers, so the new order is uploaded next time it's drawn.
+ *
+ * Dynamic meshes keep their vertex order, since callers refer to their
+ * vertices by index in mesh_update. Only their triangles are reordered.
+ *
+ * stats: Gets what the optimisation did, or NULL.
+ *
+ * Returns: 0 on success, -1 if the mesh isn't made of triangles.
+ **/
+int
+mesh_optimize(mesh_t *mesh, mesh_optimize_stats_t *stats)
+{
+	size_t count = mesh->elems;
+	size_t tris = count / 3;
+	uint16_t *narrow;
+	uint32_t *elems;
+	uint32_t *ordered;
+	char *cluster_starts;
+	size_t clusters;
+	size_t i;
+
+	if (mesh->type != GL_TRIANGLES || count % 3)
+		return -1;
+
+	if (stats)
+		memset(stats, 0, sizeof(mesh_optimize_stats_t));
+
+	if (! tris)
+		return 0;
+
+	mesh_hold_data(mesh);
+	narrow = (uint16_t *)mesh->elem_data;
+
+	if (mesh->elem_type == GL_UNSIGNED_INT) {
+		elems = xcalloc(count + 1, sizeof(uint32_t));
+		memcpy(elems, mesh->elem_data, count * sizeof(uint32_t));
+	} else {
+		elems = xcalloc(count + 1, sizeof(uint32_t));
+
+		for (i = 0; i < count; i++)
+			elems[i] = narrow[i];
+	}
+
+	if (stats) {
+		stats->tris = tris;
+		stats->verts = mesh->verts;
+		stats->misses_before = mesh_optimize_cache_misses(elems, count,
+								  mesh->verts);
+	}
+
+	ordered = xcalloc(count + 1, sizeof(uint32_t));
+	cluster_starts = xcalloc(tris + 1, 1);
+	clusters = mesh_optimize_tipsify(elems, tris, mesh->verts, ordered,
+					 cluster_starts);
+
+	mesh_optimize_overdraw(mesh, ordered, tris, cluster_starts, clusters);
+
+	if (! (mesh->format & VBUF_FMT_DYNAMIC))
+		mesh_optimize_fetch(mesh, ordered, count);
+
+	if (mesh->elem_type == GL_UNSIGNED_INT) {
+		memcpy(mesh->elem_data, ordered, count * sizeof(uint32_t));
+	} else {
+		for (i = 0; i < count; i++)
+			narrow[i] = ordered[i];
+	}
+
+	if (stats) {
+		stats->clusters = clusters;
+		stats->misses_after = mesh_optimize_cache_misses(ordered, count,
+								 mesh->verts);
+	}
+
+	mesh_remove_from_vbuf(mesh);
+	mesh_remove_from_ebuf(mesh);
+
+	free(elems);
+	free(ordered);
+	free(cluster_starts);
+
+	return 0;
+}
@@ -0,0 +1,63 @@
+/**
+ * Copyright © 2013 Casey Dahlin
+ *
+ * This file is part of Luftballons.
+ *
+ * Luftballons is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Luftballons is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef MESH_OPTIMIZE_H
+#define MESH_OPTIMIZE_H
+
+#include "mesh.h"
+
+/* Size of the FIFO post-transform cache we optimise for and measure with. */
+#ifndef MESH_OPTIMIZE_CACHE_SIZE
+#define MESH_OPTIMIZE_CACHE_SIZE 16
+#endif
+
+/**
+ * What mesh_optimize did to a mesh. Counts rather than ratios, so stats for
+ * several meshes can be added up. The average cache miss ratio (ACMR) is
+ * misses per triangle, and the average transformed vertex ratio (ATVR) is
+ * misses per vertex.
+ *
+ * tris: Triangles in the mesh.
+ * verts: Vertices in the mesh.
+ * clusters: Runs of triangles the mesh was split in to for overdraw
+ *           ordering.
+ * misses_before: Simulated vertex cache misses drawing the mesh as it was.
+ * misses_after: Simulated vertex cache misses drawing the optimised mesh.
+ **/
+typedef struct mesh_optimize_stats {
+	size_t tris;
+	size_t verts;
+	size_t clusters;
+	size_t misses_before;
+	size_t misses_after;
+} mesh_optimize_stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int mesh_optimize(mesh_t *mesh, mesh_optimize_stats_t *stats);
+size_t mesh_optimize_cache_misses(const uint32_t *elems, size_t count,
+				  size_t verts);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MESH_OPTIMIZE_H */
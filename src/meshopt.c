@@ -0,0 +1,220 @@
+/**
+ * Copyright © 2013 Casey Dahlin
+ *
+ * This file is part of Luftballons.
+ *
+ * Luftballons is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Luftballons is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+/**
+ * Mesh optimisation tool. Runs mesh_optimize over meshes and reports the
+ * average cache miss ratio (misses per triangle) and average transformed
+ * vertex ratio (misses per vertex) before and after, as JSON on stdout.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#include <luftballons/object.h>
+
+#ifdef HAVE_COLLADA
+#include <luftballons/dae_load.h>
+#endif
+
+#include "mesh.h"
+#include "mesh_optimize.h"
+#include "vbuf_fmt.h"
+
+/**
+ * Deterministic random numbers for shuffling generated meshes (xorshift64).
+ **/
+static uint64_t
+meshopt_rand(void)
+{
+	static uint64_t state = 0x2545F4914F6CDD1Dull;
+
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+/**
+ * Print a result line.
+ **/
+static void
+meshopt_print(const char *source, size_t tris, size_t verts,
+	      size_t misses_before, size_t misses_after)
+{
+	printf("{\"source\": \"%s\", \"tris\": %zu, \"verts\": %zu, "
+	       "\"acmr\": {\"before\": %.3f, \"after\": %.3f}, "
+	       "\"atvr\": {\"before\": %.3f, \"after\": %.3f}}\n",
+	       source, tris, verts,
+	       tris ? misses_before / (double)tris : 0,
+	       tris ? misses_after / (double)tris : 0,
+	       verts ? misses_before / (double)verts : 0,
+	       verts ? misses_after / (double)verts : 0);
+}
+
+/**
+ * Optimise a size by size grid of quads whose triangles have been shuffled,
+ * the worst case for the vertex cache.
+ **/
+static void
+meshopt_grid(size_t size)
+{
+	vbuf_fmt_t format = 0;
+	mesh_optimize_stats_t stats;
+	size_t verts = (size + 1) * (size + 1);
+	size_t tris = 2 * size * size;
+	float *pos = calloc(verts * 4, sizeof(float));
+	uint32_t *elems = calloc(tris * 3, sizeof(uint32_t));
+	uint32_t tmp[3];
+	size_t x, y, i, j;
+	uint32_t *t;
+	mesh_t *mesh;
+
+	if (! pos || ! elems)
+		errx(1, "Could not allocate %zu by %zu grid", size, size);
+
+	for (y = 0; y <= size; y++) {
+		for (x = 0; x <= size; x++) {
+			i = y * (size + 1) + x;
+			pos[4 * i] = x;
+			pos[4 * i + 1] = y;
+			pos[4 * i + 3] = 1;
+		}
+	}
+
+	for (y = 0, t = elems; y < size; y++) {
+		for (x = 0; x < size; x++, t += 6) {
+			i = y * (size + 1) + x;
+			t[0] = i;
+			t[1] = i + 1;
+			t[2] = i + size + 1;
+			t[3] = i + 1;
+			t[4] = i + size + 2;
+			t[5] = i + size + 1;
+		}
+	}
+
+	for (i = tris - 1; i > 0; i--) {
+		j = meshopt_rand() % (i + 1);
+		memcpy(tmp, elems + 3 * i, sizeof(tmp));
+		memcpy(elems + 3 * i, elems + 3 * j, sizeof(tmp));
+		memcpy(elems + 3 * j, tmp, sizeof(tmp));
+	}
+
+	vbuf_fmt_add(&format, "position", 4, GL_FLOAT);
+	mesh = mesh_create(verts, pos, 3 * tris, elems, GL_UNSIGNED_INT,
+			   format, GL_TRIANGLES);
+
+	if (mesh_optimize(mesh, &stats))
+		errx(1, "Could not optimise grid");
+
+	meshopt_print("grid", stats.tris, stats.verts, stats.misses_before,
+		      stats.misses_after);
+
+	mesh_ungrab(mesh);
+	free(pos);
+	free(elems);
+}
+
+/**
+ * Load a COLLADA file, which optimises its meshes as they come in, and
+ * report what that did.
+ **/
+static void
+meshopt_file(const char *path)
+{
+#ifdef HAVE_COLLADA
+	luft_dae_load_stats_t before;
+	luft_dae_load_stats_t after;
+	luft_object_t **items;
+	size_t count;
+	size_t i;
+
+	luft_dae_get_stats(&before);
+	items = luft_dae_load(path, &count);
+	luft_dae_get_stats(&after);
+
+	meshopt_print(path, after.tris - before.tris,
+		      after.verts - before.verts,
+		      after.misses_before - before.misses_before,
+		      after.misses_after - before.misses_after);
+
+	for (i = 0; i < count; i++)
+		luft_object_ungrab(items[i]);
+
+	free(items);
+#else
+	errx(1, "Built without COLLADA support, can't load %s", path);
+#endif
+}
+
+/**
+ * Print usage information.
+ **/
+static void
+meshopt_usage(const char *argv0)
+{
+	fprintf(stderr,
+		"Usage: %s [-g size] [file.dae ...]\n"
+		"  -g size    optimise a size by size grid of shuffled "
+		"triangles\n",
+		argv0);
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned long size;
+	char *end;
+	int did = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "g:h")) != -1) {
+		switch (opt) {
+		case 'g':
+			size = strtoul(optarg, &end, 10);
+
+			if (! *optarg || *end || ! size)
+				errx(1, "Option -g needs a positive number");
+
+			meshopt_grid(size);
+			did = 1;
+			break;
+		case 'h':
+			meshopt_usage(argv[0]);
+			return 0;
+		default:
+			meshopt_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	for (; optind < argc; optind++, did = 1)
+		meshopt_file(argv[optind]);
+
+	if (! did) {
+		meshopt_usage(argv[0]);
+		return 1;
+	}
+
+	return 0;
+}
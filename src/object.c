@@ -26,6 +26,11 @@
 #include "matrix.h"
 #include "quat.h"
 
+/* Give up on a collision check that hasn't converged after this many steps. */
+#ifndef OBJECT_GJK_MAX_ITERATIONS
+#define OBJECT_GJK_MAX_ITERATIONS 64
+#endif
+
 /**
  * Metadata for a camera.
  **/
@@ -54,7 +59,8 @@ object_get_fs_quad(void)
 
 	vbuf_fmt_add(&format, "position", 4, GL_FLOAT);
 
-	mesh = mesh_create(4, verts, 4, elems, format, GL_TRIANGLE_FAN);
+	mesh = mesh_create(4, verts, 4, elems, GL_UNSIGNED_SHORT, format,
+			   GL_TRIANGLE_FAN);
 	object = object_create(NULL);
 	object_set_mesh(object, mesh);
 	mesh_ungrab(mesh);
@@ -612,6 +618,7 @@ object_check_collision(object_t *a, object_t *b)
 	float direction[3] = { 0, 1, 0 };
 	float simplex[4][3];
 	size_t simplex_pos = 5;
+	size_t iterations = 0;
 	size_t last;
 	float middle[3];
 	float to_last[3];
@@ -636,7 +643,11 @@ object_check_collision(object_t *a, object_t *b)
 	if (vec3_dot(simplex[2], direction) <= 0)
 		return 0;
 
-	while (vec3_dot(simplex[simplex_pos], direction)) {
+	while (simplex_pos == 5 ||
+	       vec3_dot(simplex[simplex_pos], direction)) {
+		if (iterations++ == OBJECT_GJK_MAX_ITERATIONS)
+			return 0;
+
 		if (simplex_pos == 5) {
 			simplex_pos = 3;
 			last = 2;
@@ -17,6 +17,7 @@
  * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
  **/
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <err.h>
@@ -25,97 +26,516 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
-#include <sys/mman.h>
 
 #include "shader.h"
 #include "vbuf.h"
 #include "util.h"
+#include "stats.h"
+#include "gl_state.h"
+#include "gl_check.h"
+#include "shader_cache.h"
+#include "worker.h"
 
 static shader_t *current_shader = NULL;
 
 /**
- * Compile a shader from a string containing glsl.
+ * The shader last activated, before picking a fallback or a variant for the
+ * vertex format.
  **/
-static GLuint
-shader_string(GLenum type, const char *shader_name, const GLchar *data,
-	      GLint len)
-{
-	GLchar *log;
-	GLuint shader;
-	GLint status;
-	GLint log_len;
+static shader_t *current_base = NULL;
 
-	shader = glCreateShader(type);
-	glShaderSource(shader, 1, &data, &len);
-	glCompileShader(shader);
+/**
+ * Shaders made by shader_create_variant, so we can hand back the same shader
+ * when asked for the same variant.
+ **/
+static shader_t **shader_variants = NULL;
+static size_t num_shader_variants = 0;
+
+/**
+ * Set when the last shader activated wasn't ready and had no fallback, so
+ * there is nothing to draw with.
+ **/
+static int current_shader_missing = 0;
 
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+/**
+ * ID to give the next shader we create.
+ **/
+static uint64_t shader_next_id = 0;
 
-	CHECK_GL;
-	if (status != GL_FALSE)
-		return shader;
+/**
+ * Kinds of shader stage a program is built from, in the order shader_create
+ * takes their sources.
+ **/
+static const GLenum shader_stage_types[SHADER_NUM_STAGES] = {
+	GL_VERTEX_SHADER,
+	GL_FRAGMENT_SHADER,
+};
 
-	log = xmalloc(log_len + 1);
+/**
+ * Whether the driver supports GL_KHR_parallel_shader_compile, or -1 if we
+ * haven't checked yet.
+ **/
+static int shader_parallel_compile = -1;
 
-	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &log_len);
-	glGetShaderInfoLog(shader, log_len, NULL, log);
+/**
+ * Check for GL_KHR_parallel_shader_compile, and let the driver use as many
+ * threads as it likes if it's there.
+ **/
+static int
+shader_have_parallel_compile(void)
+{
+	if (shader_parallel_compile >= 0)
+		return shader_parallel_compile;
 
-	errx(1, "Could not compile %s: %s", shader_name, log);
+	shader_parallel_compile =
+		gl_have_extension("GL_KHR_parallel_shader_compile");
+
+	if (shader_parallel_compile)
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+
+	CLEAR_GL;
+	return shader_parallel_compile;
 }
 
 /**
- * Load an OpenGL shader from a file.
+ * Read a whole file into memory.
+ *
+ * Returns: 0 on success, or an errno value.
  **/
-static GLuint
-shader_file(GLenum type, const char *filename)
+static int
+shader_read_file(const char *filename, GLchar **data_out, GLint *size_out)
 {
 	int fd = open(filename, O_RDONLY | O_CLOEXEC);
-	GLint size;
+	size_t size = 0;
+	size_t cap = 4096;
 	GLchar *data;
-	GLuint shader;
+	ssize_t got;
+	int error;
 
 	if (fd < 0)
-		err(1, "Could not open shader file %s", filename);
+		return errno;
+
+	data = xmalloc(cap);
+
+	for (;;) {
+		if (size == cap)
+			data = xrealloc(data, cap *= 2);
+
+		got = read(fd, data + size, cap - size);
 
-	size = lseek(fd, 0, SEEK_END);
+		if (got < 0 && errno == EINTR)
+			continue;
+
+		if (got <= 0)
+			break;
 
-	if (size < 0)
-		err(1, "Could not find end of shader file %s", filename);
+		size += got;
+	}
 
-	data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	error = got < 0 ? errno : 0;
 	close(fd);
 
-	if (! data)
-		err(1, "Could not map shader file");
+	if (error) {
+		free(data);
+		return error;
+	}
+
+	*data_out = data;
+	*size_out = size;
+	return 0;
+}
+
+/**
+ * Insert #define lines into a shader source, just after the #version line if
+ * there is one, since nothing may come before that. A #line directive after
+ * them keeps line numbers in compile errors matching the file.
+ *
+ * defines: NULL-terminated list of "NAME" or "NAME VALUE" strings.
+ **/
+static void
+shader_inject_defines(GLchar **source, GLint *length, char *const *defines)
+{
+	GLchar *old = *source;
+	size_t old_len = *length;
+	size_t insert_at = 0;
+	size_t extra = 0;
+	size_t line = 1;
+	size_t pos;
+	size_t i;
+	GLchar *ret;
+
+	if (! defines || ! defines[0])
+		return;
+
+	while (insert_at < old_len && (old[insert_at] == ' ' ||
+				       old[insert_at] == '\t' ||
+				       old[insert_at] == '\n' ||
+				       old[insert_at] == '\r'))
+		insert_at++;
+
+	if (old_len - insert_at >= 8 &&
+	    ! strncmp(old + insert_at, "#version", 8)) {
+		while (insert_at < old_len && old[insert_at] != '\n')
+			insert_at++;
+
+		if (insert_at < old_len)
+			insert_at++;
+	} else {
+		insert_at = 0;
+	}
+
+	for (i = 0; i < insert_at; i++)
+		if (old[i] == '\n')
+			line++;
+
+	for (i = 0; defines[i]; i++)
+		extra += strlen("#define \n") + strlen(defines[i]);
+
+	extra += strlen("#line \n") + 20;
+
+	ret = xmalloc(old_len + extra + 2);
+	memcpy(ret, old, insert_at);
+	pos = insert_at;
+
+	/* The #version line may be the last, with no newline of its own. */
+	if (pos && ret[pos - 1] != '\n')
+		ret[pos++] = '\n';
+
+	for (i = 0; defines[i]; i++)
+		pos += sprintf(ret + pos, "#define %s\n", defines[i]);
+
+	pos += sprintf(ret + pos, "#line %zu\n", line);
+
+	memcpy(ret + pos, old + insert_at, old_len - insert_at);
+	pos += old_len - insert_at;
+
+	free(old);
+	*source = ret;
+	*length = pos;
+}
+
+/**
+ * Worker job that reads a shader's sources and specialises them.
+ **/
+static void
+shader_read_sources(void *data)
+{
+	struct shader_pending *pending = data;
+	size_t i;
+
+	for (i = 0; i < SHADER_NUM_STAGES; i++) {
+		pending->error = shader_read_file(pending->paths[i],
+						  &pending->sources[i],
+						  &pending->lengths[i]);
+
+		if (pending->error) {
+			pending->error_path = pending->paths[i];
+			return;
+		}
+
+		shader_inject_defines(&pending->sources[i],
+				      &pending->lengths[i], pending->defines);
+	}
+}
+
+/**
+ * qsort comparator for define strings.
+ **/
+static int
+shader_define_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * Free a list of defines.
+ **/
+static void
+shader_defines_free(char **defines)
+{
+	size_t i;
+
+	for (i = 0; defines && defines[i]; i++)
+		free(defines[i]);
+
+	free(defines);
+}
+
+/**
+ * Copy a NULL-terminated list of defines, written as "NAME", "NAME VALUE" or
+ * "NAME=VALUE", into the "NAME VALUE" form. The copy is sorted, so the same
+ * set of defines always gives the same list.
+ **/
+static char **
+shader_defines_dup(const char *const *defines)
+{
+	size_t count = 0;
+	char **ret;
+	char *eq;
+	size_t i;
+
+	while (defines && defines[count])
+		count++;
+
+	ret = xcalloc(count + 1, sizeof(char *));
+
+	for (i = 0; i < count; i++) {
+		ret[i] = xstrdup(defines[i]);
+		eq = strchr(ret[i], '=');
+
+		if (eq)
+			*eq = ' ';
+	}
+
+	qsort(ret, count, sizeof(char *), shader_define_cmp);
+	return ret;
+}
+
+/**
+ * Free a shader's pending build state.
+ **/
+static void
+shader_pending_free(struct shader_pending *pending)
+{
+	size_t i;
+
+	for (i = 0; i < SHADER_NUM_STAGES; i++) {
+		free(pending->paths[i]);
+		free(pending->sources[i]);
+	}
+
+	shader_defines_free(pending->defines);
+	free(pending);
+}
+
+/**
+ * Hand a shader's sources to the driver, once they've been read. Nothing
+ * here waits for the driver to finish.
+ *
+ * Returns: 1 if the program came out of the binary cache and is linked
+ * already, 0 if it is compiling.
+ **/
+static int
+shader_submit(shader_t *shader)
+{
+	struct shader_pending *pending = shader->pending;
+	const GLchar *const *sources = (const GLchar *const *)pending->sources;
+	GLuint stage;
+	size_t i;
+
+	if (pending->error)
+		errx(1, "Could not read shader file %s: %s",
+		     pending->error_path, strerror(pending->error));
+
+	pending->key = shader_cache_key(SHADER_NUM_STAGES, sources,
+					pending->lengths);
+
+	if (shader_cache_load(shader->gl_handle, pending->key))
+		return 1;
+
+	shader_have_parallel_compile();
+
+	for (i = 0; i < SHADER_NUM_STAGES; i++) {
+		stage = glCreateShader(shader_stage_types[i]);
+		glShaderSource(stage, 1, &sources[i], &pending->lengths[i]);
+		glCompileShader(stage);
+		glAttachShader(shader->gl_handle, stage);
+		pending->stages[i] = stage;
+	}
+
+	shader_cache_prepare(shader->gl_handle);
+	glLinkProgram(shader->gl_handle);
+	CHECK_GL;
+
+	pending->submitted = 1;
+	return 0;
+}
+
+/**
+ * Die with the compile log of a stage, if that stage failed to compile.
+ **/
+static void
+shader_check_stage(GLuint stage, const char *shader_name)
+{
+	GLchar *log;
+	GLint status;
+	GLint log_len = 0;
+
+	glGetShaderiv(stage, GL_COMPILE_STATUS, &status);
+
+	if (status != GL_FALSE)
+		return;
 
-	shader = shader_string(type, filename, data, size);
+	glGetShaderiv(stage, GL_INFO_LOG_LENGTH, &log_len);
+	log = xcalloc(log_len + 1, 1);
+	glGetShaderInfoLog(stage, log_len, NULL, log);
 
-	munmap(data, size);
-	return shader;
+	errx(1, "Could not compile %s: %s", shader_name, log);
 }
 
 /**
- * Link a shader.
+ * Collect the result of linking a shader. Blocks if the driver isn't done.
  **/
 static void
-shader_link(shader_t *shader)
+shader_link_finish(shader_t *shader)
 {
+	struct shader_pending *pending = shader->pending;
 	GLint status;
-	GLint log_len;
+	GLint log_len = 0;
 	GLchar *log;
+	size_t i;
 
-	glLinkProgram(shader->gl_handle);
 	glGetProgramiv(shader->gl_handle, GL_LINK_STATUS, &status);
+	CHECK_GL;
+
+	if (status == GL_FALSE) {
+		for (i = 0; i < SHADER_NUM_STAGES; i++)
+			shader_check_stage(pending->stages[i],
+					   pending->paths[i]);
+
+		glGetProgramiv(shader->gl_handle, GL_INFO_LOG_LENGTH,
+			       &log_len);
+		log = xcalloc(log_len + 1, 1);
+		glGetProgramInfoLog(shader->gl_handle, log_len, NULL, log);
+
+		errx(1, "Could not link shaders: %s", log);
+	}
+
+	shader_cache_store(shader->gl_handle, pending->key);
+
+	for (i = 0; i < SHADER_NUM_STAGES; i++) {
+		glDetachShader(shader->gl_handle, pending->stages[i]);
+		glDeleteShader(pending->stages[i]);
+	}
 
 	CHECK_GL;
-	if (status != GL_FALSE)
+}
+
+/**
+ * Query the active uniforms of a linked shader and record their locations by
+ * name ID, so we never have to ask the driver for them during drawing.
+ **/
+static void
+shader_build_uniform_table(shader_t *shader)
+{
+	GLint count;
+	GLint namesz;
+	GLint i;
+	GLint sz;
+	GLenum type;
+	GLint loc;
+	GLchar *name;
+	char *bracket;
+	size_t id;
+	size_t j;
+
+	glGetProgramiv(shader->gl_handle, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(shader->gl_handle, GL_ACTIVE_UNIFORM_MAX_LENGTH,
+		       &namesz);
+
+	if (namesz < 1)
+		namesz = 1;
+
+	name = xmalloc(namesz);
+
+	for (i = 0; i < count; i++) {
+		name[0] = '\0';
+		glGetActiveUniform(shader->gl_handle, i, namesz, NULL,
+				   &sz, &type, name);
+
+		/* Arrays are reported as "name[0]" */
+		bracket = strchr(name, '[');
+		if (bracket)
+			*bracket = '\0';
+
+		loc = glGetUniformLocation(shader->gl_handle, name);
+
+		if (loc < 0)
+			continue;
+
+		id = uniform_name_id(name);
+
+		if (id >= shader->num_locations) {
+			shader->locations = xrealloc(shader->locations,
+						     (id + 1) * sizeof(GLint));
+
+			for (j = shader->num_locations; j <= id; j++)
+				shader->locations[j] = -1;
+
+			shader->num_locations = id + 1;
+		}
+
+		shader->locations[id] = loc;
+	}
+
+	CHECK_GL;
+	free(name);
+
+	if (! shader->num_locations)
 		return;
 
-	glGetProgramiv(shader->gl_handle, GL_INFO_LOG_LENGTH, &log_len);
-	log = xmalloc(log_len + 1);
-	glGetProgramInfoLog(shader->gl_handle, log_len, NULL, log);
+	shader->uniform_versions = xcalloc(shader->num_locations,
+					   sizeof(uint64_t));
+}
+
+/**
+ * Get the location of a uniform in a shader by name ID.
+ **/
+static GLint
+shader_uniform_location(shader_t *shader, size_t name_id)
+{
+	if (name_id >= shader->num_locations)
+		return -1;
 
-	errx(1, "Could not link shaders: %s", log);
+	return shader->locations[name_id];
+}
+
+/**
+ * Move a pending shader along as far as it will go.
+ *
+ * block: Wait for the worker threads and the driver rather than returning
+ *        early.
+ *
+ * Returns: 1 if the shader is ready to use, 0 otherwise.
+ **/
+static int
+shader_progress(shader_t *shader, int block)
+{
+	struct shader_pending *pending = shader->pending;
+
+	if (! pending)
+		return 1;
+
+	if (! pending->submitted) {
+		if (! block && ! worker_job_done(&pending->work))
+			return 0;
+
+		worker_job_wait(&pending->work);
+
+		if (shader_submit(shader))
+			goto done;
+	}
+
+	/* Without the extension, asking for the link status is the only way
+	 * to find out, and it waits. */
+	if (! block && shader_have_parallel_compile()) {
+		GLint complete = GL_FALSE;
+
+		glGetProgramiv(shader->gl_handle, GL_COMPLETION_STATUS_KHR,
+			       &complete);
+
+		if (complete == GL_FALSE)
+			return 0;
+	}
+
+	shader_link_finish(shader);
+
+done:
+	shader_build_uniform_table(shader);
+	shader_pending_free(pending);
+	shader->pending = NULL;
+	CHECK_GL;
+	return 1;
 }
 
 /**
@@ -124,15 +544,94 @@ shader_link(shader_t *shader)
 static shader_t *
 shader_instantiate(void)
 {
-	shader_t *ret = xmalloc(sizeof(shader_t));
+	shader_t *ret = xcalloc(1, sizeof(shader_t));
 
 	ret->gl_handle = glCreateProgram();
-	ret->uniforms = NULL;
-	ret->uniform_count = 0;
+	ret->id = shader_next_id++;
 	CHECK_GL;
 	return ret;
 }
 
+/**
+ * Find the shader whose retained uniforms a shader uses: its base shader if
+ * it's a variant picked for a vertex format, otherwise itself.
+ **/
+static inline shader_t *
+shader_root(shader_t *shader)
+{
+	return shader->parent ? shader->parent : shader;
+}
+
+/**
+ * Hash a variant cache key.
+ **/
+static uint64_t
+shader_variant_hash(const char *key, size_t len)
+{
+	uint64_t hash = 14695981039346656037ull;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char)key[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+/**
+ * Build the variant cache key for a pair of files and a sorted define list.
+ * The parts are separated by NUL bytes, so *len_out gives the real length.
+ **/
+static char *
+shader_variant_key(const char *vertex, const char *frag, char *const *defines,
+		   size_t *len_out)
+{
+	size_t len = strlen(vertex) + strlen(frag) + 2;
+	char *ret;
+	size_t pos;
+	size_t i;
+
+	for (i = 0; defines[i]; i++)
+		len += strlen(defines[i]) + 1;
+
+	ret = xmalloc(len);
+	pos = 0;
+
+	strcpy(ret + pos, vertex);
+	pos += strlen(vertex) + 1;
+	strcpy(ret + pos, frag);
+	pos += strlen(frag) + 1;
+
+	for (i = 0; defines[i]; i++) {
+		strcpy(ret + pos, defines[i]);
+		pos += strlen(defines[i]) + 1;
+	}
+
+	*len_out = len;
+	return ret;
+}
+
+/**
+ * Find a cached variant.
+ **/
+static shader_t *
+shader_variant_lookup(const char *key, size_t len, uint64_t hash)
+{
+	size_t i;
+
+	for (i = 0; i < num_shader_variants; i++) {
+		if (shader_variants[i]->variant_hash != hash ||
+		    shader_variants[i]->variant_key_len != len)
+			continue;
+
+		if (! memcmp(shader_variants[i]->variant_key, key, len))
+			return shader_variants[i];
+	}
+
+	return NULL;
+}
+
 /**
  * Destructor for a shader_t
  **/
@@ -140,45 +639,288 @@ static void
 shader_destructor(void *shader_)
 {
 	shader_t *shader = shader_;
+	struct shader_pending *pending = shader->pending;
 	size_t i;
 
+	if (current_shader == shader)
+		current_shader = NULL;
+
+	if (current_base == shader)
+		current_base = NULL;
+
+	if (pending) {
+		worker_job_wait(&pending->work);
+
+		for (i = 0; pending->submitted && i < SHADER_NUM_STAGES; i++)
+			glDeleteShader(pending->stages[i]);
+
+		shader_pending_free(pending);
+	}
+
+	if (shader->variant_key) {
+		for (i = 0; shader_variants[i] != shader; i++);
+		shader_variants = vec_del(shader_variants,
+					  num_shader_variants, i);
+		num_shader_variants--;
+		free(shader->variant_key);
+	}
+
+	for (i = 0; i < shader->num_format_variants; i++)
+		shader_ungrab(shader->format_variants[i].shader);
+
+	free(shader->format_variants);
+
+	if (shader->fallback)
+		shader_ungrab(shader->fallback);
+
+	vbuf_forget_shader(shader->id);
 	glDeleteProgram(shader->gl_handle);
 	CLEAR_GL;
 
-	for (i = 0; i < shader->uniform_count; i++)
-		uniform_ungrab(shader->uniforms[i]);
+	for (i = 0; i < shader->num_uniforms; i++)
+		if (shader->uniforms[i])
+			uniform_ungrab(shader->uniforms[i]);
+
+	for (i = 0; i < SHADER_NUM_STAGES; i++)
+		free(shader->paths[i]);
 
+	shader_defines_free(shader->defines);
+	free(shader->uniforms);
+	free(shader->uniform_versions);
+	free(shader->locations);
 	free(shader);
 }
 
+/**
+ * Start building a shader with the given defines. Takes ownership of
+ * defines.
+ **/
+static shader_t *
+shader_start(const char *vertex, const char *frag, char **defines)
+{
+	shader_t *ret = shader_instantiate();
+	struct shader_pending *pending = xcalloc(1, sizeof(*pending));
+
+	pending->paths[0] = xstrdup(vertex);
+	pending->paths[1] = xstrdup(frag);
+	pending->defines = defines;
+	ret->pending = pending;
+
+	worker_submit(&pending->work, shader_read_sources, pending);
+
+	refcount_init(&ret->refcount);
+	refcount_add_destructor(&ret->refcount, shader_destructor, ret);
+	return ret;
+}
+
+/**
+ * Start loading a shader from a vertex and fragment shader file, and return
+ * without waiting for it. The files are read on worker threads, and the
+ * driver compiles in the background if it can. Submit all the shaders you
+ * need before using any of them so the work overlaps.
+ *
+ * A shader that isn't ready yet draws nothing, or draws with its fallback
+ * (see shader_set_fallback). Use shader_ready or shader_wait to find out
+ * when it is done. Errors in the shader are fatal when they are found.
+ **/
+shader_t *
+shader_create_async(const char *vertex, const char *frag)
+{
+	return shader_start(vertex, frag, NULL);
+}
+EXPORT(shader_create_async);
+
 /**
  * Given a file for a vertex shader and fragment shader, load them.
  **/
 shader_t *
 shader_create(const char *vertex, const char *frag)
 {
-	GLuint vert_shader = shader_file(GL_VERTEX_SHADER, vertex);
-	GLuint frag_shader = shader_file(GL_FRAGMENT_SHADER, frag);
+	shader_t *ret = shader_create_async(vertex, frag);
 
-	shader_t *ret = shader_instantiate();
+	shader_progress(ret, 1);
+	return ret;
+}
+EXPORT(shader_create);
 
-	glAttachShader(ret->gl_handle, vert_shader);
-	glAttachShader(ret->gl_handle, frag_shader);
+/**
+ * Create a specialised shader. Each of defines, a NULL-terminated list of
+ * "NAME" or "NAME VALUE" strings, becomes a #define placed just after the
+ * #version line of both files. Asking for the same files and defines again
+ * gives back the same shader.
+ *
+ * The shader is further specialised for each vertex format drawn with it,
+ * with LUFT_FORMAT defined along with LUFT_HAVE_<SEGMENT> for every segment
+ * the format has (LUFT_HAVE_COLOR for "color" and so on), so attributes and
+ * texture fetches the format can't feed can be compiled out. The shader as
+ * created is used in the meantime, so should cope with LUFT_FORMAT being
+ * undefined. Uniforms set on it apply to all of its format variants.
+ *
+ * Loads asynchronously, like shader_create_async.
+ **/
+shader_t *
+shader_create_variant(const char *vertex, const char *frag,
+		      const char *const *defines)
+{
+	char **sorted = shader_defines_dup(defines);
+	size_t len;
+	char *key = shader_variant_key(vertex, frag, sorted, &len);
+	uint64_t hash = shader_variant_hash(key, len);
+	shader_t *ret = shader_variant_lookup(key, len, hash);
+	size_t i;
 
-	shader_link(ret);
+	if (ret) {
+		shader_defines_free(sorted);
+		free(key);
+		shader_grab(ret);
+		return ret;
+	}
 
-	glDetachShader(ret->gl_handle, vert_shader);
-	glDetachShader(ret->gl_handle, frag_shader);
-	glDeleteShader(vert_shader);
-	glDeleteShader(frag_shader);
+	ret = shader_start(vertex, frag, shader_defines_dup(defines));
+	ret->variant_key = key;
+	ret->variant_key_len = len;
+	ret->variant_hash = hash;
+	ret->defines = sorted;
 
-	CHECK_GL;
+	for (i = 0; i < SHADER_NUM_STAGES; i++)
+		ret->paths[i] = xstrdup(i ? frag : vertex);
+
+	shader_variants = vec_expand(shader_variants, num_shader_variants);
+	shader_variants[num_shader_variants++] = ret;
 
-	refcount_init(&ret->refcount);
-	refcount_add_destructor(&ret->refcount, shader_destructor, ret);
 	return ret;
 }
-EXPORT(shader_create);
+EXPORT(shader_create_variant);
+
+/**
+ * Make the define that says a vertex format has a segment.
+ **/
+static char *
+shader_segment_define(const char *name)
+{
+	size_t prefix = strlen("LUFT_HAVE_");
+	char *ret = xmalloc(prefix + strlen(name) + 1);
+	size_t i;
+
+	strcpy(ret, "LUFT_HAVE_");
+
+	for (i = 0; name[i]; i++) {
+		if (name[i] >= 'a' && name[i] <= 'z')
+			ret[prefix + i] = name[i] - 'a' + 'A';
+		else if ((name[i] >= 'A' && name[i] <= 'Z') ||
+			 (name[i] >= '0' && name[i] <= '9'))
+			ret[prefix + i] = name[i];
+		else
+			ret[prefix + i] = '_';
+	}
+
+	ret[prefix + i] = '\0';
+	return ret;
+}
+
+/**
+ * Get the variant of a specialisable shader for a vertex format, starting it
+ * if this is the first time we've drawn the format with it.
+ **/
+static shader_t *
+shader_format_variant(shader_t *shader, vbuf_fmt_t format)
+{
+	struct shader_format_variant *variant;
+	vbuf_fmt_t iter = format;
+	const char *name;
+	char **defines;
+	size_t segments = 0;
+	size_t count = 0;
+	size_t i;
+
+	for (i = 0; i < shader->num_format_variants; i++)
+		if (shader->format_variants[i].format == format)
+			return shader->format_variants[i].shader;
+
+	while (shader->defines[count])
+		count++;
+
+	while (vbuf_fmt_pop_segment(&iter, NULL, NULL, NULL, NULL))
+		segments++;
+
+	defines = xcalloc(count + segments + 3, sizeof(char *));
+
+	for (i = 0; i < count; i++)
+		defines[i] = xstrdup(shader->defines[i]);
+
+	defines[count++] = xstrdup("LUFT_FORMAT");
+
+	if (format & VBUF_FMT_COMPRESSED)
+		defines[count++] = xstrdup("LUFT_COMPRESSED");
+
+	iter = format;
+
+	while (vbuf_fmt_pop_segment(&iter, NULL, NULL, &name, NULL))
+		defines[count++] = shader_segment_define(name);
+
+	shader->format_variants = vec_expand(shader->format_variants,
+					     shader->num_format_variants);
+	variant = &shader->format_variants[shader->num_format_variants++];
+	variant->format = format;
+	variant->shader = shader_start(shader->paths[0], shader->paths[1],
+				       defines);
+	variant->shader->parent = shader;
+
+	return variant->shader;
+}
+
+/**
+ * Check whether a shader has finished loading, without waiting for it.
+ **/
+int
+shader_ready(shader_t *shader)
+{
+	return shader_progress(shader, 0);
+}
+EXPORT(shader_ready);
+
+/**
+ * Wait for a shader to finish loading.
+ **/
+void
+shader_wait(shader_t *shader)
+{
+	shader_progress(shader, 1);
+}
+EXPORT(shader_wait);
+
+/**
+ * Set a shader to draw with in place of this one until it is ready. Pass NULL
+ * to skip drawing instead, which is the default.
+ **/
+void
+shader_set_fallback(shader_t *shader, shader_t *fallback)
+{
+	if (fallback)
+		shader_grab(fallback);
+
+	if (shader->fallback)
+		shader_ungrab(shader->fallback);
+
+	shader->fallback = fallback;
+}
+EXPORT(shader_set_fallback);
+
+/**
+ * Find the shader that actually draws in place of the given one: the shader
+ * itself if it is ready, its fallback if that is, or NULL.
+ **/
+static shader_t *
+shader_resolve(shader_t *shader)
+{
+	if (shader_ready(shader))
+		return shader;
+
+	if (shader->fallback && shader_ready(shader->fallback))
+		return shader->fallback;
+
+	return NULL;
+}
 
 /**
  * Grab a shader.
@@ -201,51 +943,33 @@ shader_ungrab(shader_t *shader)
 EXPORT(shader_ungrab);
 
 /**
- * Set vertex attributes.
+ * Set vertex attributes, by binding the vertex array for the current shader
+ * and vertex buffer.
  **/
 void
 shader_set_vertex_attrs()
 {
-	GLint attrs;
-	GLint namesz;
-	GLint i;
-	GLchar *name;
-	GLint sz;
-	GLenum type;
-
 	if (! current_shader)
 		return;
 
-	glGetProgramiv(current_shader->gl_handle, GL_ACTIVE_ATTRIBUTES,
-		       &attrs);
-	glGetProgramiv(current_shader->gl_handle,
-		       GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &namesz);
-
-	name = xmalloc(namesz);
-
-	for (i = 0; i < attrs; i++) {
-		glGetActiveAttrib(current_shader->gl_handle, i, namesz,
-				  NULL, &sz, &type, name);
-
-		vbuf_setup_vertex_attribute(name, i);
-	}
-
-	CHECK_GL;
-	free(name);
+	vbuf_bind_vertex_array(current_shader->gl_handle, current_shader->id);
 }
 
 /**
- * Enter this shader into the OpenGL state.
+ * Put a ready shader's program in use.
  **/
-void
-shader_activate(shader_t *shader)
+static void
+shader_use(shader_t *shader)
 {
-	texmap_end_unit_generation();
 	if (current_shader == shader)
 		return;
 
 	current_shader = shader;
-	glUseProgram(shader->gl_handle);
+
+	if (! shader)
+		return;
+
+	gl_state_use_program(shader->gl_handle);
 	shader_set_vertex_attrs();
 	CHECK_GL;
 }
@@ -254,14 +978,13 @@ shader_activate(shader_t *shader)
  * Set a uniform value to a 2D texture.
  **/
 static void
-shader_set_uniform_samp2D(shader_t *shader, const char *name, texmap_t *map)
+shader_set_uniform_samp2D(GLint loc, texmap_t *map)
 {
-	GLint loc = glGetUniformLocation(shader->gl_handle, name);
 	size_t unit = texmap_get_texture_unit(map);
 
 	glUniform1i(loc, unit);
 
-	glBindSampler(unit, map->sampler);
+	gl_state_bind_sampler(unit, map->sampler);
 	CHECK_GL;
 }
 
@@ -269,10 +992,9 @@ shader_set_uniform_samp2D(shader_t *shader, const char *name, texmap_t *map)
  * Apply a uniform to a shader, in OpenGL terms.
  **/
 static void
-shader_apply_uniform(shader_t *shader, uniform_t *uniform)
+shader_apply_uniform(shader_t *shader, uniform_t *uniform, GLint loc)
 {
-	shader_activate(shader);
-	GLint loc = glGetUniformLocation(shader->gl_handle, uniform->name);
+	shader_use(shader);
 
 	switch (uniform->type) {
 		case UNIFORM_MAT4:
@@ -283,8 +1005,7 @@ shader_apply_uniform(shader_t *shader, uniform_t *uniform)
 			glUniform4fv(loc, 1, uniform->value.data_ptr);
 			break;
 		case UNIFORM_TEXMAP:
-			shader_set_uniform_samp2D(shader, uniform->name,
-						  uniform->value.data_ptr);
+			shader_set_uniform_samp2D(loc, uniform->value.data_ptr);
 			break;
 		case UNIFORM_UINT:
 			glUniform1i(loc, (int)uniform->value.uint);
@@ -293,31 +1014,178 @@ shader_apply_uniform(shader_t *shader, uniform_t *uniform)
 			errx(1, "Unreachable statement");
 	}
 
+	shader->uniform_versions[uniform->name_id] = uniform->version;
+	stats_count_uniform_upload();
 	CHECK_GL;
 }
 
+/**
+ * Make sure a ready shader's program holds a uniform, uploading it if the
+ * program has something else.
+ **/
+static void
+shader_sync_uniform(shader_t *shader, uniform_t *uniform)
+{
+	size_t id = uniform->name_id;
+	GLint loc = shader_uniform_location(shader, id);
+
+	/* The program doesn't use this uniform, so there's nothing to set. */
+	if (loc < 0)
+		return;
+
+	/* Textures still need binding, as their unit may have been reused. */
+	if (shader->uniform_versions[id] == uniform->version &&
+	    uniform->type != UNIFORM_TEXMAP)
+		return;
+
+	shader_apply_uniform(shader, uniform, loc);
+}
+
+/**
+ * Put a ready program in use to draw for a shader, bringing it up to date
+ * with the uniforms set on that shader.
+ *
+ * root: Shader the program draws for: the program's own shader, the base of
+ *       a format variant, or a shader the program is the fallback of.
+ **/
+static void
+shader_use_synced(shader_t *shader, shader_t *root)
+{
+	size_t i;
+
+	shader_use(shader);
+
+	for (i = 0; i < root->num_uniforms; i++)
+		if (root->uniforms[i])
+			shader_sync_uniform(shader, root->uniforms[i]);
+}
+
+/**
+ * Put a ready format variant's program in use, bringing it up to date with
+ * the uniforms set on the shader it came from.
+ **/
+static void
+shader_use_variant(shader_t *variant)
+{
+	variant->parent->last_variant = variant;
+
+	if (current_shader == variant)
+		return;
+
+	shader_use_synced(variant, variant->parent);
+}
+
+/**
+ * Enter this shader into the OpenGL state.
+ **/
+void
+shader_activate(shader_t *shader)
+{
+	shader_t *drawing;
+
+	current_base = shader;
+
+	/* Start with the variant we drew with last; shader_select_format
+	 * switches if the next object needs another. */
+	if (shader->last_variant) {
+		current_shader_missing = 0;
+		shader_use_variant(shader->last_variant);
+		return;
+	}
+
+	drawing = shader_resolve(shader);
+	current_shader_missing = ! drawing;
+
+	/* A fallback may hold the values of another shader it stood in for. */
+	if (! drawing || (current_shader == drawing && drawing == shader))
+		shader_use(drawing);
+	else
+		shader_use_synced(drawing, shader);
+}
+
+/**
+ * Determine whether we can draw with the shader last activated, or whether
+ * it's still loading.
+ *
+ * If the shader was loading when it was activated, check again without
+ * waiting and switch to it once it's ready. The state it was activated for
+ * stays current from frame to frame, so it won't be activated again.
+ **/
+int
+shader_can_draw(void)
+{
+	if (current_base && ! current_base->last_variant &&
+	    current_shader != current_base && shader_ready(current_base)) {
+		current_shader_missing = 0;
+		shader_use_synced(current_base, current_base);
+	}
+
+	return ! current_shader_missing;
+}
+
+/**
+ * Draw the next object with the variant of the active shader specialised for
+ * the given vertex format, if the active shader has variants.
+ *
+ * Returns: 0 if the object can be drawn, -1 if its vertex data is compressed
+ * and the variant that can decode it is still loading.
+ **/
+int
+shader_select_format(vbuf_fmt_t format)
+{
+	shader_t *variant;
+
+	if (! current_base || ! current_base->defines)
+		return 0;
+
+	variant = shader_format_variant(current_base, format);
+
+	/* Draw with the general version until the specialised one is done,
+	 * unless the general version can't read the data. */
+	if (! shader_ready(variant))
+		return (format & VBUF_FMT_COMPRESSED) ? -1 : 0;
+
+	shader_use_variant(variant);
+	return 0;
+}
+
 /**
  * Set a uniform value.
  **/
 void
 shader_set_uniform(shader_t *shader, uniform_t *uniform)
 {
+	shader_t *root = shader_root(shader);
+	size_t id = uniform->name_id;
 	size_t i;
 
-	uniform_grab(uniform);
-	shader_apply_uniform(shader, uniform);
+	if (id >= root->num_uniforms) {
+		root->uniforms = xrealloc(root->uniforms,
+					  (id + 1) * sizeof(uniform_t *));
 
-	for (i = 0; i < shader->uniform_count; i++) {
-		if (strcmp(shader->uniforms[i]->name, uniform->name))
-			continue;
+		for (i = root->num_uniforms; i <= id; i++)
+			root->uniforms[i] = NULL;
 
-		uniform_ungrab(shader->uniforms[i]);
-		shader->uniforms[i] = uniform;
-		return;
+		root->num_uniforms = id + 1;
 	}
 
-	shader->uniforms = vec_expand(shader->uniforms, shader->uniform_count);
-	shader->uniforms[shader->uniform_count++] = uniform;
+	if (root->uniforms[id] != uniform) {
+		uniform_grab(uniform);
+
+		if (root->uniforms[id])
+			uniform_ungrab(root->uniforms[id]);
+
+		root->uniforms[id] = uniform;
+	}
+
+	/* If one of the shader's variants is drawing, it gets the value. */
+	if (current_shader && shader_root(current_shader) == root)
+		shader = current_shader;
+	else
+		shader = shader_resolve(shader);
+
+	if (shader)
+		shader_sync_uniform(shader, uniform);
 }
 
 /**
@@ -326,5 +1194,17 @@ shader_set_uniform(shader_t *shader, uniform_t *uniform)
 void
 shader_set_temp_uniform(uniform_t *uniform)
 {
-	shader_apply_uniform(current_shader, uniform);
+	GLint loc;
+
+	if (! current_shader)
+		return;
+
+	loc = shader_uniform_location(current_shader, uniform->name_id);
+
+	if (loc < 0)
+		return;
+
+	/* The program no longer holds the stored value for this name, which
+	 * shader_apply_uniform notes by recording this version instead. */
+	shader_apply_uniform(current_shader, uniform, loc);
 }
@@ -28,18 +28,93 @@
 #include "refcount.h"
 #include "uniform.h"
 #include "util.h"
+#include "worker.h"
+
+/* Stages in a program: vertex and fragment. */
+#define SHADER_NUM_STAGES 2
+
+/**
+ * Build state of a shader that isn't ready yet.
+ *
+ * work: Worker job reading the sources.
+ * paths: Source file for each stage.
+ * sources, lengths: Source text for each stage, once read.
+ * error, error_path: errno and file name if reading failed.
+ * submitted: Set once the stages are compiling and the program is linking.
+ * stages: GL shader object for each stage, once submitted.
+ * key: Binary cache key for the program.
+ * defines: NULL-terminated list of defines to insert after #version, or NULL.
+ **/
+struct shader_pending {
+	worker_job_t work;
+	char *paths[SHADER_NUM_STAGES];
+	GLchar *sources[SHADER_NUM_STAGES];
+	GLint lengths[SHADER_NUM_STAGES];
+	int error;
+	const char *error_path;
+	int submitted;
+	GLuint stages[SHADER_NUM_STAGES];
+	uint64_t key;
+	char **defines;
+};
+
+/**
+ * A shader specialised for one vertex format.
+ *
+ * format: The vertex format.
+ * shader: The shader compiled for it.
+ **/
+struct shader_format_variant {
+	vbuf_fmt_t format;
+	struct shader *shader;
+};
 
 /**
  * A shader.
  *
  * gl_handle: The OpenGL designation for the shader.
- * uniforms, uniform_count: Vector of uniforms applied to this shader.
+ * id: Unique for every shader ever created. Unlike gl_handle, never reused.
+ * pending: Build state if the shader is still loading, otherwise NULL.
+ * fallback: Shader to draw with while this one is loading, or NULL.
+ * parent: Shader this is a vertex format variant of, or NULL.
+ * locations, num_locations: Uniform locations in the linked program, indexed
+ *                           by interned uniform name ID. -1 for names the
+ *                           program doesn't use.
+ * uniforms, num_uniforms: Uniforms applied to this shader, indexed by name ID.
+ *                         Format variants use their parent's.
+ * uniform_versions: Version of the value the program holds for each name ID,
+ *                   indexed like locations. Differs from the applied
+ *                   uniform's version when a temporary uniform has
+ *                   overwritten it.
+ * paths: Source files, if this shader can have format variants.
+ * defines: Sorted defines this shader was created with, if it can have format
+ *          variants.
+ * format_variants, num_format_variants: Variants made so far.
+ * last_variant: Variant we last drew with, or NULL.
+ * variant_key, variant_key_len, variant_hash: Key this shader is found by in
+ *                                            the variant cache, or NULL.
  * refcount: Reference counter for this state.
  **/
 typedef struct shader {
 	GLuint gl_handle;
+	uint64_t id;
+	struct shader_pending *pending;
+	struct shader *fallback;
+	struct shader *parent;
+	GLint *locations;
+	size_t num_locations;
 	uniform_t **uniforms;
-	size_t uniform_count;
+	size_t num_uniforms;
+	uint64_t *uniform_versions;
+
+	char *paths[SHADER_NUM_STAGES];
+	char **defines;
+	struct shader_format_variant *format_variants;
+	size_t num_format_variants;
+	struct shader *last_variant;
+	char *variant_key;
+	size_t variant_key_len;
+	uint64_t variant_hash;
 
 	refcounter_t refcount;
 } shader_t;
@@ -49,10 +124,18 @@ extern "C" {
 #endif
 
 API_DECLARE(shader_create);
+API_DECLARE(shader_create_async);
+API_DECLARE(shader_create_variant);
+API_DECLARE(shader_ready);
+API_DECLARE(shader_wait);
+API_DECLARE(shader_set_fallback);
 API_DECLARE(shader_grab);
 API_DECLARE(shader_ungrab);
+API_DECLARE(shader_set_cache_dir);
 
 void shader_activate(shader_t *shader);
+int shader_can_draw(void);
+int shader_select_format(vbuf_fmt_t format);
 void shader_set_uniform(shader_t *shader, uniform_t *uniform);
 void shader_set_temp_uniform(uniform_t *uniform);
 
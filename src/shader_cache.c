@@ -0,0 +1,319 @@
+/**
+ * Copyright © 2013 Casey Dahlin
+ *
+ * This file is part of Luftballons.
+ *
+ * Luftballons is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Luftballons is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "shader.h"
+#include "shader_cache.h"
+#include "util.h"
+
+/**
+ * Header of a cached program binary file. The binary itself follows.
+ *
+ * magic: Always SHADER_CACHE_MAGIC.
+ * format: Binary format the driver gave us.
+ * length: Length of the binary in bytes.
+ **/
+struct shader_cache_header {
+	char magic[4];
+	uint32_t format;
+	uint32_t length;
+};
+
+#define SHADER_CACHE_MAGIC "LFPB"
+
+/**
+ * Directory to keep program binaries in, or NULL if caching is off.
+ **/
+static char *shader_cache_dir = NULL;
+
+/**
+ * Number of program binary formats the driver supports, or -1 if we haven't
+ * asked yet.
+ **/
+static GLint shader_cache_formats = -1;
+
+/**
+ * Set a directory to cache linked program binaries in. Shaders created later
+ * are loaded from the cache when the driver will take them back, which skips
+ * compiling and linking. Pass NULL to turn caching off.
+ **/
+void
+shader_set_cache_dir(const char *dir)
+{
+	free(shader_cache_dir);
+	shader_cache_dir = dir ? xstrdup(dir) : NULL;
+}
+EXPORT(shader_set_cache_dir);
+
+/**
+ * Determine whether we should use the cache.
+ **/
+static int
+shader_cache_enabled(void)
+{
+	if (! shader_cache_dir)
+		return 0;
+
+	if (shader_cache_formats < 0) {
+		shader_cache_formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS,
+			      &shader_cache_formats);
+		CLEAR_GL;
+	}
+
+	return shader_cache_formats > 0;
+}
+
+/**
+ * Add some bytes to a running hash.
+ **/
+static uint64_t
+shader_cache_hash(uint64_t hash, const void *data, size_t len)
+{
+	const unsigned char *bytes = data;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+/**
+ * Add a GL string to a running hash.
+ **/
+static uint64_t
+shader_cache_hash_gl_string(uint64_t hash, GLenum name)
+{
+	const char *str = (const char *)glGetString(name);
+
+	if (! str)
+		str = "";
+
+	return shader_cache_hash(hash, str, strlen(str) + 1);
+}
+
+/**
+ * Compute the cache key for a program built from the given sources. The key
+ * covers the driver too, since binaries don't survive driver changes.
+ **/
+uint64_t
+shader_cache_key(size_t count, const GLchar *const *sources,
+		 const GLint *lengths)
+{
+	uint64_t hash = 14695981039346656037ull;
+	uint64_t len;
+	size_t i;
+
+	hash = shader_cache_hash_gl_string(hash, GL_VENDOR);
+	hash = shader_cache_hash_gl_string(hash, GL_RENDERER);
+	hash = shader_cache_hash_gl_string(hash, GL_VERSION);
+
+	for (i = 0; i < count; i++) {
+		len = lengths[i];
+		hash = shader_cache_hash(hash, &len, sizeof(len));
+		hash = shader_cache_hash(hash, sources[i], lengths[i]);
+	}
+
+	return hash;
+}
+
+/**
+ * Get the path of the cache file for a key. Free the result.
+ **/
+static char *
+shader_cache_path(uint64_t key, const char *suffix)
+{
+	size_t len = strlen(shader_cache_dir) + strlen(suffix) + 32;
+	char *ret = xmalloc(len);
+
+	snprintf(ret, len, "%s/%016" PRIx64 ".bin%s", shader_cache_dir, key,
+		 suffix);
+	return ret;
+}
+
+/**
+ * Prepare a program for linking so we can cache its binary afterward.
+ **/
+void
+shader_cache_prepare(GLuint program)
+{
+	if (! shader_cache_enabled())
+		return;
+
+	glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+			    GL_TRUE);
+	CLEAR_GL;
+}
+
+/**
+ * Read exactly len bytes from a file.
+ *
+ * Returns: 0 on success, -1 on error or early end of file.
+ **/
+static int
+shader_cache_read(int fd, void *buf, size_t len)
+{
+	char *pos = buf;
+	ssize_t got;
+
+	while (len) {
+		got = read(fd, pos, len);
+
+		if (got < 0 && errno == EINTR)
+			continue;
+
+		if (got <= 0)
+			return -1;
+
+		pos += got;
+		len -= got;
+	}
+
+	return 0;
+}
+
+/**
+ * Try to load a program from the cache.
+ *
+ * Returns: 1 if the program was loaded and is linked, 0 if it must be built
+ * from source.
+ **/
+int
+shader_cache_load(GLuint program, uint64_t key)
+{
+	struct shader_cache_header header;
+	struct stat st;
+	char *path;
+	void *data;
+	GLint status = GL_FALSE;
+	int fd;
+
+	if (! shader_cache_enabled())
+		return 0;
+
+	path = shader_cache_path(key, "");
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	free(path);
+
+	if (fd < 0)
+		return 0;
+
+	if (fstat(fd, &st) ||
+	    shader_cache_read(fd, &header, sizeof(header)) ||
+	    memcmp(header.magic, SHADER_CACHE_MAGIC, 4) ||
+	    (off_t)(header.length + sizeof(header)) != st.st_size) {
+		close(fd);
+		return 0;
+	}
+
+	data = xmalloc(header.length);
+
+	if (shader_cache_read(fd, data, header.length)) {
+		close(fd);
+		free(data);
+		return 0;
+	}
+
+	close(fd);
+
+	/* A driver update may reject the binary. That just fails the link. */
+	glProgramBinary(program, header.format, data, header.length);
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	CLEAR_GL;
+	free(data);
+
+	return status != GL_FALSE;
+}
+
+/**
+ * Write a linked program to the cache. Failing to is not an error; we'll just
+ * build the program from source again next time.
+ **/
+void
+shader_cache_store(GLuint program, uint64_t key)
+{
+	struct shader_cache_header header;
+	GLint length = 0;
+	GLenum format;
+	char suffix[32];
+	char *path;
+	char *tmp_path;
+	void *data;
+	FILE *fp;
+	int ok;
+
+	if (! shader_cache_enabled())
+		return;
+
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+
+	if (length <= 0) {
+		CLEAR_GL;
+		return;
+	}
+
+	data = xmalloc(length);
+	glGetProgramBinary(program, length, &length, &format, data);
+
+	if (CLEAR_GL != GL_NO_ERROR || length <= 0) {
+		free(data);
+		return;
+	}
+
+	memcpy(header.magic, SHADER_CACHE_MAGIC, 4);
+	header.format = format;
+	header.length = length;
+
+	if (mkdir(shader_cache_dir, 0777) && errno != EEXIST) {
+		free(data);
+		return;
+	}
+
+	path = shader_cache_path(key, "");
+	snprintf(suffix, sizeof(suffix), ".%ld.tmp", (long)getpid());
+	tmp_path = shader_cache_path(key, suffix);
+	fp = fopen(tmp_path, "wb");
+
+	if (fp) {
+		ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+			fwrite(data, length, 1, fp) == 1;
+		ok = ! fclose(fp) && ok;
+
+		/* Write then rename, so readers never see half a binary. */
+		if (! ok || rename(tmp_path, path))
+			unlink(tmp_path);
+	}
+
+	free(tmp_path);
+	free(path);
+	free(data);
+}
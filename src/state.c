@@ -25,6 +25,19 @@
 
 #include "state.h"
 #include "util.h"
+#include "stats.h"
+#include "gl_state.h"
+
+/* Parts of a state that a change may have touched. */
+#define STATE_CHANGED_SHADER	0x1
+#define STATE_CHANGED_FLAGS	0x2
+#define STATE_CHANGED_BLEND	0x4
+#define STATE_CHANGED_COLORBUF	0x8
+#define STATE_CHANGED_ALL	0xf
+
+#ifndef STATE_AGGREGATE_CACHE_SIZE
+#define STATE_AGGREGATE_CACHE_SIZE 67 /* Next prime from 64 */
+#endif
 
 /**
  * The current state.
@@ -38,14 +51,50 @@ static state_t **state_stack;
 static size_t state_stack_size = 0;
 
 /**
- * Individual material properties.
+ * Next state ID to hand out.
+ **/
+static uint64_t state_next_id = 0;
+
+/**
+ * Cache of aggregated states, so we don't rebuild one every time the same
+ * combination of states ends up on the stack. Entries are keyed by the ID and
+ * version of each stacked state, bottom first.
+ *
+ * hash: Hash of the key.
+ * key, depth: ID/version pairs for each stacked state.
+ * state: The aggregated state, or NULL if this slot is empty.
+ **/
+static struct state_aggregate_entry {
+	uint64_t hash;
+	uint64_t *key;
+	size_t depth;
+	state_t *state;
+} state_aggregate_cache[STATE_AGGREGATE_CACHE_SIZE];
+
+/**
+ * Individual material properties. A state's materials are a dense array
+ * indexed by state_material_slot(); a material with no uniforms is unset.
+ * Uniforms are indexed by interned name ID, with NULL for names the material
+ * doesn't set, so num_uniforms is the length of the array rather than a count.
  **/
 struct material {
 	uniform_t **uniforms;
 	size_t num_uniforms;
-	material_t mat;
 };
 
+/**
+ * Index of a material in a state's material array. NO_MATERIAL gets slot 0,
+ * and everything else follows in ID order.
+ **/
+static inline size_t
+state_material_slot(material_t mat)
+{
+	if (mat == NO_MATERIAL)
+		return 0;
+
+	return mat + 1;
+}
+
 /**
  * The current material
  **/
@@ -61,29 +110,199 @@ state_destroy_material(struct material *material)
 	size_t i;
 
 	for (i = 0; i < material->num_uniforms; i++)
-		uniform_ungrab(material->uniforms[i]);
+		if (material->uniforms[i])
+			uniform_ungrab(material->uniforms[i]);
 
 	free(material->uniforms);
 }
 
 /**
- * Destroy a state object. Don't defer until the state is no longer active.
+ * Get the slot in a material which holds the uniform with the given name ID,
+ * growing the material if needed.
+ **/
+static uniform_t **
+state_material_uniform_slot(struct material *material, size_t name_id)
+{
+	size_t i;
+
+	if (name_id < material->num_uniforms)
+		return &material->uniforms[name_id];
+
+	material->uniforms = xrealloc(material->uniforms,
+				      (name_id + 1) * sizeof(uniform_t *));
+
+	for (i = material->num_uniforms; i <= name_id; i++)
+		material->uniforms[i] = NULL;
+
+	material->num_uniforms = name_id + 1;
+	return &material->uniforms[name_id];
+}
+
+/**
+ * Drop an entry from the aggregate cache.
  **/
 static void
-state_destructor(void *data)
+state_aggregate_cache_drop(struct state_aggregate_entry *entry)
+{
+	state_t *state = entry->state;
+
+	if (! state)
+		return;
+
+	/* Clear the slot first; the ungrab may recurse back in here. */
+	entry->state = NULL;
+	entry->depth = 0;
+	free(entry->key);
+	entry->key = NULL;
+
+	state_ungrab(state);
+}
+
+/**
+ * Drop all aggregate cache entries built from the given state.
+ **/
+static void
+state_aggregate_cache_evict(state_t *state)
+{
+	size_t i, j;
+	struct state_aggregate_entry *entry;
+
+	for (i = 0; i < STATE_AGGREGATE_CACHE_SIZE; i++) {
+		entry = &state_aggregate_cache[i];
+
+		for (j = 0; j < entry->depth; j++)
+			if (entry->key[2 * j] == state->id)
+				break;
+
+		if (j < entry->depth)
+			state_aggregate_cache_drop(entry);
+	}
+}
+
+/**
+ * Note that a state has been modified.
+ **/
+static void
+state_mutated(state_t *state)
+{
+	state->version++;
+	state_aggregate_cache_evict(state);
+}
+
+/**
+ * Drop this state's reference to its materials, destroying them if no other
+ * state shares them.
+ **/
+static void
+state_materials_release(state_t *state)
 {
 	size_t i;
-	state_t *state = data;
+
+	if (--*state->materials_refs)
+		return;
 
 	for (i = 0; i < state->num_materials; i++)
 		state_destroy_material(&state->materials[i]);
 
+	free(state->materials);
+	free(state->materials_refs);
+}
+
+/**
+ * Start sharing another state's materials in place of our own.
+ **/
+static void
+state_materials_share(state_t *state, state_t *other)
+{
+	state_materials_release(state);
+
+	state->materials = other->materials;
+	state->num_materials = other->num_materials;
+	state->materials_refs = other->materials_refs;
+	(*state->materials_refs)++;
+}
+
+/**
+ * Clone a material struct.
+ **/
+static void
+state_material_clone(struct material *material)
+{
+	size_t i;
+
+	if (! material->num_uniforms) {
+		material->uniforms = NULL;
+		return;
+	}
+
+	material->uniforms = vec_dup(material->uniforms,
+				     material->num_uniforms);
+
+	for (i = 0; i < material->num_uniforms; i++)
+		if (material->uniforms[i])
+			uniform_grab(material->uniforms[i]);
+}
+
+/**
+ * Make sure no other state shares our materials, so we may modify them.
+ **/
+static void
+state_materials_own(state_t *state)
+{
+	size_t i;
+
+	if (*state->materials_refs == 1)
+		return;
+
+	(*state->materials_refs)--;
+
+	state->materials = vec_dup(state->materials, state->num_materials);
+	state->materials_refs = xmalloc(sizeof(size_t));
+	*state->materials_refs = 1;
+
+	for (i = 0; i < state->num_materials; i++)
+		state_material_clone(&state->materials[i]);
+}
+
+/**
+ * Make sure this state has a slot for the given material, and that we may
+ * modify it. Returns the material.
+ **/
+static struct material *
+state_material_reserve(state_t *state, material_t mat)
+{
+	size_t slot = state_material_slot(mat);
+
+	state_materials_own(state);
+
+	if (slot < state->num_materials)
+		return &state->materials[slot];
+
+	state->materials = xrealloc(state->materials,
+				    (slot + 1) * sizeof(struct material));
+	memset(&state->materials[state->num_materials], 0,
+	       (slot + 1 - state->num_materials) * sizeof(struct material));
+	state->num_materials = slot + 1;
+
+	return &state->materials[slot];
+}
+
+/**
+ * Destroy a state object. Don't defer until the state is no longer active.
+ **/
+static void
+state_destructor(void *data)
+{
+	state_t *state = data;
+
+	state_aggregate_cache_evict(state);
+	state_materials_release(state);
+
 	if (state->colorbuf)
 		colorbuf_ungrab(state->colorbuf);
 
 	material_backlog_unsubscribe(state->material_gen);
 
-	free(state->materials);
 	free(state);
 }
 
@@ -98,7 +317,11 @@ state_create(void)
 	state->blend_mode = STATE_BLEND_DONTCARE;
 	state->num_materials = 0;
 	state->materials = NULL;
+	state->materials_refs = xmalloc(sizeof(size_t));
+	*state->materials_refs = 1;
 	state->material_gen = material_backlog_subscribe();
+	state->id = state_next_id++;
+	state->version = 0;
 
 	refcount_init(&state->refcount);
 	refcount_add_destructor(&state->refcount, state_destructor, state);
@@ -106,40 +329,24 @@ state_create(void)
 	return state;
 }
 
-/**
- * Set a state object's shader.
- **/
-void
-state_set_shader(state_t *state, shader_t *shader)
-{
-	if (state->shader)
-		shader_ungrab(state->shader);
-
-	if (shader)
-		shader_grab(shader);
-
-	state->shader = shader;
-}
-
 /**
  * Remove a material from this state. Don't check if it is valid first.
  **/
 static void
 state_do_material_eliminate(state_t *state, material_t mat)
 {
-	size_t i;
-
-	for (i = 0; i < state->num_materials; i++)
-		if (state->materials[i].mat == mat)
-			break;
+	size_t slot = state_material_slot(mat);
+	struct material *material;
 
-	if (i == state->num_materials)
+	if (slot >= state->num_materials ||
+	    ! state->materials[slot].num_uniforms)
 		return;
 
-	state_destroy_material(&state->materials[i]);
-
-	state->materials = vec_del(state->materials, state->num_materials, i);
-	state->num_materials--;
+	material = state_material_reserve(state, mat);
+	state_destroy_material(material);
+	material->uniforms = NULL;
+	material->num_uniforms = 0;
+	state_mutated(state);
 }
 
 /**
@@ -148,7 +355,7 @@ state_do_material_eliminate(state_t *state, material_t mat)
 static void
 state_sync_mat_backlog(state_t *state)
 {
-	material_t *backlog;
+	const material_t *backlog;
 	size_t num_backlog;
 	size_t i;
 
@@ -157,46 +364,28 @@ state_sync_mat_backlog(state_t *state)
 
 	for (i = 0; i < num_backlog; i++)
 		state_do_material_eliminate(state, backlog[i]);
-
-	free(backlog);
-}
-
-/**
- * Clone a material struct.
- **/
-static void
-state_material_clone(struct material *material)
-{
-	size_t i;
-
-	material->uniforms = vec_dup(material->uniforms,
-				     material->num_uniforms);
-
-	for (i = 0; i < material->num_uniforms; i++)
-		uniform_grab(material->uniforms[i]);
 }
 
 /**
- * Create a new state with the same properties as an existing state.
+ * Create a new state with the same properties as an existing state. The
+ * materials are shared until one of the two states modifies them.
  **/
 state_t *
 state_clone(state_t *in)
 {
 	state_t *state = xmalloc(sizeof(state_t));
-	size_t i;
 
+	state_sync_mat_backlog(in);
 	memcpy(state, in, sizeof(state_t));
 
-	state_sync_mat_backlog(in);
 	state->material_gen = material_backlog_subscribe();
+	state->id = state_next_id++;
+	state->version = 0;
 
 	if (state->colorbuf)
 		colorbuf_grab(state->colorbuf);
 
-	state->materials = vec_dup(in->materials, in->num_materials);
-
-	for (i = 0; i < state->num_materials; i++)
-		state_material_clone(&state->materials[i]);
+	(*state->materials_refs)++;
 
 	refcount_init(&state->refcount);
 	refcount_add_destructor(&state->refcount, state_destructor, state);
@@ -227,11 +416,7 @@ state_ungrab(state_t *state)
 static void
 state_set_depth_test(state_t *state)
 {
-	if (state->flags & STATE_DEPTH_TEST)
-		glEnable(GL_DEPTH_TEST);
-	else
-		glDisable(GL_DEPTH_TEST);
-
+	gl_state_set_cap(GL_DEPTH_TEST, state->flags & STATE_DEPTH_TEST);
 	CHECK_GL;
 }
 
@@ -241,12 +426,11 @@ state_set_depth_test(state_t *state)
 static void
 state_set_bf_cull(state_t *state)
 {
+	gl_state_set_cap(GL_CULL_FACE, state->flags & STATE_BF_CULL);
+
 	if (state->flags & STATE_BF_CULL) {
-		glEnable(GL_CULL_FACE);
-		glCullFace(GL_BACK);
-		glFrontFace(GL_CCW);
-	} else {
-		glDisable(GL_CULL_FACE);
+		gl_state_cull_face(GL_BACK);
+		gl_state_front_face(GL_CCW);
 	}
 
 	CHECK_GL;
@@ -256,28 +440,19 @@ state_set_bf_cull(state_t *state)
  * Apply this state's blend mode to OpenGL.
  **/
 static void
-state_apply_blend_mode(state_t *state, state_blend_mode_t old)
+state_apply_blend_mode(state_t *state)
 {
 	if (state->blend_mode == STATE_BLEND_DONTCARE)
 		return;
 
-	if (state->blend_mode == old)
-		return;
-
-	if (state->blend_mode == STATE_BLEND_NONE) {
-		glDisable(GL_BLEND);
-		return;
-	}
-
-	if (old == STATE_BLEND_NONE || old == STATE_BLEND_DONTCARE)
-		glEnable(GL_BLEND);
+	gl_state_set_cap(GL_BLEND, state->blend_mode != STATE_BLEND_NONE);
 
 	if (state->blend_mode == STATE_BLEND_ALPHA)
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		gl_state_blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	else if (state->blend_mode == STATE_BLEND_ADDITIVE)
-		glBlendFunc(GL_ONE, GL_ONE);
+		gl_state_blend_func(GL_ONE, GL_ONE);
 	else if (state->blend_mode == STATE_BLEND_REVERSE_ALPHA)
-		glBlendFunc(GL_ONE_MINUS_DST_ALPHA, GL_DST_ALPHA);
+		gl_state_blend_func(GL_ONE_MINUS_DST_ALPHA, GL_DST_ALPHA);
 }
 
 /**
@@ -298,6 +473,8 @@ state_material_eliminate(state_t *state, material_t mat)
 static void
 state_do_material_activate(material_t mat)
 {
+	size_t slots[2] = { 0, state_material_slot(mat) };
+	struct material *material;
 	size_t i, j;
 
 	current_material = mat;
@@ -310,15 +487,20 @@ state_do_material_activate(material_t mat)
 	if (! current_state->shader)
 		return;
 
-	for (i = 0; i < current_state->num_materials; i++) {
-		if (current_state->materials[i].mat != current_material &&
-		    current_state->materials[i].mat != NO_MATERIAL)
+	/* Material uniforms override the NO_MATERIAL ones, so go second. */
+	for (i = 0; i < 2; i++) {
+		if (i && slots[i] == 0)
+			break;
+
+		if (slots[i] >= current_state->num_materials)
 			continue;
 
-		for (j = 0; j < current_state->materials[i].num_uniforms; j++)
-			shader_set_uniform(current_state->shader,
-					   current_state->materials[i]
-					   .uniforms[j]);
+		material = &current_state->materials[slots[i]];
+
+		for (j = 0; j < material->num_uniforms; j++)
+			if (material->uniforms[j])
+				shader_set_uniform(current_state->shader,
+						   material->uniforms[j]);
 	}
 }
 
@@ -334,40 +516,45 @@ state_material_activate(material_t mat)
 	state_do_material_activate(mat);
 }
 
+/**
+ * Apply the given parts of a state to OpenGL.
+ **/
+static void
+state_apply(state_t *state, unsigned int changed)
+{
+	if ((changed & STATE_CHANGED_SHADER) && state->shader)
+		shader_activate(state->shader);
+
+	/* The GL state shadow drops anything that wouldn't change. */
+	if ((changed & STATE_CHANGED_FLAGS) &&
+	    (state->care_about & STATE_DEPTH_TEST))
+		state_set_depth_test(state);
+
+	if ((changed & STATE_CHANGED_FLAGS) &&
+	    (state->care_about & STATE_BF_CULL))
+		state_set_bf_cull(state);
+
+	if (changed & STATE_CHANGED_BLEND)
+		state_apply_blend_mode(state);
+
+	if (changed & STATE_CHANGED_COLORBUF)
+		colorbuf_prep(state->colorbuf);
+}
+
 /**
  * Enter the given state.
  **/
 static void
 state_enter(state_t *state)
 {
-	uint64_t change_flags = state->care_about;
-	state_blend_mode_t old = STATE_BLEND_DONTCARE;
-
 	if (current_state == state)
 		return;
 
 	state_sync_mat_backlog(state);
+	stats_count_state_change();
 
 	state_grab(state);
-
-	if (state->shader)
-		shader_activate(state->shader);
-
-	if (current_state) {
-		change_flags = current_state->flags ^ state->flags;
-		change_flags |= ~current_state->care_about;
-		change_flags &= state->care_about;
-		old = current_state->blend_mode;
-	}
-
-	if (change_flags & STATE_DEPTH_TEST)
-		state_set_depth_test(state);
-
-	if (change_flags & STATE_BF_CULL)
-		state_set_bf_cull(state);
-	
-	state_apply_blend_mode(state, old);
-	colorbuf_prep(state->colorbuf);
+	state_apply(state, STATE_CHANGED_ALL);
 
 	if (current_state)
 		state_ungrab(current_state);
@@ -377,28 +564,44 @@ state_enter(state_t *state)
 	state_do_material_activate(current_material);
 }
 
+/**
+ * Note that part of a state has changed. If the state is current, only the
+ * parts that changed are applied to OpenGL.
+ **/
+static void
+state_changed(state_t *state, unsigned int changed)
+{
+	state_mutated(state);
+
+	if (state != current_state)
+		return;
+
+	state_apply(state, changed);
+
+	if (changed & STATE_CHANGED_SHADER)
+		state_do_material_activate(current_material);
+}
+
 /**
  * Add all uniforms to orig that are in other and don't collide.
  **/
 static void
 state_material_underlay_in(struct material *orig, struct material *other)
 {
-	size_t i, j;
+	uniform_t **slot;
+	size_t i;
 
 	for (i = 0; i < other->num_uniforms; i++) {
-		for (j = 0; j < orig->num_uniforms; j++)
-			if (! strcmp(orig->uniforms[j]->name,
-				     other->uniforms[i]->name))
-				break;
-
-		if (j != orig->num_uniforms)
+		if (! other->uniforms[i])
 			continue;
 
-		orig->uniforms = vec_expand(orig->uniforms,
-					    orig->num_uniforms);
+		slot = state_material_uniform_slot(orig, i);
 
-		orig->uniforms[orig->num_uniforms++] = other->uniforms[i];
-		uniform_grab(other->uniforms[i]);
+		if (*slot)
+			continue;
+
+		*slot = other->uniforms[i];
+		uniform_grab(*slot);
 	}
 }
 
@@ -409,26 +612,34 @@ state_material_underlay_in(struct material *orig, struct material *other)
 static void
 state_underlay_materials(state_t *state, state_t *other)
 {
-	size_t i, j;
+	struct material *material;
+	size_t i;
+
+	if (! other->num_materials)
+		return;
+
+	if (! state->num_materials) {
+		state_materials_share(state, other);
+		return;
+	}
+
+	state_materials_own(state);
 
 	for (i = 0; i < other->num_materials; i++) {
-		for (j = 0; j < state->num_materials; j++)
-			if (state->materials[j].mat ==
-			    other->materials[i].mat)
-				break;
+		if (! other->materials[i].num_uniforms)
+			continue;
+
+		/* Slot i belongs to material i - 1; NO_MATERIAL wraps. */
+		material = state_material_reserve(state, i - 1);
 
-		if (j != state->num_materials) {
-			state_material_underlay_in(&state->materials[j],
+		if (material->num_uniforms) {
+			state_material_underlay_in(material,
 						   &other->materials[i]);
 			continue;
 		}
 
-		state->materials = vec_add(state->materials,
-					   state->num_materials, j,
-					   other->materials[i]);
-		state->num_materials++;
-
-		state_material_clone(&state->materials[j]);
+		*material = other->materials[i];
+		state_material_clone(material);
 	}
 }
 
@@ -473,13 +684,55 @@ state_underlay(state_t *state, state_t *other)
 		state->blend_mode = other->blend_mode;
 }
 
+/**
+ * Hash the ID and version of each state on the stack.
+ **/
+static uint64_t
+state_stack_hash(void)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	size_t i;
+
+	for (i = 0; i < state_stack_size; i++) {
+		hash ^= state_stack[i]->id;
+		hash *= 1099511628211ULL;
+		hash ^= state_stack[i]->version;
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+/**
+ * Determine if a cache entry was built from the current state stack.
+ **/
+static int
+state_aggregate_entry_matches(struct state_aggregate_entry *entry,
+			      uint64_t hash)
+{
+	size_t i;
+
+	if (! entry->state || entry->hash != hash ||
+	    entry->depth != state_stack_size)
+		return 0;
+
+	for (i = 0; i < state_stack_size; i++)
+		if (entry->key[2 * i] != state_stack[i]->id ||
+		    entry->key[2 * i + 1] != state_stack[i]->version)
+			return 0;
+
+	return 1;
+}
+
 /**
  * Compile the state stack into a single state and enter it.
  **/
 static void
 state_stack_aggregate(void)
 {
+	struct state_aggregate_entry *entry;
 	state_t *state;
+	uint64_t hash;
 	size_t i;
 
 	if (! state_stack_size)
@@ -490,13 +743,37 @@ state_stack_aggregate(void)
 		return;
 	}
 
+	/* Syncing may modify the states, so do it before we build the key. */
+	for (i = 0; i < state_stack_size; i++)
+		state_sync_mat_backlog(state_stack[i]);
+
+	hash = state_stack_hash();
+	entry = &state_aggregate_cache[hash % STATE_AGGREGATE_CACHE_SIZE];
+
+	if (state_aggregate_entry_matches(entry, hash)) {
+		state_enter(entry->state);
+		return;
+	}
+
 	state = state_create();
 
 	for (i = state_stack_size; i; i--)
 		state_underlay(state, state_stack[i - 1]);
 
+	state_aggregate_cache_drop(entry);
+
+	entry->key = xcalloc(2 * state_stack_size, sizeof(uint64_t));
+
+	for (i = 0; i < state_stack_size; i++) {
+		entry->key[2 * i] = state_stack[i]->id;
+		entry->key[2 * i + 1] = state_stack[i]->version;
+	}
+
+	entry->hash = hash;
+	entry->depth = state_stack_size;
+	entry->state = state;
+
 	state_enter(state);
-	state_ungrab(state);
 }
 
 /**
@@ -557,35 +834,19 @@ state_pop(state_t *state, material_t mat)
 }
 
 /**
- * Protect the state in case it is the current state and we need to modify it.
+ * Set a state object's shader.
  **/
-static void
-state_protect(state_t *state, int *needs_it)
+void
+state_set_shader(state_t *state, shader_t *shader)
 {
-	state_t *tmp;
-
-	*needs_it = (state == current_state);
-
-	if (! *needs_it)
-		return;
-
-	state_grab(state);
-	tmp = state_clone(state);
-	state_enter(tmp);
-	state_ungrab(tmp);
-}
+	if (state->shader)
+		shader_ungrab(state->shader);
 
-/**
- * Undo a state_protect call.
- **/
-static void
-state_unprotect(state_t *state, int needed_it)
-{
-	if (! needed_it)
-		return;
+	if (shader)
+		shader_grab(shader);
 
-	state_enter(state);
-	state_ungrab(state);
+	state->shader = shader;
+	state_changed(state, STATE_CHANGED_SHADER);
 }
 
 /**
@@ -594,14 +855,9 @@ state_unprotect(state_t *state, int needed_it)
 void
 state_set_flags(state_t *state, uint64_t flags)
 {
-	int needed_it;
-
-	state_protect(state, &needed_it);
-
 	state->flags |= flags;
 	state->care_about |= flags;
-
-	state_unprotect(state, needed_it);
+	state_changed(state, STATE_CHANGED_FLAGS);
 }
 
 /**
@@ -610,14 +866,9 @@ state_set_flags(state_t *state, uint64_t flags)
 void
 state_clear_flags(state_t *state, uint64_t flags)
 {
-	int needed_it;
-
-	state_protect(state, &needed_it);
-
 	state->flags &= ~flags;
 	state->care_about |= flags;
-
-	state_unprotect(state, needed_it);
+	state_changed(state, STATE_CHANGED_FLAGS);
 }
 
 /**
@@ -626,13 +877,8 @@ state_clear_flags(state_t *state, uint64_t flags)
 void
 state_ignore_flags(state_t *state, uint64_t flags)
 {
-	int needed_it;
-
-	state_protect(state, &needed_it);
-
 	state->care_about &= ~flags;
-
-	state_unprotect(state, needed_it);
+	state_changed(state, STATE_CHANGED_FLAGS);
 }
 
 /**
@@ -641,17 +887,12 @@ state_ignore_flags(state_t *state, uint64_t flags)
 void
 state_set_colorbuf(state_t *state, colorbuf_t *colorbuf)
 {
-	int needed_it;
-
-	state_protect(state, &needed_it);
-
 	if (state->colorbuf)
 		colorbuf_ungrab(state->colorbuf);
 
 	colorbuf_grab(colorbuf);
 	state->colorbuf = colorbuf;
-
-	state_unprotect(state, needed_it);
+	state_changed(state, STATE_CHANGED_COLORBUF);
 }
 
 /**
@@ -660,8 +901,8 @@ state_set_colorbuf(state_t *state, colorbuf_t *colorbuf)
 void
 state_set_uniform(state_t *state, material_t mat, uniform_type_t type, ...)
 {
-	size_t i;
 	uniform_t *uniform;
+	uniform_t **slot;
 	struct material *material;
 	va_list ap;
 
@@ -677,33 +918,14 @@ state_set_uniform(state_t *state, material_t mat, uniform_type_t type, ...)
 
 	va_end(ap);
 
-	for (i = 0; i < state->num_materials; i++)
-		if (state->materials[i].mat == mat)
-			break;
-
-	if (i == state->num_materials) {
-		state->materials = vec_expand(state->materials,
-					      state->num_materials);
-		state->num_materials++;
-		state->materials[i].uniforms = NULL;
-		state->materials[i].num_uniforms = 0;
-		state->materials[i].mat = mat;
-	}
-
-	material = &state->materials[i];
+	material = state_material_reserve(state, mat);
+	slot = state_material_uniform_slot(material, uniform->name_id);
 
-	for (i = 0; i < material->num_uniforms; i++) {
-		if (strcmp(material->uniforms[i]->name, uniform->name))
-			continue;
+	if (*slot)
+		uniform_ungrab(*slot);
 
-		uniform_ungrab(material->uniforms[i]);
-		material->uniforms[i] = uniform;
-		return;
-	}
-
-	material->uniforms = vec_expand(material->uniforms,
-					material->num_uniforms);
-	material->uniforms[material->num_uniforms++] = uniform;
+	*slot = uniform;
+	state_mutated(state);
 
 	if (state == current_state && mat == current_material)
 		shader_set_uniform(state->shader, uniform);
@@ -724,11 +946,6 @@ state_material_active(material_t mat)
 void
 state_set_blend(state_t *state, state_blend_mode_t mode)
 {
-	int needed_it;
-
-	state_protect(state, &needed_it);
-
 	state->blend_mode = mode;
-
-	state_unprotect(state, needed_it);
+	state_changed(state, STATE_CHANGED_BLEND);
 }
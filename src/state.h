@@ -50,7 +50,11 @@ struct material;
  * colorbuf: Color buffer to render to.
  * shader: Shader to load in this state.
  * material_gen: Material backlog generation.
- * material, num_materials: The materials we draw.
+ * material, num_materials: The materials we draw. Shared with clones of this
+ *                          state until one of them modifies them.
+ * materials_refs: Number of states sharing materials.
+ * id: Unique identifier for this state. Never reused.
+ * version: Bumped every time the state is modified.
  * refcount: Reference counter.
  **/
 typedef struct state {
@@ -61,7 +65,10 @@ typedef struct state {
 	size_t material_gen;
 	struct material *materials;
 	size_t num_materials;
+	size_t *materials_refs;
 	state_blend_mode_t blend_mode;
+	uint64_t id;
+	uint64_t version;
 	refcounter_t refcount;
 } state_t;
 
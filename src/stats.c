@@ -0,0 +1,476 @@
+/**
+ * Copyright © 2013 Casey Dahlin
+ *
+ * This file is part of Luftballons.
+ *
+ * Luftballons is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Luftballons is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <err.h>
+
+#include <GL/gl.h>
+
+#include "stats.h"
+#include "util.h"
+
+/* Frames we let go by before asking the driver about a pass's GPU timing. */
+#ifndef STATS_GPU_LATENCY
+#define STATS_GPU_LATENCY 3
+#endif
+
+/* Cap on recorded passes, so a forgotten trace can't eat all our memory. */
+#ifndef STATS_MAX_EVENTS
+#define STATS_MAX_EVENTS (1 << 20)
+#endif
+
+/**
+ * A single timed pass.
+ *
+ * name: Interned name of the pass.
+ * depth: How many passes this one is nested in.
+ * frame: Frame number the pass ran in.
+ * cpu_start, cpu_end: CPU clock at the start and end of the pass.
+ * queries: Timestamp queries bracketing the pass in the command stream.
+ * gpu_start, gpu_end: GPU clock at the start and end of the pass.
+ * gpu_pending: Set until the query results have been read back.
+ **/
+struct stats_event {
+	const char *name;
+	size_t depth;
+	size_t frame;
+	uint64_t cpu_start;
+	uint64_t cpu_end;
+	GLuint queries[2];
+	uint64_t gpu_start;
+	uint64_t gpu_end;
+	int gpu_pending;
+};
+
+/**
+ * Counters for the frame in progress, and for the last complete frame.
+ **/
+stats_counters_t stats_frame;
+static stats_counters_t stats_last_frame;
+
+static int stats_enabled = 0;
+static size_t stats_frame_num = 0;
+static size_t stats_depth = 0;
+
+/**
+ * Every pass recorded since the last reset, in the order they began.
+ **/
+static struct stats_event *events = NULL;
+static size_t num_events = 0;
+
+/**
+ * Index of the first event whose GPU timing hasn't been read back.
+ **/
+static size_t first_pending = 0;
+
+/**
+ * Query objects that are free to be reused.
+ **/
+static GLuint *free_queries = NULL;
+static size_t num_free_queries = 0;
+
+/**
+ * Passes from the newest frame whose timings are all known.
+ **/
+static stats_pass_t *passes = NULL;
+static size_t num_passes = 0;
+static size_t passes_frame = SIZE_T_MAX;
+
+/**
+ * Interned pass names.
+ **/
+static char **names = NULL;
+static size_t num_names = 0;
+
+/**
+ * Simultaneous readings of the CPU and GPU clocks, so we can put both on one
+ * timeline.
+ **/
+static uint64_t cpu_base = 0;
+static uint64_t gpu_base = 0;
+
+/**
+ * Read the CPU clock in nanoseconds.
+ **/
+static uint64_t
+stats_cpu_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Get a copy of a pass name that will live as long as the library does.
+ **/
+const char *
+stats_intern_name(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < num_names; i++)
+		if (! strcmp(names[i], name))
+			return names[i];
+
+	names = vec_expand(names, num_names);
+	names[num_names] = xstrdup(name);
+
+	return names[num_names++];
+}
+
+/**
+ * Get an unused query object.
+ **/
+static GLuint
+stats_query_get(void)
+{
+	GLuint ret;
+
+	if (num_free_queries)
+		return free_queries[--num_free_queries];
+
+	glGenQueries(1, &ret);
+	return ret;
+}
+
+/**
+ * Return a query object to the free list.
+ **/
+static void
+stats_query_put(GLuint query)
+{
+	free_queries = vec_expand(free_queries, num_free_queries);
+	free_queries[num_free_queries++] = query;
+}
+
+/**
+ * Turn pass timing on or off. Counters are always kept.
+ **/
+void
+stats_enable(int enable)
+{
+	GLint64 gpu_now;
+
+	if (enable && ! stats_enabled) {
+		glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+		cpu_base = stats_cpu_now();
+		gpu_base = gpu_now;
+		CHECK_GL;
+	}
+
+	stats_enabled = enable;
+}
+EXPORT(stats_enable);
+
+/**
+ * Mark the start of a pass.
+ *
+ * Returns: A handle to pass to stats_pass_end.
+ **/
+size_t
+stats_pass_begin(const char *name)
+{
+	static int warned = 0;
+	struct stats_event *ev;
+
+	if (! stats_enabled)
+		return STATS_NO_PASS;
+
+	if (num_events >= STATS_MAX_EVENTS) {
+		if (! warned)
+			warnx("Too many passes recorded, "
+			      "not timing any more until reset");
+		warned = 1;
+		return STATS_NO_PASS;
+	}
+
+	events = vec_expand(events, num_events);
+	ev = &events[num_events];
+
+	ev->name = name;
+	ev->depth = stats_depth++;
+	ev->frame = stats_frame_num;
+	ev->queries[0] = stats_query_get();
+	ev->queries[1] = stats_query_get();
+	ev->gpu_pending = 1;
+
+	glQueryCounter(ev->queries[0], GL_TIMESTAMP);
+	ev->cpu_start = stats_cpu_now();
+
+	return num_events++;
+}
+
+/**
+ * Mark the end of a pass.
+ **/
+void
+stats_pass_end(size_t pass)
+{
+	struct stats_event *ev;
+
+	if (pass == STATS_NO_PASS)
+		return;
+
+	ev = &events[pass];
+	ev->cpu_end = stats_cpu_now();
+	glQueryCounter(ev->queries[1], GL_TIMESTAMP);
+	stats_depth--;
+}
+
+/**
+ * Collect GPU timings for passes old enough that they've likely finished.
+ * Never waits on the GPU.
+ **/
+static void
+stats_poll(void)
+{
+	struct stats_event *ev;
+	GLint avail;
+
+	for (; first_pending < num_events; first_pending++) {
+		ev = &events[first_pending];
+
+		if (! ev->gpu_pending)
+			continue;
+
+		if (ev->frame + STATS_GPU_LATENCY > stats_frame_num)
+			break;
+
+		glGetQueryObjectiv(ev->queries[1], GL_QUERY_RESULT_AVAILABLE,
+				   &avail);
+
+		if (! avail)
+			break;
+
+		glGetQueryObjectui64v(ev->queries[0], GL_QUERY_RESULT,
+				      (GLuint64 *)&ev->gpu_start);
+		glGetQueryObjectui64v(ev->queries[1], GL_QUERY_RESULT,
+				      (GLuint64 *)&ev->gpu_end);
+
+		stats_query_put(ev->queries[0]);
+		stats_query_put(ev->queries[1]);
+		ev->gpu_pending = 0;
+	}
+
+	CHECK_GL;
+}
+
+/**
+ * Rebuild the pass list from the newest frame that is fully timed.
+ **/
+static void
+stats_build_passes(void)
+{
+	size_t end = first_pending;
+	size_t start;
+	size_t frame;
+	size_t i;
+
+	if (! end)
+		return;
+
+	frame = events[end - 1].frame;
+
+	if (end < num_events && events[end].frame == frame) {
+		while (end && events[end - 1].frame == frame)
+			end--;
+
+		if (! end)
+			return;
+
+		frame = events[end - 1].frame;
+	}
+
+	if (frame == passes_frame)
+		return;
+
+	for (start = end; start && events[start - 1].frame == frame; start--);
+
+	free(passes);
+	passes = xcalloc(end - start, sizeof(stats_pass_t));
+	num_passes = end - start;
+	passes_frame = frame;
+
+	for (i = 0; i < num_passes; i++) {
+		passes[i].name = events[start + i].name;
+		passes[i].depth = events[start + i].depth;
+		passes[i].cpu_ms = (events[start + i].cpu_end -
+				    events[start + i].cpu_start) / 1e6;
+		passes[i].gpu_ms = (events[start + i].gpu_end -
+				    events[start + i].gpu_start) / 1e6;
+	}
+}
+
+/**
+ * Mark the end of a frame. Counters roll over, and timings from a few frames
+ * back are collected.
+ **/
+void
+stats_frame_end(void)
+{
+	stats_last_frame = stats_frame;
+	memset(&stats_frame, 0, sizeof(stats_frame));
+	stats_frame_num++;
+
+	if (first_pending == num_events)
+		return;
+
+	stats_poll();
+	stats_build_passes();
+}
+EXPORT(stats_frame_end);
+
+/**
+ * Get the counters for the last complete frame.
+ **/
+void
+stats_get_counters(stats_counters_t *out)
+{
+	*out = stats_last_frame;
+}
+EXPORT(stats_get_counters);
+
+/**
+ * Get the pass timings from the newest frame for which they are all known.
+ *
+ * Returns: The number of passes.
+ **/
+size_t
+stats_get_passes(const stats_pass_t **out)
+{
+	*out = passes;
+	return num_passes;
+}
+EXPORT(stats_get_passes);
+
+/**
+ * Write a string as a JSON string literal.
+ **/
+static void
+stats_write_json_string(FILE *fp, const char *str)
+{
+	fputc('"', fp);
+
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\')
+			fprintf(fp, "\\%c", *str);
+		else if ((unsigned char)*str < 0x20)
+			fprintf(fp, "\\u%04x", *str);
+		else
+			fputc(*str, fp);
+	}
+
+	fputc('"', fp);
+}
+
+/**
+ * Write one complete event in Chrome's trace format.
+ **/
+static void
+stats_write_trace_event(FILE *fp, struct stats_event *ev, int tid,
+			uint64_t start, uint64_t end)
+{
+	fprintf(fp, ",\n{\"name\":");
+	stats_write_json_string(fp, ev->name);
+	fprintf(fp, ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+		"\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%zu}}",
+		tid == 1 ? "cpu" : "gpu", tid, start / 1000.0,
+		(end - start) / 1000.0, ev->frame);
+}
+
+/**
+ * Dump all passes recorded since the last reset to a file in Chrome's
+ * trace-event JSON format. CPU and GPU timings appear as separate threads.
+ *
+ * Returns: 0 on success, -1 with errno set on failure.
+ **/
+int
+stats_dump_trace(const char *path)
+{
+	FILE *fp = fopen(path, "w");
+	struct stats_event *ev;
+	size_t i;
+
+	if (! fp)
+		return -1;
+
+	fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	fprintf(fp, "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+		"\"tid\":1,\"args\":{\"name\":\"CPU\"}},");
+	fprintf(fp, "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+		"\"tid\":2,\"args\":{\"name\":\"GPU\"}}");
+
+	for (i = 0; i < num_events; i++) {
+		ev = &events[i];
+
+		stats_write_trace_event(fp, ev, 1, ev->cpu_start - cpu_base,
+					ev->cpu_end - cpu_base);
+
+		if (ev->gpu_pending)
+			continue;
+
+		stats_write_trace_event(fp, ev, 2, ev->gpu_start - gpu_base,
+					ev->gpu_end - gpu_base);
+	}
+
+	fprintf(fp, "\n]}\n");
+
+	if (fclose(fp))
+		return -1;
+
+	return 0;
+}
+EXPORT(stats_dump_trace);
+
+/**
+ * Throw away all recorded passes. Not allowed while a pass is still open,
+ * since its handle refers to the events we'd be throwing away.
+ **/
+void
+stats_reset(void)
+{
+	size_t i;
+
+	if (stats_depth)
+		errx(1, "Cannot reset stats while a pass is being timed");
+
+	for (i = first_pending; i < num_events; i++) {
+		if (! events[i].gpu_pending)
+			continue;
+
+		stats_query_put(events[i].queries[0]);
+		stats_query_put(events[i].queries[1]);
+	}
+
+	free(events);
+	events = NULL;
+	num_events = 0;
+	first_pending = 0;
+
+	free(passes);
+	passes = NULL;
+	num_passes = 0;
+	passes_frame = SIZE_T_MAX;
+}
+EXPORT(stats_reset);
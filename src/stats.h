@@ -0,0 +1,98 @@
+/**
+ * Copyright © 2013 Casey Dahlin
+ *
+ * This file is part of Luftballons.
+ *
+ * Luftballons is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Luftballons is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef STATS_H
+#define STATS_H
+#include <luftballons/stats.h>
+
+#include "util.h"
+
+typedef luft_stats_counters_t stats_counters_t;
+typedef luft_stats_pass_t stats_pass_t;
+
+/* Pass handle returned when instrumentation is off */
+#define STATS_NO_PASS SIZE_T_MAX
+
+/**
+ * Counters for the frame in progress.
+ **/
+extern stats_counters_t stats_frame;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+API_DECLARE(stats_enable);
+API_DECLARE(stats_frame_end);
+API_DECLARE(stats_get_counters);
+API_DECLARE(stats_get_passes);
+API_DECLARE(stats_dump_trace);
+API_DECLARE(stats_reset);
+
+const char *stats_intern_name(const char *name);
+size_t stats_pass_begin(const char *name);
+void stats_pass_end(size_t pass);
+
+#ifdef __cplusplus
+}
+#endif
+
+static inline void
+stats_count_draw(void)
+{
+	stats_frame.draws++;
+}
+
+static inline void
+stats_count_state_change(void)
+{
+	stats_frame.state_changes++;
+}
+
+static inline void
+stats_count_uniform_upload(void)
+{
+	stats_frame.uniform_uploads++;
+}
+
+static inline void
+stats_count_buffer_bytes(size_t bytes)
+{
+	stats_frame.buffer_bytes += bytes;
+}
+
+static inline void
+stats_count_texture_bind(void)
+{
+	stats_frame.texture_binds++;
+}
+
+static inline void
+stats_count_gl_skipped(void)
+{
+	stats_frame.gl_calls_skipped++;
+}
+
+static inline void
+stats_count_stream_stall(void)
+{
+	stats_frame.stream_stalls++;
+}
+
+#endif /* STATS_H */
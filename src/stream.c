@@ -0,0 +1,275 @@
+/**
+ * Copyright © 2013 Casey Dahlin
+ *
+ * This file is part of Luftballons.
+ *
+ * Luftballons is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Luftballons is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdint.h>
+#include <string.h>
+#include <err.h>
+
+#include "stream.h"
+#include "gl_state.h"
+#include "gl_check.h"
+#include "stats.h"
+
+/* Size of the streaming ring, in bytes. */
+#ifndef STREAM_SIZE
+#define STREAM_SIZE (16 << 20)
+#endif
+
+/* Number of pieces the ring is fenced in. At least 3. */
+#ifndef STREAM_CHUNKS
+#define STREAM_CHUNKS 8
+#endif
+
+/* Alignment of each allocation from the ring, in bytes. */
+#ifndef STREAM_ALIGN
+#define STREAM_ALIGN 256
+#endif
+
+/* How long to wait on a fence between checks, in nanoseconds. */
+#ifndef STREAM_WAIT_NS
+#define STREAM_WAIT_NS 1000000
+#endif
+
+#define STREAM_CHUNK_SIZE (STREAM_SIZE / STREAM_CHUNKS)
+
+/**
+ * The streaming ring. It's one buffer, mapped for good, which we write
+ * through from the front to the back and then start again. A chunk is fenced
+ * once an allocation starts past it, since by then the commands reading
+ * everything in it have been issued. We wait on that fence before we write
+ * to the chunk again.
+ *
+ * initialized: Whether we've tried to set the ring up.
+ * buffer: GL buffer holding the ring.
+ * data: Where the buffer is mapped, or NULL if streaming isn't supported.
+ * pos: Where the next allocation starts. Counts up forever; positions in
+ *      the buffer are this modulo STREAM_SIZE.
+ * fenced: First chunk not yet fenced, counted the same way.
+ * entered: Last chunk we've waited for and may write to.
+ * fences: Fence placed when we last moved past each chunk, or NULL.
+ **/
+static struct {
+	int initialized;
+	GLuint buffer;
+	char *data;
+	uint64_t pos;
+	uint64_t fenced;
+	uint64_t entered;
+	GLsync fences[STREAM_CHUNKS];
+} stream;
+
+/**
+ * Create and map the ring, if the context can map buffers persistently.
+ **/
+static void
+stream_init(void)
+{
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+		GL_MAP_COHERENT_BIT;
+	GLint major = 0;
+	GLint minor = 0;
+
+	stream.initialized = 1;
+
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+	if ((major < 4 || (major == 4 && minor < 4)) &&
+	    ! gl_have_extension("GL_ARB_buffer_storage"))
+		return;
+
+	CLEAR_GL_MEM;
+	glGenBuffers(1, &stream.buffer);
+	gl_state_bind_buffer(GL_COPY_READ_BUFFER, stream.buffer);
+	glBufferStorage(GL_COPY_READ_BUFFER, STREAM_SIZE, NULL, flags);
+
+	if (! CHECK_GL_MEM)
+		stream.data = glMapBufferRange(GL_COPY_READ_BUFFER, 0,
+					       STREAM_SIZE, flags);
+
+	if (stream.data)
+		return;
+
+	CLEAR_GL;
+	gl_state_delete_buffer(stream.buffer);
+	stream.buffer = 0;
+}
+
+/**
+ * Fence off a chunk of the ring the GPU has been given everything to read
+ * from.
+ **/
+static void
+stream_fence_chunk(uint64_t chunk)
+{
+	GLsync *fence = &stream.fences[chunk % STREAM_CHUNKS];
+
+	/* A chunk skipped when we wrapped still has its fence from the last
+	 * time around. Fences signal in order, so the new one covers it. */
+	if (*fence)
+		glDeleteSync(*fence);
+
+	*fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+/**
+ * Wait for the GPU to finish with a chunk of the ring before we write to it
+ * again.
+ **/
+static void
+stream_enter_chunk(uint64_t chunk)
+{
+	GLsync *fence = &stream.fences[chunk % STREAM_CHUNKS];
+	GLenum result;
+
+	if (! *fence)
+		return;
+
+	result = glClientWaitSync(*fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+
+	if (result == GL_TIMEOUT_EXPIRED)
+		stats_count_stream_stall();
+
+	while (result == GL_TIMEOUT_EXPIRED)
+		result = glClientWaitSync(*fence, 0, STREAM_WAIT_NS);
+
+	if (result == GL_WAIT_FAILED)
+		errx(1, "Could not wait for the GPU to release stream buffer");
+
+	glDeleteSync(*fence);
+	*fence = NULL;
+}
+
+/**
+ * Get space in the streaming ring for data the GPU will read once, like
+ * vertices or pixels on their way in to another buffer or a texture. The
+ * space stays mapped, and GL sees what's written there without a flush.
+ *
+ * Issue the GL commands that read the space before allocating again. Once
+ * the ring comes back around, the space is reused as soon as the GPU has
+ * finished those commands.
+ *
+ * bytes: Size of the space.
+ * buffer: Set to the GL buffer the space is in.
+ * offset: Set to where in the buffer the space starts.
+ *
+ * Returns: Where to write, or NULL if the context can't map buffers
+ * persistently or bytes is more than the ring can hand out at once.
+ **/
+void *
+stream_alloc(size_t bytes, GLuint *buffer, size_t *offset)
+{
+	uint64_t start;
+	uint64_t first;
+	uint64_t last;
+	uint64_t chunk;
+
+	if (! stream.initialized)
+		stream_init();
+
+	if (! stream.data || ! bytes ||
+	    bytes > STREAM_SIZE - 2 * STREAM_CHUNK_SIZE)
+		return NULL;
+
+	start = (stream.pos + STREAM_ALIGN - 1) & ~(uint64_t)(STREAM_ALIGN - 1);
+
+	/* Don't wrap around the end of the buffer. */
+	if (start % STREAM_SIZE + bytes > STREAM_SIZE)
+		start += STREAM_SIZE - start % STREAM_SIZE;
+
+	first = start / STREAM_CHUNK_SIZE;
+	last = (start + bytes - 1) / STREAM_CHUNK_SIZE;
+
+	/* Earlier allocations have had their commands issued, so every chunk
+	 * before this one is done being read from as far as we know. */
+	for (; stream.fenced < first; stream.fenced++)
+		stream_fence_chunk(stream.fenced);
+
+	/* The size limit keeps an allocation short of a whole lap, so the
+	 * last use of each chunk we run into has been fenced by now. Chunks
+	 * skipped when wrapping aren't written, so we don't wait for them. */
+	chunk = stream.entered + 1 > first ? stream.entered + 1 : first;
+
+	for (; chunk <= last; chunk++)
+		stream_enter_chunk(chunk);
+
+	if (last > stream.entered)
+		stream.entered = last;
+
+	stream.pos = start + bytes;
+
+	*buffer = stream.buffer;
+	*offset = start % STREAM_SIZE;
+	return stream.data + *offset;
+}
+EXPORT(stream_alloc);
+
+/**
+ * Write to part of the buffer bound to target, like glBufferSubData, but
+ * without making the CPU wait if the GPU is still reading the buffer. The
+ * data goes through the ring and the GPU copies it across.
+ **/
+void
+stream_buffer_sub_data(GLenum target, size_t offset, size_t size,
+		       const void *data)
+{
+	GLuint buffer;
+	size_t from;
+	void *dest = stream_alloc(size, &buffer, &from);
+
+	if (! dest) {
+		glBufferSubData(target, offset, size, data);
+		return;
+	}
+
+	memcpy(dest, data, size);
+	gl_state_bind_buffer(GL_COPY_READ_BUFFER, buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, target, from, offset, size);
+}
+
+/**
+ * Stage pixel data in the ring for the next texture upload, and bind it as
+ * the pixel unpack buffer. Call stream_unpack_done after the upload.
+ *
+ * Returns: What to pass as the pixel data to glTexImage2D and friends.
+ **/
+const void *
+stream_unpack(const void *data, size_t size)
+{
+	GLuint buffer;
+	size_t from;
+	void *dest = stream_alloc(size, &buffer, &from);
+
+	if (! dest)
+		return data;
+
+	memcpy(dest, data, size);
+	gl_state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+	return (const void *)(uintptr_t)from;
+}
+
+/**
+ * Unbind the pixel unpack buffer after a stream_unpack upload, so later
+ * uploads read from client memory again.
+ **/
+void
+stream_unpack_done(void)
+{
+	gl_state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
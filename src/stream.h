@@ -0,0 +1,43 @@
+/**
+ * Copyright © 2013 Casey Dahlin
+ *
+ * This file is part of Luftballons.
+ *
+ * Luftballons is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Luftballons is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef STREAM_H
+#define STREAM_H
+#include <luftballons/stream.h>
+
+#include <GL/gl.h>
+
+#include "util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+API_DECLARE(stream_alloc);
+
+void stream_buffer_sub_data(GLenum target, size_t offset, size_t size,
+			    const void *data);
+const void *stream_unpack(const void *data, size_t size);
+void stream_unpack_done(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STREAM_H */
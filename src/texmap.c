@@ -27,6 +27,7 @@
 
 #include "texmap.h"
 #include "util.h"
+#include "gl_state.h"
 
 /* Texture unit assignment */
 texmap_t **units = NULL;
@@ -96,8 +97,8 @@ texmap_destructor(void *texmap_)
 
 	free(texmap->initialized);
 
-	glDeleteSamplers(1, &texmap->sampler);
-	glDeleteTextures(1, &texmap->map);
+	gl_state_delete_sampler(texmap->sampler);
+	gl_state_delete_texture(texmap->map);
 	free(texmap);
 	CHECK_GL;
 }
@@ -391,8 +392,7 @@ texmap_get_texture_unit(texmap_t *texmap)
 	}
 
 	if (units && units[texmap->texture_unit] == texmap) {
-		glActiveTexture(GL_TEXTURE0 + texmap->texture_unit);
-		glBindTexture(GL_TEXTURE_2D, texmap->map);
+		gl_state_bind_texture(texmap->texture_unit, texmap->map);
 		return texmap->texture_unit;
 	}
 
@@ -426,8 +426,7 @@ texmap_get_texture_unit(texmap_t *texmap)
 	units[i] = texmap;
 	texmap->texture_unit = i;
 
-	glActiveTexture(GL_TEXTURE0 + i);
-	glBindTexture(GL_TEXTURE_2D, texmap->map);
+	gl_state_bind_texture(i, texmap->map);
 	CHECK_GL;
 
 	return texmap->texture_unit;
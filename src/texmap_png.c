@@ -22,6 +22,7 @@
 
 #include "texmap.h"
 #include "util.h"
+#include "stream.h"
 
 /**
  * Hand our PNG data over to OpenGL.
@@ -34,27 +35,32 @@ texmap_png_load_data(texmap_t *map, GLint level,
 	GLenum gl_ifmt;
 	GLenum gl_fmt;
 	GLenum gl_type;
+	size_t channels;
 
 	switch (color_type) {
 	case PNG_COLOR_TYPE_GRAY:
 		gl_ifmt = GL_COMPRESSED_RED;
 		gl_fmt = GL_RED;
 		gl_type = GL_UNSIGNED_BYTE;
+		channels = 1;
 		break;
 	case PNG_COLOR_TYPE_GRAY_ALPHA:
 		gl_ifmt = GL_COMPRESSED_RG;
 		gl_fmt = GL_RG;
 		gl_type = GL_UNSIGNED_BYTE;
+		channels = 2;
 		break;
 	case PNG_COLOR_TYPE_RGB:
 		gl_ifmt = GL_COMPRESSED_RGB;
 		gl_fmt = GL_RGB;
 		gl_type = GL_UNSIGNED_BYTE;
+		channels = 3;
 		break;
 	case PNG_COLOR_TYPE_RGB_ALPHA:
 		gl_ifmt = GL_COMPRESSED_RGBA;
 		gl_fmt = GL_RGBA;
 		gl_type = GL_UNSIGNED_BYTE;
+		channels = 4;
 		break;
 	default:
 		errx(1, "Encountered unknown PNG format in %s", path);
@@ -65,7 +71,8 @@ texmap_png_load_data(texmap_t *map, GLint level,
 
 	texmap_get_texture_unit(map);
 	glTexImage2D(GL_TEXTURE_2D, level, gl_ifmt, width, height, 0, gl_fmt,
-		     gl_type, data);
+		     gl_type, stream_unpack(data, channels * width * height));
+	stream_unpack_done();
 	CHECK_GL;
 
 	map->w = width;
@@ -23,6 +23,7 @@
 
 #include "texmap.h"
 #include "util.h"
+#include "stream.h"
 
 int
 texmap_load_image_tiff(texmap_t *map, GLint level, int fd, const char *path)
@@ -49,7 +50,9 @@ texmap_load_image_tiff(texmap_t *map, GLint level, int fd, const char *path)
 
 	texmap_get_texture_unit(map);
 	glTexImage2D(GL_TEXTURE_2D, level, ifmt, width, height, 0, GL_RGBA,
-		     GL_UNSIGNED_BYTE, data);
+		     GL_UNSIGNED_BYTE,
+		     stream_unpack(data, width * height * sizeof(uint32_t)));
+	stream_unpack_done();
 
 	CHECK_GL;
 	TIFFClose(img);
@@ -18,6 +18,7 @@
  **/
 
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <err.h>
 #include <errno.h>
@@ -31,6 +32,117 @@
 #include "util.h"
 #include "texmap.h"
 
+#ifndef UNIFORM_NAME_HTABLE_INITIAL_SIZE
+#define UNIFORM_NAME_HTABLE_INITIAL_SIZE 64
+#endif
+
+/**
+ * Version to give the next uniform we create.
+ **/
+static uint64_t uniform_next_version = 1;
+
+/**
+ * Interned uniform names. A name's index in this list is its ID.
+ **/
+static char **uniform_names = NULL;
+static size_t num_uniform_names = 0;
+
+/**
+ * Hash table for looking up name IDs. Slots hold an ID plus one, or zero if
+ * empty. Always a power of two in size, and never more than half full.
+ **/
+static size_t *uniform_name_htable = NULL;
+static size_t uniform_name_htable_size = 0;
+
+/**
+ * Hash a uniform name.
+ **/
+static size_t
+uniform_name_hash(const char *name)
+{
+	size_t hash = 2166136261u;
+
+	for (; *name; name++) {
+		hash ^= (unsigned char)*name;
+		hash *= 16777619;
+	}
+
+	return hash;
+}
+
+/**
+ * Put a name ID into the hash table. The table must have room.
+ **/
+static void
+uniform_name_htable_insert(size_t id)
+{
+	size_t mask = uniform_name_htable_size - 1;
+	size_t slot = uniform_name_hash(uniform_names[id]) & mask;
+
+	while (uniform_name_htable[slot])
+		slot = (slot + 1) & mask;
+
+	uniform_name_htable[slot] = id + 1;
+}
+
+/**
+ * Double the size of the name hash table.
+ **/
+static void
+uniform_name_htable_grow(void)
+{
+	size_t i;
+
+	free(uniform_name_htable);
+
+	if (! uniform_name_htable_size)
+		uniform_name_htable_size = UNIFORM_NAME_HTABLE_INITIAL_SIZE;
+	else
+		uniform_name_htable_size *= 2;
+
+	uniform_name_htable = xcalloc(uniform_name_htable_size,
+				      sizeof(size_t));
+
+	for (i = 0; i < num_uniform_names; i++)
+		uniform_name_htable_insert(i);
+}
+
+/**
+ * Get the ID for a uniform name, assigning one if the name is new. IDs are
+ * small integers handed out in order, and are never reused. Callers creating
+ * the same uniform often can look the ID up once and use uniform_create_id.
+ **/
+size_t
+uniform_name_id(const char *name)
+{
+	size_t mask = uniform_name_htable_size - 1;
+	size_t slot;
+	size_t id;
+
+	if (uniform_name_htable_size) {
+		slot = uniform_name_hash(name) & mask;
+
+		for (; uniform_name_htable[slot]; slot = (slot + 1) & mask) {
+			id = uniform_name_htable[slot] - 1;
+
+			if (! strcmp(uniform_names[id], name))
+				return id;
+		}
+	}
+
+	id = num_uniform_names;
+	uniform_names = vec_expand(uniform_names, num_uniform_names);
+	uniform_names[num_uniform_names++] = xstrdup(name);
+
+	if (num_uniform_names * 2 > uniform_name_htable_size)
+		uniform_name_htable_grow();
+	else
+		uniform_name_htable_insert(id);
+
+	return id;
+}
+EXPORT(uniform_name_id);
+
 /**
  * Destructor for a shader uniform.
  **/
@@ -45,7 +157,6 @@ uniform_destructor(void *v)
 	if (uniform->type == UNIFORM_MAT4 || uniform->type == UNIFORM_VEC4)
 		free(uniform->value.data_ptr);
 
-	free(uniform->name);
 	free(uniform);
 }
 
@@ -78,22 +189,13 @@ uniform_create(uniform_type_t type, ...)
 EXPORT(uniform_create);
 
 /**
- * Create a uniform object. Use a va_list for the final indeterminite argument.
+ * Create a uniform object from a value. The value is read from the va_list.
  **/
-uniform_t *
-uniform_vcreate(uniform_type_t type, va_list ap)
+static uniform_t *
+uniform_vcreate_value(uniform_type_t type, size_t name_id, va_list ap)
 {
 	uniform_t *ret;
 	uniform_value_t value;
-	const char *name;
-
-	if (type == UNIFORM_CLONE) {
-		ret = va_arg(ap, uniform_t *);
-		uniform_grab(ret);
-		return ret;
-	}
-
-	name = va_arg(ap, const char *);
 
 	switch (type) {
 	case UNIFORM_MAT4:
@@ -122,10 +224,58 @@ uniform_vcreate(uniform_type_t type, va_list ap)
 	refcount_add_destructor(&ret->refcount, uniform_destructor, ret);
 	ret->type = type;
 	ret->value = value;
-	ret->name = xstrdup(name);
+	ret->version = uniform_next_version++;
+	ret->name = uniform_names[name_id];
+	ret->name_id = name_id;
+
+	return ret;
+}
+
+/**
+ * Create a uniform object. Use a va_list for the final indeterminite argument.
+ **/
+uniform_t *
+uniform_vcreate(uniform_type_t type, va_list ap)
+{
+	uniform_t *ret;
+
+	if (type == UNIFORM_CLONE) {
+		ret = va_arg(ap, uniform_t *);
+		uniform_grab(ret);
+		return ret;
+	}
+
+	return uniform_vcreate_value(type,
+				     uniform_name_id(va_arg(ap, const char *)),
+				     ap);
+}
+
+/**
+ * Create a uniform object, naming it by an ID from uniform_name_id.
+ *
+ * type: The type of uniform to create. May not be LUFT_UNIFORM_CLONE.
+ * name_id: The interned name of the uniform.
+ * value: The value to assign to the uniform.
+ **/
+uniform_t *
+uniform_create_id(uniform_type_t type, size_t name_id, ...)
+{
+	uniform_t *ret;
+	va_list ap;
+
+	if (name_id >= num_uniform_names)
+		errx(1, "Uniform name ID %zu was never assigned", name_id);
+
+	if (type == UNIFORM_CLONE)
+		errx(1, "Cannot clone a uniform by name ID");
+
+	va_start(ap, name_id);
+	ret = uniform_vcreate_value(type, name_id, ap);
+	va_end(ap);
 
 	return ret;
 }
+EXPORT(uniform_create_id);
 
 /**
  * Grab a uniform.
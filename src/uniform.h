@@ -22,6 +22,7 @@
 #include <luftballons/uniform.h>
 
 #include <stdarg.h>
+#include <stdint.h>
 
 #include <GL/gl.h>
 
@@ -46,11 +47,21 @@ typedef union uniform_value {
 
 /**
  * A uniform.
+ *
+ * name: Name of the uniform in the shader. Interned; never freed.
+ * name_id: Interned ID for name.
+ * type: Type of the uniform.
+ * value: Value of the uniform.
+ * version: Unique for every uniform value ever created, so shaders can tell
+ *          whether they already hold it.
+ * refcount: Reference counter.
  **/
 typedef struct uniform {
-	char *name;
+	const char *name;
+	size_t name_id;
 	uniform_type_t type;
 	uniform_value_t value;
+	uint64_t version;
 	refcounter_t refcount;
 } uniform_t;
 
@@ -58,7 +69,9 @@ typedef struct uniform {
 extern "C" {
 #endif
 
+API_DECLARE(uniform_name_id);
 API_DECLARE(uniform_create);
+API_DECLARE(uniform_create_id);
 API_DECLARE(uniform_grab);
 API_DECLARE(uniform_ungrab);
 
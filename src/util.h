@@ -30,6 +30,13 @@
 
 #include <config.h>
 
+#include <luftballons/gl_check.h>
+
+/* Most often we'll check for GL errors; set by --with-gl-checks. */
+#ifndef GL_CHECK_MAX
+#define GL_CHECK_MAX LUFT_GL_CHECK_FULL
+#endif
+
 #define OFFSET_OF(type, member) ((uintptr_t)&((type *)0)->member)
 #define CONTAINER_OF(ptr, type, member) ((type *)(((char *)ptr) - \
 						  OFFSET_OF(type, member)))
@@ -166,6 +173,24 @@ do_vec_expand(void *vec, size_t items, size_t item_sz)
 	return xrealloc(vec, items * 2 * item_sz);
 }
 
+/**
+ * Allocate an array big enough to hold the given number of items, with room
+ * to grow the way do_vec_expand expects.
+ *
+ * items: Number of items the array will hold.
+ * item_sz: Size of each item.
+ **/
+static inline void *
+do_vec_alloc_for(size_t items, size_t item_sz)
+{
+	size_t capacity = VEC_BASE_SIZE;
+
+	while (capacity < items)
+		capacity *= 2;
+
+	return xcalloc(capacity, item_sz);
+}
+
 /**
  * Contract an allocated array to be at least 66% used.
  *
@@ -201,7 +226,7 @@ do_vec_contract(void *vec, size_t items, size_t item_sz)
 #define vec_alloc(x, y) vec_expand((x*)NULL, y)
 #define vec_dup(x, y) ({					\
 	typeof(y) sz_ = (y);					\
-	typeof(x) mine_ = vec_expand((typeof(x))NULL, sz_);	\
+	typeof(x) mine_ = do_vec_alloc_for(sz_, sizeof(*(x)));	\
 	memcpy(mine_, (x), sizeof(*(x)) * sz_);			\
 	mine_;							\
 })
@@ -226,10 +251,16 @@ do_vec_contract(void *vec, size_t items, size_t item_sz)
 	vec_contract(vec_, sz_);			\
 })
 
+extern luft_gl_check_level_t gl_check_level;
+
 /**
- * Check whether an OpenGL error has occurred and die if it has.
+ * Check whether an OpenGL error has occurred and die if it has. Does nothing
+ * unless the check level calls for it: CHECK_GL_MEM checks need
+ * LUFT_GL_CHECK_MEM, others LUFT_GL_CHECK_FULL.
  *
- * mem_ok: If set, return -1 for GL_OUT_OF_MEMORY instead of dying.
+ * mem_ok: If set, return -1 for GL_OUT_OF_MEMORY instead of dying. Below
+ *         LUFT_GL_CHECK_FULL, other errors are ignored, since they came
+ *         from calls nobody checked.
  * file, line: File name and line number for error reporting.
  *
  * Returns: 0 unless mem_ok is set.
@@ -237,7 +268,14 @@ do_vec_contract(void *vec, size_t items, size_t item_sz)
 static inline int
 check_gl_ok(int mem_ok, const char *file, size_t line)
 {
-	GLenum error = glGetError();
+	luft_gl_check_level_t needed =
+		mem_ok ? LUFT_GL_CHECK_MEM : LUFT_GL_CHECK_FULL;
+	GLenum error;
+
+	if (needed > GL_CHECK_MAX || needed > gl_check_level)
+		return 0;
+
+	error = glGetError();
 
 	if (error == GL_NO_ERROR)
 		return 0;
@@ -245,6 +283,9 @@ check_gl_ok(int mem_ok, const char *file, size_t line)
 	if (error == GL_OUT_OF_MEMORY && mem_ok)
 		return -1;
 
+	if (gl_check_level < LUFT_GL_CHECK_FULL)
+		return 0;
+
 	if (error == GL_OUT_OF_MEMORY)
 		errx(1, "OpenGL ran out of memory at %s: %zd", file, line);
 
@@ -276,9 +317,32 @@ check_gl_ok(int mem_ok, const char *file, size_t line)
 	     error, file, line);
 }
 
+/**
+ * Get rid of any errors left over from earlier calls before an allocation
+ * checked with CHECK_GL_MEM, so they aren't taken for its result. At
+ * LUFT_GL_CHECK_FULL they're reported here like CHECK_GL would.
+ *
+ * file, line: File name and line number for error reporting.
+ **/
+static inline void
+clear_gl_mem(const char *file, size_t line)
+{
+	if (LUFT_GL_CHECK_MEM > GL_CHECK_MAX ||
+	    LUFT_GL_CHECK_MEM > gl_check_level)
+		return;
+
+	if (gl_check_level >= LUFT_GL_CHECK_FULL) {
+		check_gl_ok(0, file, line);
+		return;
+	}
+
+	while (glGetError() != GL_NO_ERROR);
+}
+
 #define CHECK_GL_MEM check_gl_ok(1, __FILE__, __LINE__)
 #define CHECK_GL check_gl_ok(0, __FILE__, __LINE__)
 #define CLEAR_GL glGetError()
+#define CLEAR_GL_MEM clear_gl_mem(__FILE__, __LINE__)
 
 /* Where the hell is this?! */
 #ifndef SIZE_T_MAX
@@ -23,12 +23,30 @@
 
 #include "vbuf.h"
 #include "util.h"
+#include "gl_state.h"
 
 /* We keep this out of shader.h to prevent circular dependency. */
 void shader_set_vertex_attrs();
 
+/**
+ * A vertex array object for drawing from a vbuf with a particular shader.
+ *
+ * shader_id: ID of the shader whose attribute locations we set up.
+ * gl_handle: OpenGL handle for the vertex array object.
+ **/
+struct vbuf_vertex_array {
+	uint64_t shader_id;
+	GLuint gl_handle;
+};
+
 vbuf_t *current_vbuf = NULL;
 
+/**
+ * Every live vbuf, so we can drop vertex arrays when their shader dies.
+ **/
+static vbuf_t **vbufs = NULL;
+static size_t num_vbufs = 0;
+
 /**
  * Activate a buffer. Don't check to see if it's already in service.
  **/
@@ -36,11 +54,28 @@ static void
 vbuf_do_activate(vbuf_t *buffer)
 {
 	current_vbuf = buffer;
-	glBindBuffer(GL_ARRAY_BUFFER, buffer->gl_handle);
+	gl_state_bind_buffer(GL_ARRAY_BUFFER, buffer->gl_handle);
 	shader_set_vertex_attrs();
 	CHECK_GL;
 }
 
+/**
+ * Delete all the vertex arrays that draw from a vbuf.
+ **/
+static void
+vbuf_drop_vertex_arrays(vbuf_t *buffer)
+{
+	size_t i;
+
+	for (i = 0; i < buffer->num_vertex_arrays; i++)
+		gl_state_delete_vertex_array(
+			buffer->vertex_arrays[i].gl_handle);
+
+	free(buffer->vertex_arrays);
+	buffer->vertex_arrays = NULL;
+	buffer->num_vertex_arrays = 0;
+}
+
 /**
  * Destroy a vbuf.
  **/
@@ -48,19 +83,36 @@ static void
 vbuf_destructor(void *buffer_)
 {
 	vbuf_t *buffer = buffer_;
+	size_t i;
 
-	if (current_vbuf == buffer) {
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	if (current_vbuf == buffer)
 		current_vbuf = NULL;
-	}
 
-	glDeleteBuffers(1, &buffer->gl_handle);
+	vbuf_drop_vertex_arrays(buffer);
+
+	for (i = 0; vbufs[i] != buffer; i++);
+	vbufs = vec_del(vbufs, num_vbufs, i);
+	num_vbufs--;
+
+	gl_state_delete_buffer(buffer->gl_handle);
 
 	intervals_release(&buffer->free);
 	free(buffer);
 	CHECK_GL;
 }
 
+/**
+ * Usage hint for a buffer holding the given format.
+ **/
+static GLenum
+vbuf_usage(vbuf_fmt_t format)
+{
+	if (format & VBUF_FMT_DYNAMIC)
+		return GL_DYNAMIC_DRAW;
+
+	return GL_STATIC_DRAW;
+}
+
 /**
  * Create a new buffer object.
  *
@@ -72,20 +124,24 @@ vbuf_create(size_t size, vbuf_fmt_t format)
 {
 	vbuf_t *ret;
 	GLuint handle;
-	GLsizeiptr byte_size = vbuf_fmt_vert_size(format);
+	GLsizeiptr byte_size = vbuf_fmt_stride(format);
 	int memfail;
 
 	if (! size)
 		return NULL;
 
+	CLEAR_GL_MEM;
 	glGenBuffers(1, &handle);
-	glBindBuffer(GL_ARRAY_BUFFER, handle);
-	glBufferData(GL_ARRAY_BUFFER, byte_size * size, NULL, GL_STATIC_DRAW);
+	gl_state_bind_buffer(GL_ARRAY_BUFFER, handle);
+	glBufferData(GL_ARRAY_BUFFER, byte_size * size, NULL,
+		     vbuf_usage(format));
 	memfail = CHECK_GL_MEM;
 
 
+	/* The attribute pointers still refer to the current buffer, so we
+	 * only need to put the binding back. */
 	if (current_vbuf)
-		vbuf_do_activate(current_vbuf);
+		gl_state_bind_buffer(GL_ARRAY_BUFFER, current_vbuf->gl_handle);
 
 	if (memfail)
 		return NULL;
@@ -95,54 +151,225 @@ vbuf_create(size_t size, vbuf_fmt_t format)
 	ret->vert_count = size;
 	ret->gl_handle = handle;
 	ret->format = format;
+	ret->vertex_arrays = NULL;
+	ret->num_vertex_arrays = 0;
+
+	vbufs = vec_expand(vbufs, num_vbufs);
+	vbufs[num_vbufs++] = ret;
 
 	refcount_init(&ret->refcount);
 	refcount_add_destructor(&ret->refcount, vbuf_destructor, ret);
 
-	intervals_init(&ret->free);
-	interval_set(&ret->free, 0, size);
+	intervals_init(&ret->free, size);
 
 	return ret;
 }
 
 /**
- * Setup the vertex attribute named for the attribute handle given.
+ * Grow a buffer to hold more vertices. The data moves to a new, bigger GL
+ * buffer, copied on the GPU, and the old one is orphaned. Offsets of regions
+ * already allocated don't change.
+ *
+ * Returns: 0 on success, -1 if we ran out of GPU memory.
  **/
-void
-vbuf_setup_vertex_attribute(const char *name, GLint handle)
+int
+vbuf_grow(vbuf_t *buffer, size_t size)
+{
+	vbuf_fmt_t iter = buffer->format;
+	size_t old_base = 0;
+	size_t new_base = 0;
+	size_t seg_size;
+	GLuint handle;
+	int memfail;
+
+	if (size <= buffer->vert_count)
+		return 0;
+
+	CLEAR_GL_MEM;
+	glGenBuffers(1, &handle);
+	gl_state_bind_buffer(GL_COPY_WRITE_BUFFER, handle);
+	glBufferData(GL_COPY_WRITE_BUFFER, buffer->vert_size * size, NULL,
+		     vbuf_usage(buffer->format));
+	memfail = CHECK_GL_MEM;
+
+	if (memfail) {
+		gl_state_delete_buffer(handle);
+		return -1;
+	}
+
+	gl_state_bind_buffer(GL_COPY_READ_BUFFER, buffer->gl_handle);
+
+	/* An interleaved buffer is one block. Otherwise each segment is stored
+	 * whole, so each starts further along. */
+	if (buffer->format & VBUF_FMT_INTERLEAVED) {
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+				    0, 0, buffer->vert_size * buffer->vert_count);
+	} else {
+		while (vbuf_fmt_pop_segment(&iter, NULL, NULL, NULL,
+					    &seg_size)) {
+			glCopyBufferSubData(GL_COPY_READ_BUFFER,
+					    GL_COPY_WRITE_BUFFER,
+					    old_base, new_base,
+					    seg_size * buffer->vert_count);
+			old_base += seg_size * buffer->vert_count;
+			new_base += seg_size * size;
+		}
+	}
+
+	/* The vertex arrays point into the old buffer's layout. */
+	vbuf_drop_vertex_arrays(buffer);
+	gl_state_delete_buffer(buffer->gl_handle);
+
+	buffer->gl_handle = handle;
+	buffer->vert_count = size;
+	intervals_grow(&buffer->free, size);
+
+	if (current_vbuf == buffer)
+		vbuf_do_activate(buffer);
+
+	CHECK_GL;
+	return 0;
+}
+
+/**
+ * Move an allocated region of a buffer to a free place nearer the start, to
+ * gather up free space.
+ *
+ * Returns: The new offset of the region or -1 if there's nowhere to go.
+ **/
+ssize_t
+vbuf_move_region_down(vbuf_t *buffer, size_t offset, size_t size)
 {
+	ssize_t to = interval_alloc_below(&buffer->free, size, offset);
+	vbuf_fmt_t iter = buffer->format;
+	size_t base = 0;
+	size_t seg_size;
+
+	if (to < 0)
+		return -1;
+
+	gl_state_bind_buffer(GL_COPY_READ_BUFFER, buffer->gl_handle);
+	gl_state_bind_buffer(GL_COPY_WRITE_BUFFER, buffer->gl_handle);
+
+	if (buffer->format & VBUF_FMT_INTERLEAVED) {
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+				    offset * buffer->vert_size,
+				    to * buffer->vert_size,
+				    size * buffer->vert_size);
+	} else {
+		while (vbuf_fmt_pop_segment(&iter, NULL, NULL, NULL,
+					    &seg_size)) {
+			glCopyBufferSubData(GL_COPY_READ_BUFFER,
+					    GL_COPY_WRITE_BUFFER,
+					    base + offset * seg_size,
+					    base + to * seg_size,
+					    size * seg_size);
+			base += seg_size * buffer->vert_count;
+		}
+	}
+
+	interval_free(&buffer->free, offset, size);
+	CHECK_GL;
+	return to;
+}
+
+/**
+ * Point the attributes of a program at the segments of a buffer, in the bound
+ * vertex array. Attributes the buffer has no segment for are left disabled.
+ **/
+static void
+vbuf_setup_vertex_attributes(vbuf_t *buffer, GLuint program)
+{
+	vbuf_fmt_t iter = buffer->format;
+	int interleaved = !! (buffer->format & VBUF_FMT_INTERLEAVED);
+	GLsizei stride = interleaved ? buffer->vert_size : 0;
 	size_t position = 0;
 	size_t elems;
-	vbuf_fmt_t iter;
-	const char *sname;
+	const char *name;
 	size_t size;
 	GLenum type;
-	int found = 0;
-
-	if (! current_vbuf)
-		return;
+	GLint loc;
 
-	iter = current_vbuf->format;
+	while (vbuf_fmt_pop_segment(&iter, &elems, &type, &name, &size)) {
+		loc = glGetAttribLocation(program, name);
 
-	while (vbuf_fmt_pop_segment(&iter, &elems, &type, &sname, &size)) {
-		if (! strcmp(sname, name)) {
-			found = 1;
-			break;
+		if (loc >= 0) {
+			glEnableVertexAttribArray(loc);
+			glVertexAttribPointer(loc, elems, type,
+					      vbuf_fmt_normalized(buffer->format,
+								  name),
+					      stride, (void *)position);
 		}
 
-		position += size * current_vbuf->vert_count;
+		if (interleaved)
+			position += vbuf_fmt_pad(size);
+		else
+			position += size * buffer->vert_count;
 	}
 
-	if (! found) {
-		glDisableVertexAttribArray(handle);
-		CHECK_GL;
+	CHECK_GL;
+}
+
+/**
+ * Bind the vertex array for drawing from the current buffer with the given
+ * shader, setting one up the first time the pair is used.
+ **/
+void
+vbuf_bind_vertex_array(GLuint program, uint64_t shader_id)
+{
+	struct vbuf_vertex_array *va;
+	size_t i;
+
+	if (! current_vbuf)
+		return;
+
+	for (i = 0; i < current_vbuf->num_vertex_arrays; i++) {
+		va = &current_vbuf->vertex_arrays[i];
+
+		if (va->shader_id != shader_id)
+			continue;
+
+		gl_state_bind_vertex_array(va->gl_handle);
 		return;
 	}
 
-	glEnableVertexAttribArray(handle);
-	glVertexAttribPointer(handle, elems, type, GL_FALSE, 0,
-			      (void *)position);
-	CHECK_GL;
+	current_vbuf->vertex_arrays = vec_expand(current_vbuf->vertex_arrays,
+						 current_vbuf->num_vertex_arrays);
+	va = &current_vbuf->vertex_arrays[current_vbuf->num_vertex_arrays++];
+	va->shader_id = shader_id;
+
+	glGenVertexArrays(1, &va->gl_handle);
+	gl_state_bind_vertex_array(va->gl_handle);
+	gl_state_bind_buffer(GL_ARRAY_BUFFER, current_vbuf->gl_handle);
+	vbuf_setup_vertex_attributes(current_vbuf, program);
+}
+
+/**
+ * Delete the vertex arrays belonging to a shader that is going away.
+ **/
+void
+vbuf_forget_shader(uint64_t shader_id)
+{
+	struct vbuf_vertex_array *va;
+	vbuf_t *buffer;
+	size_t i, j;
+
+	for (i = 0; i < num_vbufs; i++) {
+		buffer = vbufs[i];
+
+		for (j = 0; j < buffer->num_vertex_arrays; j++)
+			if (buffer->vertex_arrays[j].shader_id == shader_id)
+				break;
+
+		if (j == buffer->num_vertex_arrays)
+			continue;
+
+		va = &buffer->vertex_arrays[j];
+		gl_state_delete_vertex_array(va->gl_handle);
+		buffer->vertex_arrays = vec_del(buffer->vertex_arrays,
+						buffer->num_vertex_arrays, j);
+		buffer->num_vertex_arrays--;
+	}
 }
 
 /**
@@ -164,21 +391,26 @@ vbuf_ungrab(vbuf_t *buffer)
 }
 
 /**
- * Create a new free region and add it to a buffer's lists.
+ * Free a region of a buffer allocated with vbuf_alloc_region.
  **/
 void
 vbuf_drop_data(vbuf_t *buffer, size_t offset, size_t size)
 {
-	interval_set(&buffer->free, offset, size);
+	interval_free(&buffer->free, offset, size);
 }
 
 /**
  * Allocate a region of a buffer.
+ *
+ * buffer: Buffer to allocate from.
+ * size: Size of the region.
+ *
+ * Returns: Offset to the region or -1 if not enough space found.
  **/
-void
-vbuf_alloc_region(vbuf_t *buffer, size_t offset, size_t size)
+ssize_t
+vbuf_alloc_region(vbuf_t *buffer, size_t size)
 {
-	interval_unset(&buffer->free, offset, size);
+	return interval_alloc(&buffer->free, size);
 }
 
 /**
@@ -192,17 +424,3 @@ vbuf_activate(vbuf_t *buffer)
 
 	vbuf_do_activate(buffer);
 }
-
-/**
- * Locate some free space in a buffer.
- *
- * buffer: Buffer to search.
- * size: Size of free space to find.
- *
- * Returns: Offset to space or -1 if not enough space found.
- **/
-ssize_t
-vbuf_locate_free_space(vbuf_t *buffer, size_t size)
-{
-	return interval_find(&buffer->free, size);
-}
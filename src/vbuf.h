@@ -20,6 +20,8 @@
 #ifndef VBUF_H
 #define VBUF_H
 
+#include <stdint.h>
+
 #include <GL/gl.h>
 
 #include "interval.h"
@@ -34,12 +36,17 @@
  * format: Type of data in each segment.
  * vert_size: size of the data for a vertex in bytes.
  * vert_count: total verts in this buffer.
+ * vertex_arrays, num_vertex_arrays: Vertex array objects set up to draw
+ *                                   from this buffer, one per shader.
  * refcount: Reference counting.
  * free: Free space tracking.
  **/
 typedef struct vbuf {
 	GLuint gl_handle;
 
+	struct vbuf_vertex_array *vertex_arrays;
+	size_t num_vertex_arrays;
+
 	vbuf_fmt_t format;
 	size_t vert_size;
 	size_t vert_count;
@@ -58,9 +65,11 @@ void vbuf_grab(vbuf_t *buffer);
 void vbuf_ungrab(vbuf_t *buffer);
 void vbuf_drop_data(vbuf_t *buffer, size_t offset, size_t size);
 void vbuf_activate(vbuf_t *buffer);
-void vbuf_alloc_region(vbuf_t *buffer, size_t offset, size_t size);
-ssize_t vbuf_locate_free_space(vbuf_t *buffer, size_t size);
-void vbuf_setup_vertex_attribute(const char *name, GLint handle);
+ssize_t vbuf_alloc_region(vbuf_t *buffer, size_t size);
+int vbuf_grow(vbuf_t *buffer, size_t size);
+ssize_t vbuf_move_region_down(vbuf_t *buffer, size_t offset, size_t size);
+void vbuf_bind_vertex_array(GLuint program, uint64_t shader_id);
+void vbuf_forget_shader(uint64_t shader_id);
 
 #ifdef __cplusplus
 }
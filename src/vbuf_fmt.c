@@ -34,12 +34,15 @@
 
 /**
  * Table of segments. The index maps them to types.
+ *
+ * normalized: Set if integer data is read as normalised fixed point.
  **/
 static struct vbuf_segment {
 	size_t elems;
 	GLenum type;
 	const char *name;
-} vbuf_segments[64] = {{0,0,NULL}};
+	int normalized;
+} vbuf_segments[64] = {{0,0,NULL,0}};
 
 /**
  * Highest used entry in vbuf_segments.
@@ -108,6 +111,9 @@ vbuf_segment_hash(struct vbuf_segment *seg)
 		ret *= fnv_prime;
 	}
 
+	ret ^= seg->normalized;
+	ret *= fnv_prime;
+
 	return ret;
 }
 
@@ -129,13 +135,16 @@ vbuf_segment_lookup(struct vbuf_segment *seg)
 		if (vbuf_segments[ret].elems != seg->elems)
 			continue;
 
+		if (vbuf_segments[ret].normalized != seg->normalized)
+			continue;
+
 		if (strcmp(vbuf_segments[ret].name, seg->name))
 			continue;
 
 		return ret;
 	}
 
-	if (vbuf_segments_sz == 64)
+	if (vbuf_segments_sz == 61)
 		errx(1, "Ran out of vbuf segment descriptors");
 
 	seg->name = xstrdup(seg->name);
@@ -157,6 +166,11 @@ vbuf_segment_size(struct vbuf_segment *seg)
 	if (seg->type <= vbuf_type_sizes_max)
 		ret = vbuf_type_sizes[seg->type];
 
+	/* Packed types hold all the elements in one value. */
+	if (seg->type == GL_INT_2_10_10_10_REV ||
+	    seg->type == GL_UNSIGNED_INT_2_10_10_10_REV)
+		return ret;
+
 	if (ret)
 		return ret * seg->elems;
 
@@ -169,10 +183,24 @@ vbuf_segment_size(struct vbuf_segment *seg)
 void
 vbuf_fmt_add(vbuf_fmt_t *fmt, const char *name, size_t elems, GLenum type)
 {
-	struct vbuf_segment seg = { elems, type, name };
+	struct vbuf_segment seg = { elems, type, name, 0 };
+	vbuf_seg_id_t id = vbuf_segment_lookup(&seg);
+
+	*fmt |= (vbuf_fmt_t)1 << id;
+}
+
+/**
+ * Add a segment of integer data that is read as normalised fixed point to
+ * the given vbuf format.
+ **/
+void
+vbuf_fmt_add_normalized(vbuf_fmt_t *fmt, const char *name, size_t elems,
+			GLenum type)
+{
+	struct vbuf_segment seg = { elems, type, name, 1 };
 	vbuf_seg_id_t id = vbuf_segment_lookup(&seg);
 
-	*fmt |= 1 << id;
+	*fmt |= (vbuf_fmt_t)1 << id;
 }
 
 /**
@@ -184,6 +212,8 @@ vbuf_fmt_do_pop_segment(vbuf_fmt_t *iter)
 	vbuf_seg_id_t id = 0;
 	vbuf_fmt_t mask = 1;
 
+	*iter &= ~VBUF_FMT_FLAGS;
+
 	if (! *iter)
 		return NULL;
 
@@ -212,6 +242,52 @@ vbuf_fmt_vert_size(vbuf_fmt_t fmt)
 	return ret;
 }
 
+/**
+ * Check whether the segment with the given name in the given format should be
+ * read as normalised fixed point.
+ **/
+int
+vbuf_fmt_normalized(vbuf_fmt_t fmt, const char *name)
+{
+	struct vbuf_segment *seg;
+
+	while ((seg = vbuf_fmt_do_pop_segment(&fmt)))
+		if (! strcmp(seg->name, name))
+			return seg->normalized;
+
+	return 0;
+}
+
+/**
+ * Round a segment size up to the alignment segments keep within an
+ * interleaved vertex.
+ **/
+size_t
+vbuf_fmt_pad(size_t size)
+{
+	return (size + VBUF_FMT_ALIGN - 1) & ~(size_t)(VBUF_FMT_ALIGN - 1);
+}
+
+/**
+ * Find the buffer space a vertex in the given format takes up. This is the
+ * same as the vertex size unless the format is interleaved, in which case it
+ * includes the padding to keep each segment aligned.
+ **/
+size_t
+vbuf_fmt_stride(vbuf_fmt_t fmt)
+{
+	struct vbuf_segment *seg;
+	size_t ret = 0;
+
+	if (! (fmt & VBUF_FMT_INTERLEAVED))
+		return vbuf_fmt_vert_size(fmt);
+
+	while ((seg = vbuf_fmt_do_pop_segment(&fmt)))
+		ret += vbuf_fmt_pad(vbuf_segment_size(seg));
+
+	return ret;
+}
+
 /**
  * Remove one of the segments from the given vbuf_fmt_t and return its
  * parameters.
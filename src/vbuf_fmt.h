@@ -30,6 +30,33 @@
  **/
 typedef uint64_t vbuf_fmt_t;
 
+/**
+ * Flag in a vbuf_fmt_t saying vertices are stored interleaved, with all the
+ * segments for one vertex together, rather than each segment stored whole.
+ **/
+#define VBUF_FMT_INTERLEAVED ((vbuf_fmt_t)1 << 63)
+
+/**
+ * Flag in a vbuf_fmt_t asking for meshes to be quantised when they're
+ * created (see mesh_compress).
+ **/
+#define VBUF_FMT_COMPRESSED ((vbuf_fmt_t)1 << 62)
+
+/**
+ * Flag in a vbuf_fmt_t saying meshes will be changed after they're created
+ * (see mesh_update). They're kept in buffers of their own.
+ **/
+#define VBUF_FMT_DYNAMIC ((vbuf_fmt_t)1 << 61)
+
+/* Flag bits, which are never used for segments. */
+#define VBUF_FMT_FLAGS \
+	(VBUF_FMT_INTERLEAVED | VBUF_FMT_COMPRESSED | VBUF_FMT_DYNAMIC)
+
+/* Alignment of each segment within an interleaved vertex, in bytes. */
+#ifndef VBUF_FMT_ALIGN
+#define VBUF_FMT_ALIGN 4
+#endif
+
 /**
  * A segment ID. Basically contains an index for a bit in vbuf_fmt_t.
  **/
@@ -42,6 +69,11 @@ extern "C" {
 void vbuf_fmt_add(vbuf_fmt_t *fmt, const char *name, size_t elems,
 		  GLenum type);
 size_t vbuf_fmt_vert_size(vbuf_fmt_t fmt);
+size_t vbuf_fmt_stride(vbuf_fmt_t fmt);
+size_t vbuf_fmt_pad(size_t size);
+void vbuf_fmt_add_normalized(vbuf_fmt_t *fmt, const char *name, size_t elems,
+			     GLenum type);
+int vbuf_fmt_normalized(vbuf_fmt_t fmt, const char *name);
 int vbuf_fmt_pop_segment(vbuf_fmt_t *iter, size_t *elems, GLenum *type,
 			 const char **name, size_t *size);
 
@@ -19,10 +19,24 @@
  * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
  **/
 
+/* Without LUFT_FORMAT this is the general version, taking every attribute.
+ * Variants for a vertex format only take the attributes the format has. */
+#ifndef LUFT_FORMAT
+#define LUFT_HAVE_COLOR
+#define LUFT_HAVE_NORMAL
+#define LUFT_HAVE_TEXCOORD
+#endif
+
 in vec4 position;
+#ifdef LUFT_HAVE_COLOR
 in vec4 color;
+#endif
+#ifdef LUFT_HAVE_NORMAL
 in vec3 normal;
+#endif
+#ifdef LUFT_HAVE_TEXCOORD
 in vec4 texcoord;
+#endif
 out vec4 colorout;
 out vec4 normalout;
 out vec4 texcoordout;
@@ -30,11 +44,53 @@ out vec4 posout;
 uniform mat4 transform;
 uniform mat4 clip_transform;
 
+/* Compressed formats store positions relative to the mesh's bounding box and
+ * normals in fixed point, which may leave them slightly off unit length. */
+#ifdef LUFT_COMPRESSED
+uniform vec4 position_offset;
+uniform vec4 position_scale;
+
+vec4 luft_decode_position(vec4 p)
+{
+	return vec4(p.xyz * position_scale.xyz + position_offset.xyz, 1);
+}
+
+vec3 luft_decode_normal(vec3 n)
+{
+	return normalize(n);
+}
+#else
+vec4 luft_decode_position(vec4 p)
+{
+	return p;
+}
+
+vec3 luft_decode_normal(vec3 n)
+{
+	return n;
+}
+#endif
+
 void main()
 {
-	posout = transform * position;
-	gl_Position = clip_transform * transform * position;
+	vec4 pos = luft_decode_position(position);
+
+	posout = transform * pos;
+	gl_Position = clip_transform * transform * pos;
+	/* Missing attributes read as (0, 0, 0, 1) */
+#ifdef LUFT_HAVE_COLOR
 	colorout = color;
+#else
+	colorout = vec4(0, 0, 0, 1);
+#endif
+#ifdef LUFT_HAVE_TEXCOORD
 	texcoordout = texcoord;
-	normalout = transform * vec4(normal, 0);
+#else
+	texcoordout = vec4(0, 0, 0, 1);
+#endif
+#ifdef LUFT_HAVE_NORMAL
+	normalout = transform * vec4(luft_decode_normal(normal), 0);
+#else
+	normalout = vec4(0, 0, 0, 0);
+#endif
 }
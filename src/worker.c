@@ -0,0 +1,162 @@
+/**
+ * Copyright © 2013 Casey Dahlin
+ *
+ * This file is part of Luftballons.
+ *
+ * Luftballons is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Luftballons is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <err.h>
+#include <pthread.h>
+
+#include "worker.h"
+
+/* Most worker threads we'll start, however many CPUs there are. */
+#ifndef WORKER_MAX_THREADS
+#define WORKER_MAX_THREADS 8
+#endif
+
+/**
+ * The job queue. Jobs are taken from the head and added at the tail.
+ **/
+static worker_job_t *worker_queue_head = NULL;
+static worker_job_t *worker_queue_tail = NULL;
+
+static pthread_mutex_t worker_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Signalled when a job is queued, and when one finishes.
+ **/
+static pthread_cond_t worker_queued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t worker_finished = PTHREAD_COND_INITIALIZER;
+
+static int worker_threads_started = 0;
+
+/**
+ * Main loop of a worker thread.
+ **/
+static void *
+worker_main(void *unused)
+{
+	worker_job_t *job;
+
+	(void)unused;
+
+	pthread_mutex_lock(&worker_lock);
+
+	for (;;) {
+		while (! worker_queue_head)
+			pthread_cond_wait(&worker_queued, &worker_lock);
+
+		job = worker_queue_head;
+		worker_queue_head = job->next;
+
+		if (! worker_queue_head)
+			worker_queue_tail = NULL;
+
+		pthread_mutex_unlock(&worker_lock);
+		job->func(job->data);
+		pthread_mutex_lock(&worker_lock);
+
+		job->done = 1;
+		pthread_cond_broadcast(&worker_finished);
+	}
+
+	return NULL;
+}
+
+/**
+ * Start the worker threads. Called with worker_lock held.
+ **/
+static void
+worker_start_threads(void)
+{
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	pthread_t thread;
+	long i;
+
+	if (count < 1)
+		count = 1;
+
+	if (count > WORKER_MAX_THREADS)
+		count = WORKER_MAX_THREADS;
+
+	for (i = 0; i < count; i++) {
+		if (pthread_create(&thread, NULL, worker_main, NULL))
+			errx(1, "Could not start worker thread");
+
+		pthread_detach(thread);
+	}
+
+	worker_threads_started = 1;
+}
+
+/**
+ * Queue a job to run func(data) on a worker thread. The job must stay valid
+ * until it is done.
+ **/
+void
+worker_submit(worker_job_t *job, void (*func)(void *), void *data)
+{
+	job->func = func;
+	job->data = data;
+	job->done = 0;
+	job->next = NULL;
+
+	pthread_mutex_lock(&worker_lock);
+
+	if (! worker_threads_started)
+		worker_start_threads();
+
+	if (worker_queue_tail)
+		worker_queue_tail->next = job;
+	else
+		worker_queue_head = job;
+
+	worker_queue_tail = job;
+
+	pthread_cond_signal(&worker_queued);
+	pthread_mutex_unlock(&worker_lock);
+}
+
+/**
+ * Check whether a job has finished, without waiting.
+ **/
+int
+worker_job_done(worker_job_t *job)
+{
+	int ret;
+
+	pthread_mutex_lock(&worker_lock);
+	ret = job->done;
+	pthread_mutex_unlock(&worker_lock);
+
+	return ret;
+}
+
+/**
+ * Wait for a job to finish.
+ **/
+void
+worker_job_wait(worker_job_t *job)
+{
+	pthread_mutex_lock(&worker_lock);
+
+	while (! job->done)
+		pthread_cond_wait(&worker_finished, &worker_lock);
+
+	pthread_mutex_unlock(&worker_lock);
+}
@@ -0,0 +1,52 @@
+/**
+ * Copyright © 2013 Casey Dahlin
+ *
+ * This file is part of Luftballons.
+ *
+ * Luftballons is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * Luftballons is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with Luftballons.  If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef WORKER_H
+#define WORKER_H
+
+#include "util.h"
+
+/**
+ * A unit of work for the worker threads.
+ *
+ * func: Function to run on a worker thread.
+ * data: Argument to func.
+ * done: Set once func has returned. Only read through worker_job_done.
+ * next: Next job in the queue.
+ **/
+typedef struct worker_job {
+	void (*func)(void *data);
+	void *data;
+	int done;
+	struct worker_job *next;
+} worker_job_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void worker_submit(worker_job_t *job, void (*func)(void *), void *data);
+int worker_job_done(worker_job_t *job);
+void worker_job_wait(worker_job_t *job);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* WORKER_H */